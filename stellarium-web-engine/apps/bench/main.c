@@ -0,0 +1,360 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * swe-bench: headless benchmark of the engine.
+ *
+ * Load the test sky data from the local filesystem, then call core_update
+ * and core_render for a given number of frames while moving the observer
+ * around, and print the time spent in each frame.  Build it with:
+ *
+ *   make bench
+ *
+ * The program is meant to be run with perf, valgrind, etc.  It is compiled
+ * with NO_GL, so nothing is actually rendered.
+ *
+ * With --replay, instead of the built-in motion we replay a navigation
+ * record (see replay.h, and the samples in apps/bench/replays) at a fixed
+ * 60 fps clock.  After each frame we wait for the background workers to
+ * finish, so that two runs load the same tiles at the same frames.
+ */
+
+#include "swe.h"
+#include "render_null.h"
+#include "replay.h"
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char  *data_dir;
+    const char  *pack_path;
+    const char  *trace_path;
+    const char  *replay_path;
+    int         nb_frames;
+    int         warmup;
+    int         win_size[2];
+    bool        quiet;
+    bool        record;
+    bool        run_tests;
+} args_t;
+
+// Render commands stats, when recording is enabled.
+typedef struct {
+    int64_t     nb_cmds;
+    int64_t     nb_state_changes;
+    int64_t     nb_tex_binds;
+} cmds_stats_t;
+
+// Frame rate of the replay virtual clock.
+#define REPLAY_FPS 60
+
+// Virtual clock used when we replay a record.
+static double g_clock = 0;
+
+static double get_clock(void *user)
+{
+    return g_clock;
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_source(const char *module, const char *data_dir,
+                       const char *path, const char *key)
+{
+    char url[1024];
+    obj_t *m = core_get_module(module);
+    assert(m);
+    snprintf(url, sizeof(url), "%s/%s", data_dir, path);
+    module_add_data_source(m, url, key);
+}
+
+static void add_sources(const char *data_dir)
+{
+    add_source("stars", data_dir, "stars", NULL);
+    add_source("skycultures", data_dir, "skycultures/western", "western");
+    add_source("dsos", data_dir, "dso", NULL);
+    add_source("landscapes", data_dir, "landscapes/guereins", "guereins");
+    add_source("milkyway", data_dir, "surveys/milkyway", NULL);
+    add_source("minor_planets", data_dir, "mpcorb.dat", "mpc_asteroids");
+    add_source("planets", data_dir, "surveys/sso/moon", "moon");
+    add_source("planets", data_dir, "surveys/sso/sun", "sun");
+    add_source("planets", data_dir, "surveys/sso/moon", "default");
+    add_source("comets", data_dir, "CometEls.txt", "mpc_comets");
+    add_source("satellites", data_dir, "tle_satellite.jsonl.gz", "jsonl/sat");
+}
+
+// Scripted observer motion: a full turn in azimuth while oscillating in
+// altitude and zooming in and out between 120° and 5°.
+static void move_observer(int frame, int nb_frames)
+{
+    double t = (double)frame / nb_frames;
+    core->observer->yaw = t * 2 * M_PI;
+    core->observer->pitch = (20 + 30 * sin(t * 4 * M_PI)) * DD2R;
+    core->fov = exp(log(120 * DD2R) +
+                    (log(5 * DD2R) - log(120 * DD2R)) *
+                    (0.5 - 0.5 * cos(t * 2 * M_PI)));
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    return cmp(*(const double*)a, *(const double*)b);
+}
+
+static void print_summary(const double *times, int n)
+{
+    double *sorted, total = 0;
+    int i;
+    if (n <= 0) return;
+    sorted = malloc(n * sizeof(*sorted));
+    memcpy(sorted, times, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), cmp_double);
+    for (i = 0; i < n; i++) total += times[i];
+    printf("frames: %d\n", n);
+    printf("total:  %.3f s\n", total);
+    printf("avg:    %.3f ms\n", total / n * 1000);
+    printf("p50:    %.3f ms\n", sorted[n / 2] * 1000);
+    printf("p95:    %.3f ms\n", sorted[(int)(n * 0.95)] * 1000);
+    printf("max:    %.3f ms\n", sorted[n - 1] * 1000);
+    free(sorted);
+}
+
+static void add_cmds_stats(cmds_stats_t *stats)
+{
+    const render_cmd_t *cmds;
+    int i, nb;
+    cmds = render_null_get_cmds(core->rend, &nb);
+    for (i = 0; i < nb; i++) {
+        stats->nb_cmds++;
+        stats->nb_state_changes += cmds[i].state_change;
+        stats->nb_tex_binds += cmds[i].tex_bind;
+    }
+}
+
+static replay_t *load_replay(const char *path)
+{
+    char *data;
+    int size;
+    json_value *json;
+    replay_t *replay;
+
+    data = read_file(path, &size);
+    if (!data) {
+        LOG_E("Cannot read %s", path);
+        return NULL;
+    }
+    json = json_parse(data, size);
+    free(data);
+    if (!json) {
+        LOG_E("Cannot parse %s", path);
+        return NULL;
+    }
+    replay = replay_create(json);
+    json_value_free(json);
+    return replay;
+}
+
+// Wait until all the queued background work is done.
+static void wait_workers(void)
+{
+    while (worker_pool_get_nb_pending()) usleep(100);
+}
+
+static int save_trace(const char *path)
+{
+    json_value *json;
+    char *buf;
+    FILE *file;
+    json_serialize_opts opts = {.mode = json_serialize_mode_packed};
+
+    file = fopen(path, "w");
+    if (!file) {
+        LOG_E("Cannot open %s", path);
+        return -1;
+    }
+    json = trace_to_json();
+    buf = calloc(1, json_measure_ex(json, opts));
+    json_serialize_ex(buf, json, opts);
+    fputs(buf, file);
+    fclose(file);
+    free(buf);
+    json_builder_free(json);
+    return 0;
+}
+
+static void usage(void)
+{
+    printf("Usage: swe-bench [OPTIONS]\n"
+           "  -d, --data=DIR     Sky data directory (apps/test-skydata)\n"
+           "  -k, --pack=FILE    Serve the data dir surveys from a tile pack\n"
+           "  -n, --frames=N     Number of measured frames (600)\n"
+           "  -w, --warmup=N     Frames to run before measuring (60)\n"
+           "  -s, --size=WxH     Window size (1024x768)\n"
+           "  -q, --quiet        Only print the summary\n"
+           "  -r, --record       Record the render commands\n"
+           "  -t, --trace=FILE   Save a Chrome trace of the measured frames\n"
+           "  -p, --replay=FILE  Replay a navigation record at %d fps\n"
+           "      --tests        Run the unit tests and exit\n",
+           REPLAY_FPS);
+}
+
+static int parse_args(int argc, char **argv, args_t *args)
+{
+    int c;
+    const struct option options[] = {
+        {"data",    required_argument,  NULL, 'd'},
+        {"pack",    required_argument,  NULL, 'k'},
+        {"frames",  required_argument,  NULL, 'n'},
+        {"warmup",  required_argument,  NULL, 'w'},
+        {"size",    required_argument,  NULL, 's'},
+        {"quiet",   no_argument,        NULL, 'q'},
+        {"record",  no_argument,        NULL, 'r'},
+        {"trace",   required_argument,  NULL, 't'},
+        {"replay",  required_argument,  NULL, 'p'},
+        {"tests",   no_argument,        NULL, 'T'},
+        {"help",    no_argument,        NULL, 'h'},
+        {}
+    };
+    while ((c = getopt_long(argc, argv, "d:k:n:w:s:qrt:p:h",
+                            options, NULL)) != -1) {
+        switch (c) {
+        case 'd': args->data_dir = optarg; break;
+        case 'k': args->pack_path = optarg; break;
+        case 'n': args->nb_frames = atoi(optarg); break;
+        case 'w': args->warmup = atoi(optarg); break;
+        case 's':
+            if (sscanf(optarg, "%dx%d",
+                       &args->win_size[0], &args->win_size[1]) != 2)
+                return -1;
+            break;
+        case 'q': args->quiet = true; break;
+        case 'r': args->record = true; break;
+        case 't': args->trace_path = optarg; break;
+        case 'p': args->replay_path = optarg; break;
+        case 'T': args->run_tests = true; break;
+        default: return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    args_t args = {
+        .data_dir = "apps/test-skydata",
+        .nb_frames = 600,
+        .warmup = 60,
+        .win_size = {1024, 768},
+    };
+    double *times, t, win_size[2];
+    int i, tiles_visited = 0, tiles_loaded = 0;
+    const arena_t *arena;
+    cmds_stats_t stats = {};
+    replay_t *replay = NULL;
+
+    if (parse_args(argc, argv, &args)) {
+        usage();
+        return -1;
+    }
+
+    if (args.run_tests) {
+        tests_run("auto");
+        return 0;
+    }
+
+    if (args.replay_path) {
+        replay = load_replay(args.replay_path);
+        if (!replay) return -1;
+        sys_callbacks.get_time = get_clock;
+    }
+
+    win_size[0] = args.win_size[0];
+    win_size[1] = args.win_size[1];
+    core_init(win_size[0], win_size[1], 1.0);
+    // Use a fixed date close to the epoch of the test satellites data, so
+    // that all the runs compute the same sky.
+    obj_set_attr(&core->observer->obj, "utc", 58880.8);
+    if (args.pack_path && asset_add_pack(args.data_dir, args.pack_path))
+        return -1;
+    add_sources(args.data_dir);
+    if (replay) {
+        replay_init(replay, &g_clock, win_size);
+        // Run until one second after the last event.
+        args.nb_frames = (replay_get_duration(replay) + 1) * REPLAY_FPS;
+    }
+
+    // With a replay the clock doesn't move during the warmup, so we only
+    // load the data around the initial view.
+    for (i = 0; i < args.warmup; i++) {
+        if (!replay) move_observer(i, args.warmup + args.nb_frames);
+        core_update();
+        core_render(win_size[0], win_size[1], 1.0);
+        if (replay) wait_workers();
+    }
+
+    if (args.record) {
+        // The renderer is only created on the first call to core_render.
+        if (!core->rend) core->rend = render_create();
+        render_null_set_recording(core->rend, true, false);
+    }
+
+    if (args.trace_path) trace_start(0);
+
+    times = calloc(args.nb_frames, sizeof(*times));
+    for (i = 0; i < args.nb_frames; i++) {
+        if (replay) {
+            replay_apply(replay, (double)i / REPLAY_FPS);
+        } else {
+            move_observer(args.warmup + i, args.warmup + args.nb_frames);
+        }
+        t = get_time();
+        core_update();
+        core_render(win_size[0], win_size[1], 1.0);
+        times[i] = get_time() - t;
+        tiles_visited += profiler_get_count(PROFILE_TILES_VISITED);
+        tiles_loaded += profiler_get_count(PROFILE_TILES_LOADED);
+        if (!args.quiet) printf("frame %d: %.3f ms\n", i, times[i] * 1000);
+        if (args.record) add_cmds_stats(&stats);
+        if (replay) {
+            wait_workers();
+            g_clock += 1.0 / REPLAY_FPS;
+        }
+    }
+    print_summary(times, args.nb_frames);
+    if (args.nb_frames > 0) {
+        printf("tiles visited: %d (%.1f per frame)\n", tiles_visited,
+               (double)tiles_visited / args.nb_frames);
+        printf("tiles loaded:  %d\n", tiles_loaded);
+        arena = render_get_arena(core->rend);
+        printf("frame arena:   %.0f KiB peak, %d blocks allocated\n",
+               arena->peak / 1024., arena->nb_mallocs);
+    }
+    if (args.trace_path) {
+        trace_stop();
+        save_trace(args.trace_path);
+    }
+    if (args.record && args.nb_frames > 0) {
+        printf("render commands per frame: %.1f\n",
+               (double)stats.nb_cmds / args.nb_frames);
+        printf("state changes per frame:   %.1f\n",
+               (double)stats.nb_state_changes / args.nb_frames);
+        printf("texture binds per frame:   %.1f\n",
+               (double)stats.nb_tex_binds / args.nb_frames);
+    }
+    free(times);
+    replay_delete(replay);
+    core_release();
+    return 0;
+}
@@ -26,6 +26,10 @@ struct item
     double b; // Semi-minor axis.
     double angle;
     obj_t  *obj;
+    // If set, used to create the object when we pick the area.
+    obj_t  *(*get_obj)(void *user, uint64_t id);
+    void   *user;
+    uint64_t id;
 };
 
 struct areas
@@ -76,6 +80,19 @@ void areas_add_circle(areas_t *areas, const double pos[2], double r,
     utarray_push_back(areas->items, &item);
 }
 
+void areas_add_circle_deferred(areas_t *areas, const double pos[2], double r,
+                               obj_t *(*get_obj)(void *user, uint64_t id),
+                               void *user, uint64_t id)
+{
+    item_t item = {};
+    memcpy(item.pos, pos, sizeof(item.pos));
+    item.a = item.b = r;
+    item.get_obj = get_obj;
+    item.user = user;
+    item.id = id;
+    utarray_push_back(areas->items, &item);
+}
+
 void areas_add_ellipse(areas_t *areas, const double pos[2], double angle,
                        double a, double b, const obj_t *obj)
 {
@@ -139,5 +156,6 @@ obj_t *areas_lookup(const areas_t *areas, const double pos[2], double max_dist)
         }
     }
     if (!best) return NULL;
+    if (best->get_obj) return best->get_obj(best->user, best->id);
     return obj_retain(best->obj);
 }
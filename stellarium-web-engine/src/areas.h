@@ -37,6 +37,28 @@ areas_t *areas_create(void);
 void areas_add_circle(areas_t *areas, const double pos[2], double r,
                       const obj_t *obj);
 
+/*
+ * Function: areas_add_circle_deferred
+ * Same as areas_add_circle, but the object is only created if the area gets
+ * picked by <areas_lookup>.
+ *
+ * This avoids creating objects for all the points we render, when most of
+ * them will never be picked.
+ *
+ * Parameters:
+ *   areas   - an areas instance.
+ *   pos     - a 2d position in window space.
+ *   r       - radius in window space.
+ *   get_obj - function that returns a new reference to the object, or NULL
+ *             if it doesn't exist anymore.
+ *   user    - pointer passed to get_obj.  It should stay valid as long
+ *             as the areas are not cleared.
+ *   id      - id passed to get_obj.
+ */
+void areas_add_circle_deferred(areas_t *areas, const double pos[2], double r,
+                               obj_t *(*get_obj)(void *user, uint64_t id),
+                               void *user, uint64_t id);
+
 void areas_add_ellipse(areas_t *areas, const double pos[2], double angle,
                        double a, double b,
                        const obj_t *obj);
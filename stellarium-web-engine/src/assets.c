@@ -41,11 +41,21 @@ struct asset
     int             size;
     int             last_used;
     int             delay;
+    int             priority;   // Request priority.
 };
 
 // Global map of all the assets.
 static asset_t *g_assets = NULL;
 
+// Packs of files mounted at a given base url.
+typedef struct pack_mount pack_mount_t;
+struct pack_mount {
+    char            *base_url;
+    tile_pack_t     *pack;
+    pack_mount_t    *next;
+};
+static pack_mount_t *g_packs = NULL;
+
 // Global hook function.
 static struct {
     void *user;
@@ -87,6 +97,33 @@ static bool file_exists(const char *path)
     return false;
 }
 
+static int get_priority(int flags)
+{
+    if (flags & ASSET_PREFETCH) return REQUEST_PREFETCH;
+    if (flags & ASSET_CATALOG) return REQUEST_CATALOG;
+    return REQUEST_VISIBLE;
+}
+
+/*
+ * Look for an url in the mounted packs.  The data points directly into
+ * the mapped pack, so we don't need to create an asset for it.
+ */
+static const void *get_packed_data(const char *url, int *size)
+{
+    pack_mount_t *mount;
+    const void *data;
+    int len;
+
+    for (mount = g_packs; mount; mount = mount->next) {
+        len = strlen(mount->base_url);
+        if (strncmp(url, mount->base_url, len) != 0 || url[len] != '/')
+            continue;
+        data = tile_pack_get_path(mount->pack, url + len + 1, size);
+        if (data) return data;
+    }
+    return NULL;
+}
+
 static asset_t *asset_get(const char *url, int flags)
 {
     asset_t *asset;
@@ -97,6 +134,7 @@ static asset_t *asset_get(const char *url, int flags)
         asset->url = strdup(url);
         asset->flags |= flags;
         if (flags & ASSET_DELAY) asset->delay = DEFAULT_DELAY;
+        asset->priority = get_priority(flags);
         HASH_ADD_KEYPTR(hh, g_assets, asset->url, strlen(asset->url), asset);
     }
     asset->last_used = 0;
@@ -140,16 +178,26 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
     code = code ?: &default_code;
 
     assets_update();
-    asset = asset_get(url, flags);
     *code = 0;
     *size = 0;
 
+    if (g_packs) {
+        data = get_packed_data(url, size);
+        if (data) {
+            *code = 200;
+            return data;
+        }
+    }
+
+    asset = asset_get(url, flags);
+
     if (!asset) {
         *code = 404;
         goto end;
     }
 
     if (!asset->data && asset->compressed_data) {
+        TRACE_SCOPE_DETAIL("assets", "uncompress", url);
         asset->size = ((uint32_t*)asset->compressed_data)[0];
         assert(asset->size > 0);
         // Always add a NULL byte at the end so that text data are properly
@@ -199,6 +247,12 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code)
             return NULL;
         }
         asset->request = request_create(asset->url);
+        request_set_priority(asset->request, asset->priority);
+    }
+    // Promote the request if we now need the data more urgently.
+    if (get_priority(flags) < asset->priority) {
+        asset->priority = get_priority(flags);
+        request_set_priority(asset->request, asset->priority);
     }
     data = request_get_data(asset->request, size, code);
     if (*code && data && (flags & ASSET_USED_ONCE))
@@ -263,6 +317,23 @@ void asset_release(const char *url)
     asset_release_(asset);
 }
 
+int asset_add_pack(const char *base_url, const char *path)
+{
+    pack_mount_t *mount;
+    tile_pack_t *pack;
+
+    pack = tile_pack_open(path);
+    if (!pack) {
+        LOG_E("Cannot open tile pack %s", path);
+        return -1;
+    }
+    mount = calloc(1, sizeof(*mount));
+    mount->base_url = strdup(base_url);
+    mount->pack = pack;
+    LL_APPEND(g_packs, mount);
+    return 0;
+}
+
 /*
  * Function: asset_set_hook
  * Set a global function to handle special urls.
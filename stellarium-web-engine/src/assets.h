@@ -20,6 +20,9 @@
  * - A bundled data url (asset://something).
  * - A local filesytem path (/path/to/something).
  *
+ * The urls under a base url with a mounted tile pack (see <asset_add_pack>)
+ * are served directly from the pack when it contains them.
+ *
  * The function <asset_get_data> return the data associated with an url
  * if available, and the function <asset_release> is a hint to the assets
  * manager that we won't need this asset anymore.
@@ -36,11 +39,19 @@
  *   ASSET_ACCEPT_404   - Do not log error on a 404 return.
  *   ASSET_USED_ONCE    - Hint that the data can be release after it has
  *                        been read.
+ *   ASSET_PREFETCH     - Low priority download of data we might need soon.
+ *   ASSET_CATALOG      - Low priority download of a catalog file.
+ *
+ * Without ASSET_PREFETCH or ASSET_CATALOG the network requests get the
+ * highest priority.  If we get the same asset again with a higher
+ * priority, the request is promoted.
  */
 enum {
     ASSET_DELAY             = 1 << 0,
     ASSET_ACCEPT_404        = 1 << 1,
     ASSET_USED_ONCE         = 1 << 2,
+    ASSET_PREFETCH          = 1 << 3,
+    ASSET_CATALOG           = 1 << 4,
 };
 
 /*
@@ -81,7 +92,7 @@ const void *asset_get_data2(const char *url, int flags, int *size, int *code);
  * Release the memory associated with an asset.
  *
  * This should be called after asset_get_data, once we don't need the data
- * anymore.
+ * anymore.  If the data is still being downloaded, the request is aborted.
  */
 void asset_release(const char *url);
 
@@ -110,6 +121,29 @@ void asset_register(const char *url, const void *data, int size,
     static void register_asset_##id_(void) { \
         asset_register("asset://" name_, data_, sizeof(data_), comp_); }
 
+/*
+ * Function: asset_add_pack
+ * Serve the files of a tile pack for all the urls under a base url.
+ *
+ * The pack is memory mapped, and the data returned by <asset_get_data>
+ * points directly into it.  The files not in the pack are loaded as usual.
+ * See <tile_pack.h>.
+ *
+ * The pack takes priority over the network, without checking the surveys
+ * release dates, so it should only be used as an offline bundle of a fixed
+ * version of the surveys.  Since the surveys properties files are also
+ * served from the pack, the tiles always match the release date that the
+ * surveys report.
+ *
+ * Parameters:
+ *   base_url - Url of the root of the pack, without trailing '/'.
+ *   path     - Path of the pack file.
+ *
+ * Return:
+ *   0 on success.
+ */
+int asset_add_pack(const char *base_url, const char *path);
+
 /*
  * Function: asset_set_hook
  * Set a global function to handle special urls.
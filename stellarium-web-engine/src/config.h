@@ -37,6 +37,21 @@ extern "C" {
 #   endif
 #endif
 
+// Run the workers in a thread pool if we have pthread.
+#ifndef HAVE_PTHREAD
+#   if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#      define HAVE_PTHREAD 1
+#   else
+#      define HAVE_PTHREAD 0
+#   endif
+#endif
+
+// Compile the tracing code (see utils/trace.h).  Only in debug by default,
+// set SWE_TRACE=1 to also have it in release builds.
+#ifndef SWE_TRACE
+#   define SWE_TRACE DEBUG
+#endif
+
 // Use stb implementation of sprintf and snprinf
 #ifndef __cplusplus
 #   include <stdio.h>
@@ -11,12 +11,16 @@
 #include "algos/utctt.h"
 #include "navigation.h"
 #include "render.h"
+#include "replay.h"
 #include <ctype.h>
 
 core_t *core;   // The global core object.
 
 #define exp10(x) exp((x) * log(10.))
 
+// Max size of the hips tiles snapshots saved on disk.
+#define SNAPSHOTS_DISK_SIZE (256 * (1 << 20))
+
 static void core_on_fov_changed(obj_t *obj, const attribute_t *attr)
 {
     // For the moment there is not point going further than 0.5°.
@@ -51,6 +55,49 @@ static json_value *core_fn_progressbars(obj_t *obj, const attribute_t *attr,
     return ret;
 }
 
+static json_value *core_fn_profile(obj_t *obj, const attribute_t *attr,
+                                   const json_value *args)
+{
+    return profiler_to_json();
+}
+
+static json_value *core_fn_tracing(obj_t *obj, const attribute_t *attr,
+                                   const json_value *args)
+{
+    bool enabled;
+    if (args && args->u.array.length) {
+        args_get(args, TYPE_BOOL, &enabled);
+        if (enabled && !trace_is_enabled()) trace_start(0);
+        if (!enabled) trace_stop();
+    }
+    return args_value_new(TYPE_BOOL, trace_is_enabled());
+}
+
+static json_value *core_fn_trace(obj_t *obj, const attribute_t *attr,
+                                 const json_value *args)
+{
+    return trace_to_json();
+}
+
+static json_value *core_fn_replay_recording(obj_t *obj,
+                                            const attribute_t *attr,
+                                            const json_value *args)
+{
+    bool enabled;
+    if (args && args->u.array.length) {
+        args_get(args, TYPE_BOOL, &enabled);
+        if (enabled && !replay_is_recording()) replay_record_start();
+        if (!enabled) replay_record_stop();
+    }
+    return args_value_new(TYPE_BOOL, replay_is_recording());
+}
+
+static json_value *core_fn_replay_record(obj_t *obj, const attribute_t *attr,
+                                         const json_value *args)
+{
+    return replay_get_record();
+}
+
 EMSCRIPTEN_KEEPALIVE
 obj_t *core_get_module(const char *id)
 {
@@ -215,7 +262,7 @@ static uint8_t *texture_load_function(
 EMSCRIPTEN_KEEPALIVE
 void core_init(double win_w, double win_h, double pixel_scale)
 {
-    char cache_dir[1024];
+    char cache_dir[1024], snapshots_dir[1040];
     obj_klass_t *module;
     obj_t *m;
 
@@ -231,6 +278,12 @@ void core_init(double win_w, double win_h, double pixel_scale)
     snprintf(cache_dir, sizeof(cache_dir), "%s/%s",
              sys_get_user_dir(), ".cache");
     request_init(cache_dir);
+#ifndef __EMSCRIPTEN__
+    // The wasm build has no persistent file system.
+    snprintf(snapshots_dir, sizeof(snapshots_dir), "%s/swe-snapshots",
+             cache_dir);
+    hips_set_snapshots_dir(snapshots_dir, SNAPSHOTS_DISK_SIZE);
+#endif
 
     core = (core_t*)obj_create("core", NULL);
     core->obj.id = "core";
@@ -287,15 +340,19 @@ EMSCRIPTEN_KEEPALIVE
 int core_update(void)
 {
     bool atm_visible;
-    double lwmax, now, dt;
+    double lwmax, now, dt, t0, t;
     int r;
     obj_t *atm, *module;
     task_t *task, *task_tmp;
 
+    TRACE_SCOPE("core", "core_update");
+    profiler_new_frame();
+    t0 = profiler_get_time();
     now = sys_get_unix_time();
     dt = now - core->clock;
     dt = fmax(dt, 0.001); // Prevent bug in case the clock goes backward.
     core->clock = now;
+    cache_set_clock(now);
 
     atm = core_get_module("atmosphere");
     assert(atm);
@@ -328,6 +385,7 @@ int core_update(void)
 
     // Defined in navigation.c
     core_update_observer(dt);
+    core_update_view_motion(dt);
 
     DL_FOREACH_SAFE(core->tasks, task, task_tmp) {
         if (task->fun(task, dt) != 0) {
@@ -339,11 +397,16 @@ int core_update(void)
     DL_SORT(core->obj.children, modules_sort_cmp);
     DL_FOREACH(core->obj.children, module) {
         if (module->klass->update) {
+            TRACE_SCOPE_DETAIL("core", "module_update", module->id);
+            t = profiler_get_time();
             r = module->klass->update(module, dt);
             if (r < 0) LOG_E("Error updating module '%s'", module->id);
+            profiler_add_time(module->id, PROFILE_UPDATE,
+                              profiler_get_time() - t);
         }
     }
 
+    profiler_add_time(NULL, PROFILE_UPDATE, profiler_get_time() - t0);
     return 0;
 }
 
@@ -439,6 +502,96 @@ bool core_get_point_for_mag(double mag, double *radius, double *luminance)
     return true;
 }
 
+/*
+ * Lookup table of core_get_point_for_mag, so that we don't have to call pow
+ * and exp for each rendered star.  The values only depend on the tonemapper,
+ * the stars scales, the bortle index and the telescope (so the fov), we
+ * rebuild the table at the beginning of a frame if any of them changed.
+ */
+#define POINT_LUT_MAG_MIN (-4)
+#define POINT_LUT_MAG_MAX 26
+#define POINT_LUT_STEPS_PER_MAG 32
+#define POINT_LUT_SIZE \
+    ((POINT_LUT_MAG_MAX - POINT_LUT_MAG_MIN) * POINT_LUT_STEPS_PER_MAG + 1)
+
+typedef struct {
+    tonemapper_t tonemapper;
+    double linear_scale;
+    double relative_scale;
+    double screen_factor;
+    int    bortle_index;
+    double light_grasp;
+    double magnification;
+    double min_radius;
+    double skip_radius;
+    double max_radius;
+    double pixels_scale;
+} point_lut_key_t;
+
+static struct {
+    point_lut_key_t key;
+    bool            valid;
+    double          values[POINT_LUT_SIZE][2]; // radius, luminance.
+} g_point_lut = {};
+
+static void point_lut_update(void)
+{
+    point_lut_key_t key;
+    int i;
+
+    memset(&key, 0, sizeof(key)); // So that we can use memcmp.
+    key.tonemapper = core->tonemapper;
+    key.linear_scale = core->star_linear_scale;
+    key.relative_scale = core->star_relative_scale;
+    key.screen_factor = core->star_scale_screen_factor;
+    key.bortle_index = core->bortle_index;
+    key.light_grasp = core->telescope.light_grasp;
+    key.magnification = core->telescope.magnification;
+    key.min_radius = core->min_point_radius;
+    key.skip_radius = core->skip_point_radius;
+    key.max_radius = core->max_point_radius;
+    key.pixels_scale = core->win_pixels_scale;
+
+    if (g_point_lut.valid && memcmp(&key, &g_point_lut.key, sizeof(key)) == 0)
+        return;
+    TRACE_SCOPE("core", "point_lut_update");
+    for (i = 0; i < POINT_LUT_SIZE; i++) {
+        core_get_point_for_mag(POINT_LUT_MAG_MIN +
+                               (double)i / POINT_LUT_STEPS_PER_MAG,
+                               &g_point_lut.values[i][0],
+                               &g_point_lut.values[i][1]);
+    }
+    g_point_lut.key = key;
+    g_point_lut.valid = true;
+}
+
+bool core_get_point_for_mag_fast(double mag, double *radius,
+                                 double *luminance)
+{
+    double x, f;
+    const double (*v)[2];
+    int i;
+
+    x = (mag - POINT_LUT_MAG_MIN) * POINT_LUT_STEPS_PER_MAG;
+    if (!g_point_lut.valid || !(x >= 0) || x >= POINT_LUT_SIZE - 1)
+        return core_get_point_for_mag(mag, radius, luminance);
+    i = (int)x;
+    f = x - i;
+    v = &g_point_lut.values[i];
+    if (v[0][0] == 0) { // Already too faint.
+        *radius = 0;
+        if (luminance) *luminance = 0;
+        return false;
+    }
+    // The function is not continuous at the skip radius, so use the exact
+    // value just before it.
+    if (v[1][0] == 0)
+        return core_get_point_for_mag(mag, radius, luminance);
+    *radius = v[0][0] + (v[1][0] - v[0][0]) * f;
+    if (luminance) *luminance = v[0][1] + (v[1][1] - v[0][1]) * f;
+    return true;
+}
+
 double core_get_hints_mag_offset(const double win_pos[2])
 {
     const double center[2] = {core->win_size[0] / 2, core->win_size[1] / 2};
@@ -523,7 +676,8 @@ int core_render(double win_w, double win_h, double pixel_scale)
 {
     obj_t *module;
     projection_t proj;
-    double max_vmag, hints_vmag;
+    double max_vmag, hints_vmag, t0, t;
+    TRACE_SCOPE("core", "core_render");
 
     // Used to make sure some values are not touched during render.
     struct {
@@ -535,6 +689,7 @@ int core_render(double win_w, double win_h, double pixel_scale)
     };
     (void)bck;
 
+    t0 = profiler_get_time();
     core->win_size[0] = win_w;
     core->win_size[1] = win_h;
     core->win_pixels_scale = pixel_scale;
@@ -543,6 +698,7 @@ int core_render(double win_w, double win_h, double pixel_scale)
     observer_update(core->observer, true);
     max_vmag = compute_vmag_for_radius(core->skip_point_radius);
     hints_vmag = compute_vmag_for_radius(core->show_hints_radius);
+    point_lut_update();
 
     fps_tick(&core->fps, sys_get_unix_time());
     module_changed(&core->obj, "fps");
@@ -571,7 +727,10 @@ int core_render(double win_w, double win_h, double pixel_scale)
     paint_prepare(&painter, win_w, win_h, pixel_scale);
 
     DL_FOREACH(core->obj.children, module) {
+        TRACE_SCOPE_DETAIL("core", "module_render", module->id);
+        t = profiler_get_time();
         obj_render(module, &painter);
+        profiler_add_time(module->id, PROFILE_RENDER, profiler_get_time() - t);
     }
 
     // Render the viewport cap for debugging.
@@ -585,7 +744,13 @@ int core_render(double win_w, double win_h, double pixel_scale)
     }
 
     // Flush all rendering pipeline
-    paint_finish(&painter);
+    t = profiler_get_time();
+    {
+        TRACE_SCOPE("core", "paint_finish");
+        paint_finish(&painter);
+    }
+    profiler_add_time(NULL, PROFILE_PAINT_FINISH, profiler_get_time() - t);
+    profiler_add_time(NULL, PROFILE_RENDER, profiler_get_time() - t0);
 
     assert(bck.obs.tt == core->observer->tt);
     assert(bck.obs.yaw == core->observer->yaw);
@@ -593,10 +758,20 @@ int core_render(double win_w, double win_h, double pixel_scale)
     assert(bck.fov == core->fov);
 
     // Do post render (e.g. for GUI)
+    t0 = profiler_get_time();
     DL_FOREACH(core->obj.children, module) {
-        if (module->klass->post_render)
+        if (module->klass->post_render) {
+            t = profiler_get_time();
             module->klass->post_render(module, &painter);
+            profiler_add_time(module->id, PROFILE_POST_RENDER,
+                              profiler_get_time() - t);
+        }
     }
+    profiler_add_time(NULL, PROFILE_POST_RENDER, profiler_get_time() - t0);
+
+    // Now that we know all the tiles needed for this frame, start decoding
+    // the most important ones.
+    hips_schedule_loaders();
 
     return 0;
 }
@@ -606,6 +781,7 @@ void core_on_mouse(int id, int state, double x, double y, int buttons)
 {
     obj_t *module;
     int r;
+    replay_on_mouse(id, state, x, y, buttons);
     DL_FOREACH(core->obj.children, module) {
         if (!module->klass->on_mouse) continue;
         r = module->klass->on_mouse(module, id, state, x, y, buttons);
@@ -686,6 +862,7 @@ EMSCRIPTEN_KEEPALIVE
 void core_on_zoom(double k, double x, double y)
 {
     obj_t *module;
+    replay_on_zoom(k, x, y);
     DL_FOREACH(core->obj.children, module) {
         if (module->klass->on_zoom) {
             if (module->klass->on_zoom(module, k, x, y) == 0)
@@ -864,6 +1041,7 @@ void core_lookat(const double *pos, double duration)
     double az, al, now;
     typeof(core->target) *anim = &core->target;
 
+    replay_on_lookat(pos, duration);
     // Direct lookat.
     if (duration == 0.0) {
         vec3_to_sphe(pos, &core->observer->yaw, &core->observer->pitch);
@@ -943,6 +1121,7 @@ void core_set_time(double utc, double duration)
     double tt, speed, now;
     typeof(core->time_animation) *anim = &core->time_animation;
 
+    replay_on_set_time(utc, duration);
     tt = utc2tt(utc);
     if (duration == 0.0) {
         obj_set_attr(&core->observer->obj, "tt", tt);
@@ -1131,6 +1310,12 @@ static obj_klass_t core_klass = {
         PROPERTY(lock, TYPE_OBJ, MEMBER(core_t, target.lock)),
         PROPERTY(progressbars, TYPE_JSON, .fn = core_fn_progressbars),
         PROPERTY(fps, TYPE_INT, MEMBER(core_t, fps.avg)),
+        PROPERTY(profile, TYPE_JSON, .fn = core_fn_profile),
+        PROPERTY(tracing, TYPE_BOOL, .fn = core_fn_tracing),
+        PROPERTY(trace, TYPE_JSON, .fn = core_fn_trace),
+        PROPERTY(replay_recording, TYPE_BOOL,
+                 .fn = core_fn_replay_recording),
+        PROPERTY(replay_record, TYPE_JSON, .fn = core_fn_replay_record),
         PROPERTY(clicks, TYPE_INT, MEMBER(core_t, clicks)),
         PROPERTY(zoom, TYPE_FLOAT, MEMBER(core_t, zoom)),
         PROPERTY(test, TYPE_BOOL, MEMBER(core_t, test)),
@@ -1215,7 +1400,24 @@ static void test_info(void)
     obj_get_info(obj, core->observer, INFO_VMAG, &vmag);
 }
 
+static void test_point_lut(void)
+{
+    double mag, r1, r2, l1, l2, linear_scale;
+    core_init(100, 100, 1.0);
+    linear_scale = core->star_linear_scale;
+    core->star_linear_scale = 0.5;
+    point_lut_update();
+    assert(g_point_lut.key.linear_scale == 0.5);
+    for (mag = -6; mag < 28; mag += 0.01) {
+        assert(core_get_point_for_mag(mag, &r1, &l1) ==
+               core_get_point_for_mag_fast(mag, &r2, &l2));
+        assert(fabs(r1 - r2) < 0.01 && fabs(l1 - l2) < 0.01);
+    }
+    core->star_linear_scale = linear_scale;
+}
+
 TEST_REGISTER(NULL, test_core, TEST_AUTO);
+TEST_REGISTER(NULL, test_point_lut, TEST_AUTO);
 TEST_REGISTER(NULL, test_vec, TEST_AUTO);
 TEST_REGISTER(NULL, test_basic, TEST_AUTO);
 TEST_REGISTER(NULL, test_info, TEST_AUTO);
@@ -157,6 +157,16 @@ struct core
         int         mode;
     } time_animation;
 
+    // View motion estimated at each frame, used to predict the view.
+    struct {
+        double      yaw;         // View direction at the last frame.
+        double      pitch;
+        double      fov;         // Fov at the last frame.
+        double      yaw_speed;   // rad/s.
+        double      pitch_speed; // rad/s.
+        double      fov_speed;   // Change of log(fov) per second.
+    } view_motion;
+
     double time_speed; // Time update speed factor: 0=stopped, 1=real time.
 
     fader_t refraction; // Toggle the observer refraction.
@@ -312,6 +322,17 @@ void core_report_luminance_in_fov(double lum, bool fast_adaptation);
  */
 bool core_get_point_for_mag(double mag, double *radius, double *luminance);
 
+/*
+ * Function: core_get_point_for_mag_fast
+ * Same as core_get_point_for_mag, but interpolate the values from a lookup
+ * table computed at the beginning of each frame.
+ *
+ * Use this in the render loops that process many points, like the stars.
+ * The result is only up to date during the rendering.
+ */
+bool core_get_point_for_mag_fast(double mag, double *radius,
+                                 double *luminance);
+
 /*
  * Function: core_get_hints_mag_offset
  * Return the global adjustment offset to apply to the label threshold
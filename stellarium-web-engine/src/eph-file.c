@@ -9,7 +9,6 @@
 
 #include "eph-file.h"
 #include "swe.h"
-#include "zlib.h"
 
 #include <assert.h>
 #include <sys/stat.h>
@@ -77,20 +76,31 @@ int eph_read_tile_header(const void *data, int data_size, int *data_ofs,
     return 0;
 }
 
+// Return a per thread scratch buffer of at least a given size, so that we
+// don't need to allocate memory for each tile we parse.
+static void *get_scratch(int size)
+{
+    static __thread void *buf = NULL;
+    static __thread int buf_size = 0;
+    if (size > buf_size) {
+        free(buf);
+        buf = malloc(size);
+        buf_size = size;
+    }
+    return buf;
+}
+
 void *eph_read_compressed_block(const void *data, int data_size,
                                 int *data_ofs, int *size)
 {
     int comp_size;
     void *ret;
-    unsigned long lsize;
     data += *data_ofs;
     memcpy(size, data, 4);
     memcpy(&comp_size, data + 4, 4);
-    lsize = *size;
-    ret = malloc(lsize);
+    ret = malloc(*size);
     *data_ofs += 8 + comp_size;
-    if (uncompress(ret, &lsize, data + 8, comp_size) != Z_OK) {
-        LOG_E("Cannot uncompress data");
+    if (z_uncompress(ret, *size, data + 8, comp_size)) {
         free(ret);
         return NULL;
     }
@@ -134,18 +144,57 @@ int eph_load(const void *data, int data_size, void *user,
     return 0;
 }
 
+void eph_unshuffle_bytes(uint8_t *restrict dst, const uint8_t *restrict src,
+                         int nb, int size)
+{
+    // Transpose by small blocks, so that both the reads and the writes
+    // stay in the cache.
+    const int BLOCK = 16;
+    int i, j, i0, j0, i1, j1;
+
+    for (i0 = 0; i0 < nb; i0 += BLOCK) {
+        i1 = i0 + BLOCK < nb ? i0 + BLOCK : nb;
+        for (j0 = 0; j0 < size; j0 += BLOCK) {
+            j1 = j0 + BLOCK < size ? j0 + BLOCK : size;
+            for (j = j0; j < j1; j++)
+                for (i = i0; i < i1; i++)
+                    dst[j * nb + i] = src[i * size + j];
+        }
+    }
+}
+
 // In place shuffle of the data bytes for optimized compression.
 void eph_shuffle_bytes(uint8_t *data, int nb, int size)
 {
-    int i, j;
-    uint8_t *buf = malloc(nb * size);
+    uint8_t *buf = get_scratch(nb * size);
     memcpy(buf, data, nb * size);
-    for (j = 0; j < size; j++) {
-        for (i = 0; i < nb; i++) {
-            data[j * nb + i] = buf[i * size + j];
-        }
+    eph_unshuffle_bytes(data, buf, nb, size);
+}
+
+void *eph_read_table_block(const void *data, int data_size, int *data_ofs,
+                           int *size, int flags, int row_size, int nb)
+{
+    int comp_size;
+    void *ret, *buf;
+
+    if (!(flags & 1))
+        return eph_read_compressed_block(data, data_size, data_ofs, size);
+
+    // Uncompress into a scratch buffer and unshuffle directly into the
+    // returned buffer.
+    data += *data_ofs;
+    memcpy(size, data, 4);
+    memcpy(&comp_size, data + 4, 4);
+    *data_ofs += 8 + comp_size;
+    if (*size < row_size * nb) {
+        LOG_E("Wrong table data size");
+        return NULL;
     }
-    free(buf);
+    buf = get_scratch(*size);
+    if (z_uncompress(buf, *size, data + 8, comp_size)) return NULL;
+    ret = malloc(*size);
+    eph_unshuffle_bytes(ret, buf, row_size, nb);
+    return ret;
 }
 
 int eph_read_table_header(int version, const void *data, int data_size,
@@ -256,3 +305,95 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
     *data_ofs += columns[0].row_size;
     return 0;
 }
+
+int eph_read_table_column(const void *data, int data_size, int nb,
+                          const eph_table_column_t *column, void *out)
+{
+    int i, size;
+    const uint8_t *src = (const uint8_t*)data + column->start;
+    const int row_size = column->row_size;
+    float v, *fout = out;
+    double k;
+
+    switch (column->type) {
+        case 'Q': size = 8; break;
+        case 's': size = column->size; break;
+        default:  size = 4; break;
+    }
+    if (!column->got) {
+        memset(out, 0, nb * size);
+        return 0;
+    }
+    if (nb <= 0) return 0;
+    CHECK(column->start + size <= row_size);
+    CHECK((nb - 1) * row_size + column->start + size <= data_size);
+
+    if (column->type == 'f') {
+        // The conversion is always a simple factor.
+        k = eph_convert_f(column->src_unit, column->unit, 1.0);
+        for (i = 0; i < nb; i++) {
+            memcpy(&v, src + i * row_size, 4);
+            fout[i] = v * k;
+        }
+        return 0;
+    }
+    for (i = 0; i < nb; i++)
+        memcpy((uint8_t*)out + i * size, src + i * row_size, size);
+    return 0;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+// Check that the row and column readers return the same values.
+static void test_read_table_column(void)
+{
+    // Two rows of {float ra (deg), int hip}.
+    struct { float ra; int hip; } rows[2] = {{10.5, 1}, {-20.25, 2}};
+    eph_table_column_t columns[] = {
+        {"ra", 'f', EPH_RAD, .got = 1, .start = 0, .src_unit = EPH_DEG,
+         .row_size = 8},
+        {"hip", 'i', .got = 1, .start = 4, .row_size = 8},
+        {"vmag", 'f', EPH_VMAG, .row_size = 8}, // Not in the data.
+    };
+    int i, ofs = 0, hip, hips[2];
+    double ra, vmag;
+    float ras[2], vmags[2];
+
+    assert(sizeof(rows) == 16);
+    eph_read_table_column(rows, sizeof(rows), 2, &columns[0], ras);
+    eph_read_table_column(rows, sizeof(rows), 2, &columns[1], hips);
+    eph_read_table_column(rows, sizeof(rows), 2, &columns[2], vmags);
+    for (i = 0; i < 2; i++) {
+        eph_read_table_row(rows, sizeof(rows), &ofs, 3, columns,
+                           &ra, &hip, &vmag);
+        assert(ras[i] == (float)ra);
+        assert(hips[i] == hip);
+        assert(vmags[i] == 0 && vmag == 0);
+    }
+    assert(fabs(ras[1] - (-20.25 * DD2R)) < 1e-6);
+    // Data too small.
+    assert(eph_read_table_column(rows, 12, 2, &columns[1], hips) == -1);
+}
+
+TEST_REGISTER(NULL, test_read_table_column, TEST_AUTO);
+
+static void test_unshuffle(void)
+{
+    const int nb = 37, size = 53;
+    uint8_t src[37 * 53], dst[37 * 53];
+    int i, j;
+
+    for (i = 0; i < nb * size; i++) src[i] = i * 7;
+    eph_unshuffle_bytes(dst, src, nb, size);
+    for (i = 0; i < nb; i++)
+        for (j = 0; j < size; j++)
+            assert(dst[j * nb + i] == src[i * size + j]);
+    eph_shuffle_bytes(src, nb, size);
+    assert(memcmp(src, dst, sizeof(dst)) == 0);
+}
+
+TEST_REGISTER(NULL, test_unshuffle, TEST_AUTO);
+
+#endif
@@ -34,8 +34,44 @@ int eph_read_tile_header(const void *data, int data_size, int *data_ofs,
 void *eph_read_compressed_block(const void *data, int data_size,
                                 int *data_ofs, int *size);
 
+/*
+ * Function: eph_read_table_block
+ * Uncompress the data block of a table, and unshuffle it if needed.
+ *
+ * This is the same as calling eph_read_compressed_block followed by
+ * eph_shuffle_bytes when the shuffle flag is set, but without the
+ * intermediate copies.
+ *
+ * Parameters:
+ *   data       - The chunk data.
+ *   data_size  - Size of the chunk data.
+ *   data_ofs   - Offset of the block in the data, updated after the block.
+ *   size       - Get the size of the returned data.
+ *   flags      - Table flags, as returned by eph_read_table_header.
+ *   row_size   - Table row size, as returned by eph_read_table_header.
+ *   nb         - Number of rows in the table.
+ *
+ * Return:
+ *   The table data, to be released with free, or NULL in case of error.
+ */
+void *eph_read_table_block(const void *data, int data_size, int *data_ofs,
+                           int *size, int flags, int row_size, int nb);
+
 void eph_shuffle_bytes(uint8_t *data, int nb, int size);
 
+/*
+ * Function: eph_unshuffle_bytes
+ * Same as eph_shuffle_bytes, but into a separate buffer.
+ *
+ * Parameters:
+ *   dst    - Output buffer of nb * size bytes.
+ *   src    - Input data, must not overlap dst.
+ *   nb     - Size of the input planes, that is the row size of the output.
+ *   size   - Number of input planes, that is the number of output rows.
+ */
+void eph_unshuffle_bytes(uint8_t *restrict dst, const uint8_t *restrict src,
+                         int nb, int size);
+
 /*
  * Enum: EPH_UNIT
  * Represent the different unit we can use for eph file data.
@@ -85,4 +121,28 @@ int eph_read_table_row(const void *data, int data_size, int *data_ofs,
                        int nb_columns, const eph_table_column_t *columns,
                        ...);
 
+/*
+ * Function: eph_read_table_column
+ * Read all the values of a table column at once.
+ *
+ * This is faster than calling eph_read_table_row for each row, since the
+ * unit conversion is only computed once for the whole column.
+ *
+ * Parameters:
+ *   data       - The table data, after the header (and unshuffled).
+ *   data_size  - Size of the table data.
+ *   nb         - Number of rows.
+ *   column     - A column filled by eph_read_table_header.
+ *   out        - Output array of nb values.  The type depends on the
+ *                column type: float for 'f', int for 'i', uint64_t for 'Q'
+ *                and for 's', nb strings of column->size bytes (not
+ *                necessarily null terminated).  If the column is not
+ *                present in the file all the values are set to zero.
+ *
+ * Return:
+ *   0 on success, or -1 if the data is too small.
+ */
+int eph_read_table_column(const void *data, int data_size, int nb,
+                          const eph_table_column_t *column, void *out);
+
 #endif // EPH_FILE_H
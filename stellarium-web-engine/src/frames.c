@@ -228,6 +228,74 @@ int convert_framev4(const observer_t *obs,
     }
 }
 
+void convert_frame_to_view_n(const observer_t *obs, int origin, bool at_inf,
+                             int n, const double (*in)[3], double (*out)[3],
+                             const bool *mask)
+{
+    double m1[3][3], m2[3][3], dist;
+    const double basis[3][3] = MAT3_IDENTITY;
+    int i, k, lin_origin = origin;
+    const bool refract = obs->pressure != 0;
+
+    // Fallback for the cases we don't optimize.
+    if ((origin == FRAME_ASTROM && !at_inf) ||
+        (origin > FRAME_OBSERVED_GEOM && origin != FRAME_VIEW) ||
+        origin == FRAME_JNOW) {
+        for (i = 0; i < n; i++) {
+            if (mask && !mask[i]) continue;
+            convert_frame(obs, origin, FRAME_VIEW, at_inf, in[i], out[i]);
+        }
+        return;
+    }
+    if (origin == FRAME_VIEW) {
+        if (out != in) memcpy(out, in, n * sizeof(*out));
+        return;
+    }
+
+    // The only non linear parts are the aberration and the refraction.
+    if (origin == FRAME_ASTROM) {
+        for (i = 0; i < n; i++) {
+            if (mask && !mask[i]) {
+                vec3_copy(in[i], out[i]);
+                continue;
+            }
+            astrometric_to_apparent(obs, in[i], true, out[i]);
+        }
+        in = out;
+        lin_origin = FRAME_ICRF;
+    }
+
+    // Compute the matrices of the linear parts by converting the basis
+    // vectors, this way we are sure to get the same result as
+    // convert_frame.
+    for (k = 0; k < 3; k++) {
+        convert_frame(obs, lin_origin, FRAME_OBSERVED_GEOM, true,
+                      basis[k], m1[k]);
+        convert_frame(obs, FRAME_OBSERVED, FRAME_VIEW, true,
+                      basis[k], m2[k]);
+    }
+    if (!refract) mat3_mul(m2, m1, m1);
+
+    for (i = 0; i < n; i++)
+        mat3_mul_vec3(m1, in[i], out[i]);
+    if (!refract) return;
+
+    for (i = 0; i < n; i++) {
+        if (mask && !mask[i]) continue;
+        if (at_inf) {
+            refraction(out[i], obs->refa, obs->refb, out[i]);
+            continue;
+        }
+        dist = vec3_norm(out[i]);
+        if (dist == 0.0) continue;
+        vec3_mul(1.0 / dist, out[i], out[i]);
+        refraction(out[i], obs->refa, obs->refb, out[i]);
+        vec3_mul(dist, out[i], out[i]);
+    }
+    for (i = 0; i < n; i++)
+        mat3_mul_vec3(m2, out[i], out[i]);
+}
+
 void position_to_astrometric(const observer_t *obs, int origin,
                                 const double in[2][3], double out[2][3])
 {
@@ -494,4 +562,39 @@ static void test_convert_origin(void)
 
 TEST_REGISTER(NULL, test_convert_origin, TEST_AUTO)
 
+// Check that the batched conversion gives the same result as convert_frame.
+static void test_convert_frame_to_view_n(void)
+{
+    observer_t *obs;
+    double in[8][3], out[8][3], ref[3];
+    const double pressures[] = {0, 1013.25};
+    const int origins[] = {FRAME_ASTROM, FRAME_ICRF, FRAME_CIRS,
+                           FRAME_OBSERVED_GEOM};
+    int i, j, k;
+
+    core_init(100, 100, 1.0);
+    obs = core->observer;
+    obj_set_attr((obj_t*)obs, "utc", 58450.0);
+    obj_set_attr((obj_t*)obs, "latitude", 33.7490 * DD2R);
+    obj_set_attr((obj_t*)obs, "pitch", 0.3);
+
+    for (i = 0; i < 8; i++)
+        eraS2c(i * 0.8, (i - 4) * 0.35, in[i]);
+
+    for (k = 0; k < ARRAY_SIZE(pressures); k++) {
+        obs->pressure = pressures[k];
+        observer_update(obs, false);
+        for (j = 0; j < ARRAY_SIZE(origins); j++) {
+            convert_frame_to_view_n(obs, origins[j], true, 8,
+                                    (const double (*)[3])in, out, NULL);
+            for (i = 0; i < 8; i++) {
+                convert_frame(obs, origins[j], FRAME_VIEW, true, in[i], ref);
+                assert(vec3_dist(out[i], ref) < 1e-12);
+            }
+        }
+    }
+}
+
+TEST_REGISTER(NULL, test_convert_frame_to_view_n, TEST_AUTO)
+
 #endif
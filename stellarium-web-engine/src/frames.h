@@ -150,6 +150,29 @@ int convert_framev4(const observer_t *obs,
                     int origin, int dest,
                     const double in[S 4], double out[S 4]);
 
+/*
+ * Function: convert_frame_to_view_n
+ * Rotate an array of vectors to the view frame.
+ *
+ * This gives the same result as calling convert_frame on each vector, but
+ * all the rotations are merged into one or two matrices, so that the loop
+ * is cheap and can be vectorized by the compiler.
+ *
+ * Parameters:
+ *   obs    - The observer.
+ *   origin - The origin frame.  One of the <FRAME> enum values.
+ *   at_inf - true for fixed objects, see convert_frame.
+ *   n      - Number of vectors.
+ *   in     - Input vectors.
+ *   out    - Output vectors.  Can be the same as the input.
+ *   mask   - Optional array of n values.  If set, we skip the expensive
+ *            computations for the vectors with a false value, and their
+ *            output value is undefined.
+ */
+void convert_frame_to_view_n(const observer_t *obs, int origin, bool at_inf,
+                             int n, const double (*in)[3], double (*out)[3],
+                             const bool *mask);
+
 /* Enum: ORIGIN
  * Represent a reference system, i.e. the origin of a reference frame and the
  * associated intertial frame.
@@ -9,6 +9,8 @@
 
 #include "swe.h"
 #include "ini.h"
+#include "navigation.h"
+#include "utils/disk_cache.h"
 #include <string.h>
 #include <zlib.h> // For crc32.
 
@@ -21,6 +23,17 @@
 // past its limit if the items are still in use!
 #define CACHE_SIZE (256 * (1 << 20))
 
+// Default size of the cache of the evicted tiles snapshots.  The wasm
+// build is more limited in memory, so we keep less of them.
+#ifdef __EMSCRIPTEN__
+#   define SNAPSHOTS_CACHE_SIZE (32 * (1 << 20))
+#else
+#   define SNAPSHOTS_CACHE_SIZE (64 * (1 << 20))
+#endif
+
+// Version of the snapshots header, see snapshot_t.
+#define SNAPSHOT_VERSION 1
+
 // Flags of the tiles:
 enum {
     // Bit fields set by tile if we know that we don't have further tiles
@@ -36,7 +49,32 @@ enum {
 #define TILE_NO_CHILD_ALL \
     (TILE_NO_CHILD_0 | TILE_NO_CHILD_1 | TILE_NO_CHILD_2 | TILE_NO_CHILD_3)
 
+// How far in the future we predict the view to prefetch the tiles (sec).
+#define PREFETCH_TIME 0.3
+// Max number of prefetch downloads running at the same time.
+#define PREFETCH_MAX_RUNNING 4
+// Max average bandwidth used by the prefetch downloads (bytes/sec).
+#define PREFETCH_MAX_RATE (1 << 20)
+// Number of frames after which we cancel a prefetched tile if it was not
+// predicted visible anymore.
+#define PREFETCH_KEEP_FRAMES 60
+
 typedef struct tile tile_t;
+typedef struct loader loader_t;
+
+// Loader to parse the tile data in a thread.
+struct loader {
+    worker_t    worker;
+    tile_t      *tile;
+    void        *data;
+    int         size;
+    int         cost;
+    bool        started;    // Set once the worker has been submitted.
+    int         frame;      // Last scheduler frame the tile was requested.
+    double      priority;   // Priority computed at the last request.
+    loader_t    *next, *prev; // In the scheduler pending list.
+};
+
 struct tile {
     struct {
         int order;
@@ -46,15 +84,19 @@ struct tile {
     fader_t     fader;
     int         flags;
     void        *data;
+    loader_t    *loader;
+};
 
-    // Loader to parse the image in a thread.
-    struct {
-        worker_t worker;
-        tile_t *tile;
-        void *data;
-        int size;
-        int cost;
-    } *loader;
+/*
+ * Type: prefetch_t
+ * A tile download started by the prefetcher, and not used yet.
+ */
+typedef struct prefetch prefetch_t;
+struct prefetch {
+    UT_hash_handle  hh;
+    int             frame;      // Last frame the tile was predicted visible.
+    bool            running;    // Set until the download is finished.
+    char            url[];
 };
 
 /*
@@ -77,9 +119,53 @@ typedef struct {
     texture_t   *tex;
 } img_tile_t;
 
+/*
+ * Type: snapshot_t
+ * Header of a tile snapshot, followed by the data returned by the survey
+ * snapshot_tile function.  We use the same format in memory and on disk.
+ */
+typedef struct {
+    char        magic[4] NONSTRING; // "SNAP"
+    uint32_t    version;            // SNAPSHOT_VERSION.
+    uint32_t    hips_hash;
+    int32_t     order;
+    int32_t     pix;
+    int32_t     flags;              // TILE_NO_CHILD_* flags of the tile.
+    double      release_date;
+    int32_t     size;               // Size of the data after the header.
+    uint32_t    crc;                // crc32 of the data.
+    uint8_t     data[] __attribute__((aligned(16)));
+} snapshot_t;
+
 // Gobal cache for all the tiles.
 static cache_t *g_cache = NULL;
 
+// Snapshots of the tiles evicted from the cache.
+static struct {
+    cache_t      *cache;
+    int          size;
+    disk_cache_t *disk;     // If set, also save the snapshots there.
+} g_snapshots = {.size = SNAPSHOTS_CACHE_SIZE};
+
+// Global scheduler for the tiles decoding.
+static struct {
+    loader_t    *pending; // Loaders waiting to be started.
+    int         frame;    // Incremented at each hips_schedule_loaders call.
+    // Transformation of the survey currently rendered with hips_render.
+    const double (*transf)[4];
+    // Buffer used to sort the pending loaders.
+    loader_t    **sorted;
+    int         sorted_allocated;
+} g_sched = {};
+
+// Global state of the tiles prefetcher.
+static struct {
+    prefetch_t  *requests;      // Hash table of the prefetches by url.
+    int         nb_running;
+    double      budget;         // Bandwidth budget left (bytes).
+    double      last_time;      // Clock at the last budget update.
+} g_prefetch = {};
+
 
 static void *create_img_tile(
         void *user, int order, int pix, const void *src, int size,
@@ -156,6 +242,13 @@ static const char *get_url_for(const hips_t *hips, char *buf, int len,
     return buf;
 }
 
+static const char *get_tile_url(const hips_t *hips, int order, int pix,
+                                char *buf, int len)
+{
+    return get_url_for(hips, buf, len, "Norder%d/Dir%d/Npix%d.%s",
+                       order, (pix / 10000) * 10000, pix, hips->ext);
+}
+
 static int property_handler(void* user, const char* section,
                             const char* name, const char* value)
 {
@@ -223,14 +316,161 @@ static int parse_properties(hips_t *hips)
 }
 
 
+void hips_set_snapshots_cache_size(int size)
+{
+    g_snapshots.size = size;
+    if (g_snapshots.cache) cache_set_max_size(g_snapshots.cache, size);
+}
+
+static void save_snapshots_index(void)
+{
+    if (g_snapshots.disk) disk_cache_save(g_snapshots.disk);
+}
+
+void hips_set_snapshots_dir(const char *dir, int64_t max_size)
+{
+    static bool registered = false;
+    disk_cache_delete(g_snapshots.disk);
+    g_snapshots.disk = dir ? disk_cache_create(dir, max_size) : NULL;
+    if (dir && !registered) {
+        atexit(save_snapshots_index);
+        registered = true;
+    }
+}
+
+static int del_snapshot(void *data)
+{
+    free(data);
+    return 0;
+}
+
+// Key of a snapshot in the disk cache.
+static void get_snapshot_disk_key(const hips_t *hips, int order, int pix,
+                                  char *buf, int size)
+{
+    snprintf(buf, size, "%08x-%d-%d", hips->hash, order, pix);
+}
+
+static bool snapshot_is_valid(const snapshot_t *snap, int size,
+                              const hips_t *hips, int order, int pix)
+{
+    return size >= sizeof(*snap) &&
+           memcmp(snap->magic, "SNAP", 4) == 0 &&
+           snap->version == SNAPSHOT_VERSION &&
+           snap->hips_hash == hips->hash &&
+           snap->order == order &&
+           snap->pix == pix &&
+           snap->release_date == hips->release_date &&
+           snap->size == size - sizeof(*snap);
+}
+
+/*
+ * Keep a snapshot of a tile, so that if we need it again after it has been
+ * evicted from the cache we don't have to parse the source data again.
+ */
+static void save_snapshot(const tile_t *tile)
+{
+    const hips_t *hips = tile->hips;
+    tile_key_t key = {hips->hash, tile->pos.order, tile->pos.pix};
+    snapshot_t *snap;
+    void *data;
+    int size;
+    char disk_key[64];
+
+    if (!hips->settings.snapshot_tile || !g_snapshots.size) return;
+    if (!g_snapshots.cache)
+        g_snapshots.cache = cache_create(g_snapshots.size, 0);
+    if (cache_get(g_snapshots.cache, &key, sizeof(key))) return;
+
+    data = hips->settings.snapshot_tile(hips->settings.user, tile->data,
+                                        &size);
+    if (!data) return;
+    snap = malloc(sizeof(*snap) + size);
+    memset(snap, 0, sizeof(*snap));
+    memcpy(snap->magic, "SNAP", 4);
+    snap->version = SNAPSHOT_VERSION;
+    snap->hips_hash = hips->hash;
+    snap->order = tile->pos.order;
+    snap->pix = tile->pos.pix;
+    snap->flags = tile->flags & TILE_NO_CHILD_ALL;
+    snap->release_date = hips->release_date;
+    snap->size = size;
+    memcpy(snap->data, data, size);
+    free(data);
+
+    // Don't rewrite the file if we already saved this tile.
+    if (g_snapshots.disk) {
+        snap->crc = crc32(0, snap->data, size);
+        get_snapshot_disk_key(hips, snap->order, snap->pix,
+                              disk_key, sizeof(disk_key));
+        if (!disk_cache_get_info(g_snapshots.disk, disk_key, NULL, NULL))
+            disk_cache_write(g_snapshots.disk, disk_key, snap,
+                             sizeof(*snap) + size, NULL, 0);
+    }
+    cache_add(g_snapshots.cache, &key, sizeof(key), snap,
+              sizeof(*snap) + size, del_snapshot);
+}
+
+/*
+ * Return the snapshot of a tile if we have one, either in memory or
+ * on disk.  The returned pointer is owned by the snapshots cache, and is
+ * only valid until the next snapshot is added.
+ */
+static const snapshot_t *get_snapshot(const hips_t *hips, int order,
+                                      int pix)
+{
+    tile_key_t key = {hips->hash, order, pix};
+    snapshot_t *snap;
+    char disk_key[64];
+    int size;
+
+    if (!hips->settings.create_tile_from_snapshot) return NULL;
+    if (!g_snapshots.size) return NULL;
+    if (!g_snapshots.cache)
+        g_snapshots.cache = cache_create(g_snapshots.size, 0);
+    snap = cache_get(g_snapshots.cache, &key, sizeof(key));
+    if (snap) {
+        size = sizeof(*snap) + snap->size;
+        // The survey can get a new release after we saved the snapshot.
+        return snapshot_is_valid(snap, size, hips, order, pix) ? snap : NULL;
+    }
+
+    if (!g_snapshots.disk) return NULL;
+    get_snapshot_disk_key(hips, order, pix, disk_key, sizeof(disk_key));
+    snap = disk_cache_read(g_snapshots.disk, disk_key, &size);
+    if (!snap) return NULL;
+    if (!snapshot_is_valid(snap, size, hips, order, pix) ||
+            snap->crc != crc32(0, snap->data, snap->size)) {
+        LOG_W("Ignore invalid tile snapshot %s", disk_key);
+        free(snap);
+        disk_cache_remove(g_snapshots.disk, disk_key);
+        return NULL;
+    }
+    cache_add(g_snapshots.cache, &key, sizeof(key), snap, size,
+              del_snapshot);
+    return snap;
+}
+
 // Used by the cache.
 static int del_tile(void *data)
 {
     tile_t *tile = data;
-    // XXX: why the worker_is_running?
+    // The loader worker still references the tile.
     if (tile->loader && worker_is_running(&tile->loader->worker))
         return CACHE_KEEP;
+    if (tile->loader) {
+        if (!tile->loader->started)
+            DL_DELETE(g_sched.pending, tile->loader);
+        // The loader can be started but still idle if the workers queue
+        // was full.  Once the worker ran the data is already released.
+        free(tile->loader->data);
+        free(tile->loader);
+        tile->loader = NULL;
+    }
     if (tile->data) {
+        // Note: we keep the snapshot even if the tile is not deleted yet,
+        // it will be valid when the tile actually gets deleted.
+        save_snapshot(tile);
         if (tile->hips->settings.delete_tile(tile->data) == CACHE_KEEP)
             return CACHE_KEEP;
     }
@@ -253,101 +493,174 @@ static bool img_is_transparent(
     return true;
 }
 
+static double get_view_priority(int frame, const double (*transf)[4],
+                                int order, int pix);
+
 int hips_traverse(void *user, int callback(int order, int pix, void *user))
 {
-    typedef struct {
-        int order;
-        int pix;
-    } node_t;
-    node_t queue[1024];
-    const int n = ARRAY_SIZE(queue);
-    int start = 0, size = 12, r, i;
-    int order, pix;
-    // Enqueue the first 12 pix at order 0.
-    for (i = 0; i < 12; i++) {queue[i] = (node_t){0, i};}
-    while (size) {
-        order = queue[start % n].order;
-        pix = queue[start % n].pix;
-        start++;
-        size--;
+    hips_iterator_t iter;
+    int order, pix, r = 0;
+
+    hips_iter_init(&iter);
+    while (hips_iter_next(&iter, &order, &pix)) {
         r = callback(order, pix, user);
-        if (r < 0) return r;
-        if (r == 1) {
-            // Enqueue the 4 children tiles.
-            if (size + 4 >= n) {
-                // No more space.
-                LOG_W("Abort HIPS traverse");
-                return -1;
-            }
-            for (i = 0; i < 4; i++) {
-                queue[(start + size) % n] = (node_t){order + 1, pix * 4 + i};
-                size++;
-            }
-        }
+        if (r < 0) break;
+        if (r == 1) hips_iter_push_children(&iter, order, pix);
     }
-    return 0;
+    hips_iter_release(&iter);
+    return r < 0 ? r : 0;
+}
+
+static hips_iterator_node_t *iter_queue(hips_iterator_t *iter)
+{
+    return iter->queue ?: iter->inline_queue;
+}
+
+// Make sure that we can add n more nodes to the queue.
+static void iter_reserve(hips_iterator_t *iter, int n)
+{
+    hips_iterator_node_t *queue, *old = iter_queue(iter);
+    int i, allocated = iter->allocated;
+
+    if (iter->size + n <= iter->allocated) return;
+    while (allocated < iter->size + n) allocated *= 2;
+    queue = malloc(allocated * sizeof(*queue));
+    // Unroll the ring buffer.  In priority mode start is always zero.
+    for (i = 0; i < iter->size; i++)
+        queue[i] = old[(iter->start + i) % iter->allocated];
+    free(iter->queue);
+    iter->queue = queue;
+    iter->allocated = allocated;
+    iter->start = 0;
+}
+
+static void iter_push(hips_iterator_t *iter, int order, int pix)
+{
+    hips_iterator_node_t *queue, node = {order, pix};
+    int i, parent;
+
+    iter_reserve(iter, 1);
+    queue = iter_queue(iter);
+    if (!iter->priority) {
+        queue[(iter->start + iter->size++) % iter->allocated] = node;
+        return;
+    }
+    // Binary heap insertion.
+    node.priority = iter->priority(iter->priority_user, order, pix);
+    if (order > 0) node.priority = fmin(node.priority, iter->current);
+    for (i = iter->size++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (queue[parent].priority >= node.priority) break;
+        queue[i] = queue[parent];
+    }
+    queue[i] = node;
+}
+
+static hips_iterator_node_t iter_pop(hips_iterator_t *iter)
+{
+    hips_iterator_node_t *queue = iter_queue(iter), ret, last;
+    int i, child;
+
+    if (!iter->priority) {
+        ret = queue[iter->start];
+        iter->start = (iter->start + 1) % iter->allocated;
+        iter->size--;
+        return ret;
+    }
+    // Binary heap removal.
+    ret = queue[0];
+    last = queue[--iter->size];
+    for (i = 0; (child = 2 * i + 1) < iter->size; i = child) {
+        if (child + 1 < iter->size &&
+                queue[child + 1].priority > queue[child].priority)
+            child++;
+        if (last.priority >= queue[child].priority) break;
+        queue[i] = queue[child];
+    }
+    queue[i] = last;
+    return ret;
 }
 
-/*
- * Function: hips_iter_init
- * Initialize the iterator with the initial twelve order zero healpix pixels.
- */
 void hips_iter_init(hips_iterator_t *iter)
 {
     int i;
-    typedef __typeof__(iter->queue[0]) node_t;
-    memset(iter, 0, sizeof(*iter));
+    iter->queue = NULL;
+    iter->size = 0;
+    iter->start = 0;
+    iter->allocated = HIPS_ITER_INLINE_SIZE;
+    iter->priority = NULL;
+    iter->priority_user = NULL;
+    iter->current = DBL_MAX;
+    iter->nb = 0;
+    iter->max_nb = 0;
+    iter->deadline = 0;
+    iter->is_render = false;
+    iter->over_budget = false;
     // Enqueue the first 12 pix at order 0.
-    iter->size = 12;
-    for (i = 0; i < 12; i++) {
-        iter->queue[i] = (node_t){0, i};
-    }
+    for (i = 0; i < 12; i++) iter_push(iter, 0, i);
+}
+
+void hips_iter_set_priority(hips_iterator_t *iter,
+                            double (*fn)(void *user, int order, int pix),
+                            void *user)
+{
+    int i;
+    assert(iter->size == 12); // Only after init.
+    iter->size = 0;
+    iter->start = 0;
+    iter->priority = fn;
+    iter->priority_user = user;
+    for (i = 0; i < 12; i++) iter_push(iter, 0, i);
+}
+
+static double iter_view_priority(void *user, int order, int pix)
+{
+    const hips_iterator_t *iter = user;
+    return get_view_priority(iter->frame, NULL, order, pix);
+}
+
+void hips_iter_set_view_priority(hips_iterator_t *iter, int frame)
+{
+    iter->frame = frame;
+    hips_iter_set_priority(iter, iter_view_priority, iter);
+}
+
+void hips_iter_set_budget(hips_iterator_t *iter, int max_nb,
+                          double max_time)
+{
+    iter->max_nb = max_nb;
+    iter->deadline = max_time ? profiler_get_time() + max_time : 0;
 }
 
-/*
- * Function: hips_iter_next
- * Pop the next healpix pixel from the iterator.
- *
- * Return false if there are no more pixel enqueued.
- */
 bool hips_iter_next(hips_iterator_t *iter, int *order, int *pix)
 {
-    const int n = ARRAY_SIZE(iter->queue);
+    hips_iterator_node_t node;
     if (!iter->size) return false;
-    // Get the first tile from the queue.
-    *order = iter->queue[iter->start % n].order;
-    *pix = iter->queue[iter->start % n].pix;
-    iter->start++;
-    iter->size--;
+    if ((iter->max_nb && iter->nb >= iter->max_nb) ||
+            (iter->deadline && profiler_get_time() > iter->deadline)) {
+        iter->over_budget = true;
+        return false;
+    }
+    node = iter_pop(iter);
+    *order = node.order;
+    *pix = node.pix;
+    iter->current = node.priority;
+    iter->nb++;
+    if (iter->is_render) profiler_count(PROFILE_TILES_VISITED, 1);
     return true;
 }
 
-/*
- * Function: hips_iter_push_children
- * Add the four children of the giver pixel to the iterator.
- *
- * The children will be retrieved after all the currently queued values
- * from the iterator have been processed.
- */
 void hips_iter_push_children(hips_iterator_t *iter, int order, int pix)
 {
-    typedef __typeof__(iter->queue[0]) node_t;
-    const int n = ARRAY_SIZE(iter->queue);
     int i;
-    // Enqueue the next four tiles.
-    if (iter->size + 4 >= n) {
-        // Todo: we should probably use a dynamic array instead.
-        LOG_E("No more space!");
-        return;
-    }
-    for (i = 0; i < 4; i++) {
-        iter->queue[(iter->start + iter->size) % n] = (node_t) {
-            order + 1, pix * 4 + i
-        };
-        iter->size++;
-    }
+    for (i = 0; i < 4; i++) iter_push(iter, order + 1, pix * 4 + i);
 }
 
+void hips_iter_release(hips_iterator_t *iter)
+{
+    free(iter->queue);
+    iter->queue = NULL;
+}
 
 /*
  * Function: hips_get_tile_texture
@@ -489,8 +802,12 @@ int hips_render(hips_t *hips, const painter_t *painter,
     // Can't split less than the rendering order.
     split_order = fmax(split_order, render_order);
 
+    // Let the tiles scheduler know where the tiles are actually rendered.
+    g_sched.transf = transf;
+
     // Breath first traversal of all the tiles.
     hips_iter_init(&iter);
+    iter.is_render = true;
     while (hips_iter_next(&iter, &order, &pix)) {
         // Early exit if the tile is clipped.
         uv_map_init_healpix(&map, order, pix, false, false);
@@ -505,6 +822,9 @@ int hips_render(hips_t *hips, const painter_t *painter,
         render_visitor(hips, painter, transf, order, pix, split,
                        &nb_tot, &nb_loaded);
     }
+    hips_iter_release(&iter);
+    g_sched.transf = NULL;
+    if (!transf) hips_prefetch(hips, render_order);
 
     progressbar_report(hips->url, hips->label, nb_loaded, nb_tot, -1);
     return 0;
@@ -645,18 +965,147 @@ int hips_get_render_order_planet(const hips_t *hips, const painter_t *painter,
 static int load_tile_worker(worker_t *worker)
 {
     int transparency = 0;
-    typeof(((tile_t*)0)->loader) loader = (void*)worker;
+    loader_t *loader = (void*)worker;
     tile_t *tile = loader->tile;
     hips_t *hips = tile->hips;
+    TRACE_SCOPE_DETAIL("hips", "create_tile", hips->url);
     tile->data = hips->settings.create_tile(
                     hips->settings.user, tile->pos.order, tile->pos.pix,
                     loader->data, loader->size, &loader->cost, &transparency);
     if (!tile->data) tile->flags |= TILE_LOAD_ERROR;
     tile->flags |= (transparency * TILE_NO_CHILD_0);
     free(loader->data);
+    loader->data = NULL;
     return 0;
 }
 
+/*
+ * Compute the decoding priority of a tile from the current view.
+ *
+ * The priority is the approximate area of the tile on screen in pixels,
+ * attenuated by the distance of the tile to the view center, so that the
+ * tiles the user is looking at get decoded first, and the tiles that are
+ * out of the screen last.
+ */
+static double get_view_priority(int frame, const double (*transf)[4],
+                                int order, int pix)
+{
+    double pos[4], sep, radius, area, dist;
+    const double fov = core->fov;
+
+    healpix_pix2vec(1 << order, pix, pos);
+    if (transf) mat4_mul_dir3(transf, pos, pos);
+    convert_frame(core->observer, frame, FRAME_VIEW, true, pos, pos);
+    vec3_normalize(pos, pos);
+    sep = acos(clamp(-pos[2], -1, 1)); // Separation with the view center.
+    // Approximate angular radius of a healpix pixel at this order.
+    radius = sqrt(4 * M_PI / (12.0 * (1 << (2 * order)))) / 2;
+    area = pow(2 * radius / fov * core->win_size[1], 2);
+    // Distance from the view center to the tile edge, in half fov unit.
+    dist = fmax(0, sep - radius) / (fov / 2);
+    return area / pow(1 + dist, 4);
+}
+
+// Submit a loader to the worker pool.
+static void loader_start(loader_t *loader)
+{
+    assert(!loader->started);
+    DL_DELETE(g_sched.pending, loader);
+    loader->started = true;
+    worker_iter(&loader->worker);
+}
+
+static int loader_cmp(const void *a, const void *b)
+{
+    const loader_t *l1 = *(const loader_t**)a;
+    const loader_t *l2 = *(const loader_t**)b;
+    return cmp(l2->priority, l1->priority);
+}
+
+static void prefetch_remove(prefetch_t *req)
+{
+    if (req->running) g_prefetch.nb_running--;
+    HASH_DEL(g_prefetch.requests, req);
+    free(req);
+}
+
+// Called when the renderer requests a tile, so that we don't cancel it.
+static void prefetch_forget(const char *url)
+{
+    prefetch_t *req;
+    if (!g_prefetch.requests) return;
+    HASH_FIND_STR(g_prefetch.requests, url, req);
+    if (req) prefetch_remove(req);
+}
+
+static void prefetch_update(void)
+{
+    prefetch_t *req, *tmp;
+    int size, code;
+    double dt = core->clock - g_prefetch.last_time;
+
+    g_prefetch.last_time = core->clock;
+    g_prefetch.budget = fmin(g_prefetch.budget + dt * PREFETCH_MAX_RATE,
+                             PREFETCH_MAX_RATE);
+    HASH_ITER(hh, g_prefetch.requests, req, tmp) {
+        if (req->running) {
+            asset_get_data2(req->url, ASSET_ACCEPT_404 | ASSET_PREFETCH,
+                            &size, &code);
+            if (code) {
+                req->running = false;
+                g_prefetch.nb_running--;
+                g_prefetch.budget -= size;
+            }
+        }
+        // Wrong prediction: release the data, or abort the download.
+        if (g_sched.frame - req->frame > PREFETCH_KEEP_FRAMES) {
+            asset_release(req->url);
+            prefetch_remove(req);
+        }
+    }
+}
+
+/*
+ * Function: hips_schedule_loaders
+ * Start the decoding of the most important pending tiles.
+ *
+ * Tiles requested with HIPS_LOAD_IN_THREAD are not decoded right away:
+ * instead each request updates the tile priority, and this function,
+ * called once per frame, submits the pending tiles to the workers pool
+ * by order of priority.  Tiles that were not requested since the last
+ * call (because the view moved away) are deferred until they get
+ * requested again, or evicted from the cache.
+ */
+void hips_schedule_loaders(void)
+{
+    int n = 0, i, budget, nb_threads;
+    loader_t *loader;
+
+    prefetch_update();
+    if (g_snapshots.disk) disk_cache_update(g_snapshots.disk);
+    DL_FOREACH(g_sched.pending, loader) {
+        if (loader->frame != g_sched.frame) continue;
+        if (n >= g_sched.sorted_allocated) {
+            g_sched.sorted_allocated = fmax(64, g_sched.sorted_allocated * 2);
+            g_sched.sorted = realloc(g_sched.sorted, g_sched.sorted_allocated *
+                                     sizeof(*g_sched.sorted));
+        }
+        g_sched.sorted[n++] = loader;
+    }
+    g_sched.frame++;
+    if (!n) return;
+
+    // Only keep the pool busy, so that the next frames can still change
+    // the order of the remaining tiles.
+    nb_threads = worker_pool_get_nb_threads();
+    budget = 2 * nb_threads - worker_pool_get_nb_pending();
+    if (budget <= 0) return;
+
+    qsort(g_sched.sorted, n, sizeof(*g_sched.sorted), loader_cmp);
+    for (i = 0; i < n && i < budget; i++)
+        loader_start(g_sched.sorted[i]);
+}
+
 static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
                               int *code)
 {
@@ -664,17 +1113,34 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     int size, parent_code, asset_flags, cost = 0, transparency = 0;
     char url[URL_MAX_SIZE];
     tile_t *tile, *parent;
+    loader_t *loader;
+    const snapshot_t *snap;
     tile_key_t key = {hips->hash, order, pix};
 
     assert(order >= 0);
     *code = 0;
+    // Without threads the scheduler would only delay the tiles by a frame,
+    // so we decode them right away.
+    if (!worker_pool_get_nb_threads()) flags &= ~HIPS_LOAD_IN_THREAD;
 
     if (!g_cache) g_cache = cache_create(CACHE_SIZE, 1);
     tile = cache_get(g_cache, &key, sizeof(key));
 
     // Got a tile but it is still loading.
     if (tile && tile->loader) {
-        if (!worker_iter(&tile->loader->worker)) return NULL;
+        loader = tile->loader;
+        if (!loader->started) {
+            if (flags & HIPS_LOAD_IN_THREAD) {
+                loader->priority = get_view_priority(
+                        hips->frame, g_sched.transf, order, pix);
+                loader->frame = g_sched.frame;
+                return NULL;
+            }
+            // Blocking request, don't wait for the scheduler.
+            loader_start(loader);
+        }
+        if (!worker_iter(&loader->worker)) return NULL;
+        profiler_count(PROFILE_TILES_LOADED, 1);
         cache_set_cost(g_cache, &key, sizeof(key), tile->loader->cost);
         free(tile->loader);
         tile->loader = NULL;
@@ -704,8 +1170,32 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
             return NULL;
         }
     }
-    get_url_for(hips, url, sizeof(url), "Norder%d/Dir%d/Npix%d.%s",
-                order, (pix / 10000) * 10000, pix, hips->ext);
+    // If the tile has been evicted from the cache, recreating it from its
+    // snapshot is much faster than parsing the source data again.
+    snap = get_snapshot(hips, order, pix);
+    if (snap) {
+        TRACE_SCOPE_DETAIL("hips", "create_tile_from_snapshot", hips->url);
+        data = hips->settings.create_tile_from_snapshot(
+                hips->settings.user, order, pix, snap->data, snap->size,
+                &cost);
+        if (data) {
+            tile = calloc(1, sizeof(*tile));
+            tile->pos.order = order;
+            tile->pos.pix = pix;
+            tile->hips = hips;
+            tile->flags = snap->flags;
+            tile->data = (void*)data;
+            hips->ref++;
+            cache_add(g_cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
+                      del_tile);
+            profiler_count(PROFILE_TILES_LOADED, 1);
+            *code = 200;
+            return tile;
+        }
+    }
+
+    get_tile_url(hips, order, pix, url, sizeof(url));
+    prefetch_forget(url); // We take ownership of the asset.
     asset_flags = ASSET_ACCEPT_404;
     if (order > 0 && !(flags & HIPS_NO_DELAY))
         asset_flags |= ASSET_DELAY;
@@ -736,10 +1226,13 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
     tile->pos.pix = pix;
     tile->hips = hips;
     hips->ref++;
+    // Until the tile is parsed, count the source data in the cost.
+    if (flags & HIPS_LOAD_IN_THREAD) cost = size;
     cache_add(g_cache, &key, sizeof(key), tile, sizeof(*tile) + cost,
               del_tile);
 
     if (!(flags & HIPS_LOAD_IN_THREAD)) {
+        TRACE_SCOPE_DETAIL("hips", "create_tile", hips->url);
         tile->data = hips->settings.create_tile(
                 hips->settings.user, order, pix, data, size,
                 &cost, &transparency);
@@ -748,14 +1241,20 @@ static tile_t *hips_get_tile_(hips_t *hips, int order, int pix, int flags,
             LOG_W("Cannot parse tile %s", url);
             tile->flags |= TILE_LOAD_ERROR;
         }
+        profiler_count(PROFILE_TILES_LOADED, 1);
         asset_release(url);
     } else {
-        tile->loader = calloc(1, sizeof(*tile->loader));
-        worker_init(&tile->loader->worker, load_tile_worker);
-        tile->loader->data = malloc(size);
-        tile->loader->size = size;
-        tile->loader->tile = tile;
-        memcpy(tile->loader->data, data, size);
+        loader = calloc(1, sizeof(*loader));
+        worker_init(&loader->worker, load_tile_worker);
+        loader->data = malloc(size);
+        loader->size = size;
+        loader->tile = tile;
+        loader->priority = get_view_priority(hips->frame, g_sched.transf,
+                                             order, pix);
+        loader->frame = g_sched.frame;
+        memcpy(loader->data, data, size);
+        tile->loader = loader;
+        DL_APPEND(g_sched.pending, loader);
         asset_release(url);
         *code = 0;
         return NULL;
@@ -770,6 +1269,102 @@ void *hips_get_tile(hips_t *hips, int order, int pix, int flags, int *code)
     return tile ? tile->data : NULL;
 }
 
+// Get the view direction in the hips frame, and its angular radius.
+static void get_view_cone(const hips_t *hips, double yaw, double pitch,
+                          double fov, double dir[3], double *radius)
+{
+    const observer_t *obs = core->observer;
+    double v[3];
+    eraS2c(yaw, pitch, v);
+    mat3_mul_vec3_transposed(obs->ro2m, v, v); // Mount to observed.
+    convert_frame(obs, FRAME_OBSERVED, hips->frame, true, v, dir);
+    // Add some margin for the corners of the screen.
+    *radius = fmin(fov / 2 * M_SQRT2, M_PI);
+}
+
+static void prefetch_tile(hips_t *hips, int order, int pix)
+{
+    tile_key_t key = {hips->hash, order, pix};
+    tile_key_t parent_key = {hips->hash, order - 1, pix / 4};
+    const tile_t *parent;
+    char url[URL_MAX_SIZE];
+    prefetch_t *req;
+
+    // Peek only, so that a prefetch doesn't keep the tiles in the cache.
+    if (cache_peek(g_cache, &key, sizeof(key))) return;
+    // Skip the tiles we already know don't exist.
+    if (order > hips->order_min) {
+        parent = cache_peek(g_cache, &parent_key, sizeof(parent_key));
+        // The flags are only valid once the parent has been loaded.
+        if (parent && !parent->loader &&
+                (parent->flags & (TILE_NO_CHILD_0 << (pix % 4))))
+            return;
+    }
+    get_tile_url(hips, order, pix, url, sizeof(url));
+    HASH_FIND_STR(g_prefetch.requests, url, req);
+    if (req) {
+        req->frame = g_sched.frame;
+        return;
+    }
+    if (g_prefetch.nb_running >= PREFETCH_MAX_RUNNING) return;
+    if (g_prefetch.budget <= 0) return;
+
+    req = calloc(1, sizeof(*req) + strlen(url) + 1);
+    strcpy(req->url, url);
+    req->frame = g_sched.frame;
+    req->running = true;
+    HASH_ADD_STR(g_prefetch.requests, url, req);
+    g_prefetch.nb_running++;
+    // Without ASSET_DELAY, so that the download starts right away.
+    asset_get_data2(url, ASSET_ACCEPT_404 | ASSET_PREFETCH, NULL, NULL);
+}
+
+void hips_prefetch(hips_t *hips, int order)
+{
+    const observer_t *obs = core->observer;
+    double yaw, pitch, fov, dir[3], view_dir[3], radius, view_radius;
+    double pos[3], pix_radius;
+    int pred_order, o, pix;
+    hips_iterator_t iter;
+
+    // Local surveys are read directly, no need to prefetch.
+    if (!str_startswith(hips->service_url, "http://") &&
+        !str_startswith(hips->service_url, "https://"))
+        return;
+    if (!g_cache || !hips_is_ready(hips)) return;
+
+    core_predict_view(PREFETCH_TIME, &yaw, &pitch, &fov);
+    pred_order = order + round(log2(core->fov / fov));
+    pred_order = fmax(pred_order, hips->order_min);
+    if (hips->order) pred_order = fmin(pred_order, hips->order);
+    // Same hard limit as hips_render, unless we already render deeper.
+    pred_order = fmin(pred_order, fmax(order, 9));
+    get_view_cone(hips, yaw, pitch, fov, dir, &radius);
+    get_view_cone(hips, obs->yaw, obs->pitch, core->fov, view_dir,
+                  &view_radius);
+    // Nothing to do if the current view already covers the predicted one.
+    if (pred_order <= order &&
+            vec3_sep(dir, view_dir) + radius <= view_radius)
+        return;
+
+    hips_iter_init(&iter);
+    while (hips_iter_next(&iter, &o, &pix)) {
+        healpix_pix2vec(1 << o, pix, pos);
+        // Generous angular radius of the pixel.
+        pix_radius = sqrt(4 * M_PI / (12.0 * (1 << (2 * o))));
+        if (vec3_sep(pos, dir) > radius + pix_radius) continue;
+        if (o < pred_order) {
+            hips_iter_push_children(&iter, o, pix);
+            continue;
+        }
+        // The renderer already requests the tiles of the current view.
+        if (o <= order && vec3_sep(pos, view_dir) < view_radius + pix_radius)
+            continue;
+        prefetch_tile(hips, o, pix);
+    }
+    hips_iter_release(&iter);
+}
+
 /*
  * Default tile support for images surveys
  */
@@ -835,3 +1430,120 @@ double hips_parse_date(const char *str)
     eraDtf2d("UTC", iy, im, id, ihr, imn, 0, &d1, &d2);
     return d1 - DJM0 + d2;
 }
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static double test_priority(void *user, int order, int pix)
+{
+    return (pix * 7919) % 1000;
+}
+
+static void test_hips_iter(void)
+{
+    hips_iterator_t iter;
+    int order, pix, nb = 0, nb_max_order = 0;
+    double last = DBL_MAX;
+
+    // Breadth first, up to order 5: the queue needs to grow.
+    hips_iter_init(&iter);
+    while (hips_iter_next(&iter, &order, &pix)) {
+        assert(order >= nb_max_order);
+        nb_max_order = order;
+        nb++;
+        if (order < 5) hips_iter_push_children(&iter, order, pix);
+    }
+    assert(nb == 12 * (1 + 4 + 16 + 64 + 256 + 1024));
+    assert(iter.queue && !iter.over_budget);
+    hips_iter_release(&iter);
+
+    // Priority order, with a budget.
+    hips_iter_init(&iter);
+    hips_iter_set_priority(&iter, test_priority, NULL);
+    hips_iter_set_budget(&iter, 1000, 0);
+    nb = 0;
+    while (hips_iter_next(&iter, &order, &pix)) {
+        assert(iter.current <= last);
+        last = iter.current;
+        nb++;
+        if (order < 5) hips_iter_push_children(&iter, order, pix);
+    }
+    assert(nb == 1000 && iter.over_budget);
+    hips_iter_release(&iter);
+}
+
+static void *test_snapshot_tile(void *user, const void *tile, int *size)
+{
+    *size = strlen(tile) + 1;
+    return strdup(tile);
+}
+
+static void *test_create_tile_from_snapshot(
+        void *user, int order, int pix, const void *data, int size,
+        int *cost)
+{
+    return NULL;
+}
+
+// Remove all the snapshots in memory, to force to read them from disk.
+static void test_clear_snapshots_cache(void)
+{
+    int size = g_snapshots.size;
+    hips_set_snapshots_cache_size(0);
+    hips_set_snapshots_cache_size(size);
+}
+
+static void test_snapshots(void)
+{
+    char dir[] = "/tmp/swe-test-snapshots-XXXXXX";
+    char key[64], path[1024];
+    hips_t hips = {.hash = 1234, .release_date = 10};
+    tile_t tile = {.pos = {3, 100}, .hips = &hips, .flags = TILE_NO_CHILD_1,
+                   .data = "tile data"};
+    disk_cache_t *disk = g_snapshots.disk;
+    const snapshot_t *snap;
+    snapshot_t *file_snap;
+    int size;
+
+    hips.settings.snapshot_tile = test_snapshot_tile;
+    hips.settings.create_tile_from_snapshot = test_create_tile_from_snapshot;
+    get_snapshot_disk_key(&hips, 3, 100, key, sizeof(key));
+    assert(mkdtemp(dir));
+    g_snapshots.disk = NULL;
+    hips_set_snapshots_dir(dir, 1 << 20);
+
+    // Save, and read back from disk.
+    save_snapshot(&tile);
+    test_clear_snapshots_cache();
+    snap = get_snapshot(&hips, 3, 100);
+    assert(snap && snap->flags == TILE_NO_CHILD_1);
+    assert(strcmp((const char*)snap->data, "tile data") == 0);
+
+    // New release of the survey: the file is ignored and removed.
+    test_clear_snapshots_cache();
+    hips.release_date = 11;
+    assert(!get_snapshot(&hips, 3, 100));
+    assert(!disk_cache_get_info(g_snapshots.disk, key, NULL, NULL));
+
+    // Corrupted data.
+    save_snapshot(&tile);
+    file_snap = disk_cache_read(g_snapshots.disk, key, &size);
+    file_snap->data[0] = 'T';
+    disk_cache_write(g_snapshots.disk, key, file_snap, size, NULL, 0);
+    free(file_snap);
+    test_clear_snapshots_cache();
+    assert(!get_snapshot(&hips, 3, 100));
+    assert(!disk_cache_get_info(g_snapshots.disk, key, NULL, NULL));
+
+    hips_set_snapshots_dir(NULL, 0);
+    g_snapshots.disk = disk;
+    snprintf(path, sizeof(path), "%s/index", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+TEST_REGISTER(NULL, test_hips_iter, TEST_AUTO);
+TEST_REGISTER(NULL, test_snapshots, TEST_AUTO);
+
+#endif
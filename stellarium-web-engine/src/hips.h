@@ -43,17 +43,33 @@ enum {
  *                 can be anything.  This is called every time the survey
  *                 load a tile that is not in the cache.  See note [1]
  *   delete_tile - function used to delete the data returned by create_tile.
+ *   snapshot_tile - optional function that serializes a tile into a single
+ *                 malloc'ed relocatable buffer.  See note [2].
+ *   create_tile_from_snapshot - create a tile back from a buffer returned
+ *                 by snapshot_tile.  Return NULL if the data is not valid.
  *   user        - pointer passed to create_tile.
  *
  * Note 1:
  *   The create_tile function needs to return a cost value (in bytes) for the
  *   cache, and if we know that some children tiles don't need to be loaded, we
  *   can set the transparency value, as a four bits bitmask, one bit per child.
+ *
+ * Note 2:
+ *   When a tile is evicted from the cache, we keep its snapshot in a
+ *   separate cache (see <hips_set_snapshots_cache_size>), and on disk if
+ *   <hips_set_snapshots_dir> has been called, so that getting the tile
+ *   again doesn't require to parse the source data.  The snapshot can be
+ *   written to a file and loaded back at a different address, so it should
+ *   not contain any pointer, and should have its own version number.
  */
 typedef struct hips_settings {
     void *(*create_tile)(void *user, int order, int pix, const void *data,
                                int size, int *cost, int *transparency);
     int (*delete_tile)(void *tile);
+    void *(*snapshot_tile)(void *user, const void *tile, int *size);
+    void *(*create_tile_from_snapshot)(void *user, int order, int pix,
+                                       const void *data, int size,
+                                       int *cost);
     const char *ext; // If set, force the files extension.
     void *user;
 } hips_settings_t;
@@ -130,6 +146,33 @@ void hips_delete(hips_t *hips);
  */
 void *hips_get_tile(hips_t *hips, int order, int pix, int flags, int *code);
 
+/*
+ * Function: hips_set_snapshots_cache_size
+ * Set the size of the cache of the evicted tiles snapshots.
+ *
+ * The default is 64 MiB, and 32 MiB for the wasm build.
+ *
+ * Parameters:
+ *   size - Maximum size in bytes, or 0 to disable the snapshots, including
+ *          the ones on disk.
+ */
+void hips_set_snapshots_cache_size(int size);
+
+/*
+ * Function: hips_set_snapshots_dir
+ * Set a directory where to also save the tiles snapshots.
+ *
+ * The snapshots are kept in a size limited disk cache (see <disk_cache.h>),
+ * so that they can be reused by the next sessions.  Each snapshot has a
+ * version and a crc, and the invalid ones are ignored and removed.
+ *
+ * Parameters:
+ *   dir      - Path to a directory, or NULL to only keep the snapshots in
+ *              memory.
+ *   max_size - Max total size of the snapshots on disk, in bytes.
+ */
+void hips_set_snapshots_dir(const char *dir, int64_t max_size);
+
 /*
  * Function: hips_is_ready
  * Check if a hips survey is ready to use
@@ -157,7 +200,6 @@ bool hips_update(hips_t *hips);
  *
  * Return:
  *   0 if the traverse finished.
- *   -1 if we reach the traverse limite.
  *   -v if the callback returned a negative value -v.
  */
 int hips_traverse(void *user, int callback(int order, int pix, void *user));
@@ -165,7 +207,7 @@ int hips_traverse(void *user, int callback(int order, int pix, void *user));
 
 /*
  * Struct: hips_iterator_t
- * Used for breadth first traversal of hips.
+ * Used for traversal of hips.
  *
  * To iter a hips index we can use the <hips_iter_init>, <hips_iter_next>
  * and <hips_iter_push_children> functions.  e.g:
@@ -179,16 +221,45 @@ int hips_traverse(void *user, int callback(int order, int pix, void *user));
  *         hips_iter_push_children(iter, order, pix);
  *      }
  *  }
+ *  hips_iter_release(&iter);
  *
+ * By default the traversal is breadth first.  With
+ * <hips_iter_set_priority> the pixels are returned by order of priority
+ * instead, and with <hips_iter_set_budget> we can stop the traversal once
+ * we processed enough pixels, so that we only skip the least important
+ * ones.
+ *
+ * The queue grows as needed: we only allocate memory if the traversal
+ * goes over HIPS_ITER_INLINE_SIZE pending pixels.
  */
+#define HIPS_ITER_INLINE_SIZE 256
+
+typedef struct hips_iterator_node {
+    int     order;
+    int     pix;
+    double  priority;
+} hips_iterator_node_t;
+
 typedef struct hips_iterator
 {
-    struct {
-        int order;
-        int pix;
-    } queue[1024]; // Todo: make it dynamic?
+    hips_iterator_node_t *queue; // Malloc'ed queue, or NULL.
+    hips_iterator_node_t inline_queue[HIPS_ITER_INLINE_SIZE];
     int size;
     int start;
+    int allocated;
+    // Priority mode.
+    double (*priority)(void *user, int order, int pix);
+    void *priority_user;
+    double current; // Priority of the last returned pixel.
+    int frame; // For the view priority.
+    // Budget.
+    int nb;             // Number of pixels returned so far.
+    int max_nb;         // 0 for no limit.
+    double deadline;    // Monotonic time limit, 0 for no limit.
+    bool over_budget;   // Set if we stopped because of the budget.
+    // Set by the render loops, so that only the pixels they visit are
+    // counted by the profiler (PROFILE_TILES_VISITED).
+    bool is_render;
 } hips_iterator_t;
 
 /*
@@ -197,11 +268,58 @@ typedef struct hips_iterator
  */
 void hips_iter_init(hips_iterator_t *iter);
 
+/*
+ * Function: hips_iter_set_priority
+ * Return the pixels by decreasing priority instead of breadth first.
+ *
+ * Should be called right after <hips_iter_init>.  The priority of the
+ * children is clamped to the priority of their parent, so that we always
+ * get the parents first.
+ *
+ * Parameters:
+ *   iter   - An iterator.
+ *   fn     - Function that returns the priority of a pixel.
+ *   user   - Data passed to fn.
+ */
+void hips_iter_set_priority(hips_iterator_t *iter,
+                            double (*fn)(void *user, int order, int pix),
+                            void *user);
+
+/*
+ * Function: hips_iter_set_view_priority
+ * Return the pixels by order of importance on screen.
+ *
+ * The priority is the approximate area of the pixels on screen,
+ * attenuated by their distance to the view center, so that we get the
+ * pixels the user is looking at first.
+ *
+ * Parameters:
+ *   iter   - An iterator.
+ *   frame  - Frame of the healpix grid.
+ */
+void hips_iter_set_view_priority(hips_iterator_t *iter, int frame);
+
+/*
+ * Function: hips_iter_set_budget
+ * Stop the iteration after a given number of pixels or a given time.
+ *
+ * Once the budget is used <hips_iter_next> returns false and sets the
+ * iterator over_budget attribute.
+ *
+ * Parameters:
+ *   iter       - An iterator.
+ *   max_nb     - Max number of pixels to return, or 0 for no limit.
+ *   max_time   - Max time since this call (sec), or 0 for no limit.
+ */
+void hips_iter_set_budget(hips_iterator_t *iter, int max_nb,
+                          double max_time);
+
 /*
  * Function: hips_iter_next
  * Pop the next healpix pixel from the iterator.
  *
- * Return false if there are no more pixel enqueued.
+ * Return false if there are no more pixel enqueued, or if we used all the
+ * budget.
  */
 bool hips_iter_next(hips_iterator_t *iter, int *order, int *pix);
 
@@ -209,11 +327,17 @@ bool hips_iter_next(hips_iterator_t *iter, int *order, int *pix);
  * Function: hips_iter_push_children
  * Add the four children of the giver pixel to the iterator.
  *
- * The children will be retrieved after all the currently queued values
- * from the iterator have been processed.
+ * In breadth first mode, the children will be retrieved after all the
+ * currently queued values from the iterator have been processed.
  */
 void hips_iter_push_children(hips_iterator_t *iter, int order, int pix);
 
+/*
+ * Function: hips_iter_release
+ * Release the memory allocated by an iterator.
+ */
+void hips_iter_release(hips_iterator_t *iter);
+
 /*
  * Function: hips_get_tile_texture
  * Get the texture for a given hips tile.
@@ -306,6 +430,39 @@ int hips_get_render_order_planet(const hips_t *hips, const painter_t *painter,
 int hips_render(hips_t *hips, const painter_t *painter,
                 const double transf[4][4], int split_order);
 
+/*
+ * Function: hips_schedule_loaders
+ * Start the decoding of the most important pending tiles.
+ *
+ * Should be called once per frame, after all the tiles have been requested.
+ * Tiles requested with the HIPS_LOAD_IN_THREAD flag are decoded in order of
+ * priority (size on screen and distance to the view center), and the tiles
+ * that were not requested during the frame are deferred.
+ *
+ * In builds without threads the tiles are always decoded synchronously, in
+ * the frame that requests them.
+ */
+void hips_schedule_loaders(void);
+
+/*
+ * Function: hips_prefetch
+ * Start downloading the tiles that will likely be visible soon.
+ *
+ * We predict the view a few hundred milliseconds in the future from the
+ * current animations and view motion (see <core_predict_view>), and
+ * request the tiles that would be visible then but that the renderer
+ * didn't ask for yet.  The number of downloads and the bandwidth are
+ * capped, and the prefetches that are not predicted visible anymore after
+ * a while get cancelled.
+ *
+ * Only online surveys are prefetched.
+ *
+ * Parameters:
+ *   hips   - A hips survey.
+ *   order  - The order at which the survey is currently rendered.
+ */
+void hips_prefetch(hips_t *hips, int order);
+
 /*
  * Function: hips_parse_date
  * Parse a date in the format supported for HiPS property files
@@ -63,20 +63,26 @@ static void line_get_normal(const double (*line)[3], int size, int i,
         vec2_normalize(n, n);
 }
 
+// Allocate memory, either from an arena or with calloc.
+static void *alloc(arena_t *arena, size_t n, size_t size)
+{
+    return arena ? arena_alloc(arena, n * size) : calloc(n, size);
+}
+
 line_mesh_t *line_to_mesh(const double (*line)[3],
                           const double (*win)[3],
-                          int size, double width)
+                          int size, double width, arena_t *arena)
 {
     int i, k;
     double n[2], v[2], length = 0;
-    line_mesh_t *mesh = calloc(1, sizeof(*mesh));
+    line_mesh_t *mesh = alloc(arena, 1, sizeof(*mesh));
 
     assert(size >= 2);
 
     mesh->verts_count = size * 2;
-    mesh->verts = calloc(mesh->verts_count, sizeof(*mesh->verts));
+    mesh->verts = alloc(arena, mesh->verts_count, sizeof(*mesh->verts));
     mesh->indices_count = 6 * (size - 1);
-    mesh->indices = calloc(mesh->indices_count, sizeof(*mesh->indices));
+    mesh->indices = alloc(arena, mesh->indices_count, sizeof(*mesh->indices));
 
     // Compute all vertices.
     for (i = 0; i < size; i++) {
@@ -118,14 +124,23 @@ static double line_point_dist(const double a[2], const double b[2],
     return fabs(vec2_cross(ap, u)) / vec2_norm(u);
 }
 
-static void line_push_point(double (**pos)[3], double (**win)[3],
+static void *grow(arena_t *arena, void *ptr, size_t old_size, size_t size)
+{
+    return arena ? arena_realloc(arena, ptr, old_size, size) :
+                   realloc(ptr, size);
+}
+
+static void line_push_point(arena_t *arena,
+                            double (**pos)[3], double (**win)[3],
                             const double p[3], const double w[3],
                             int *size, int *allocated)
 {
-    if (*size <= *allocated) {
-        *allocated += 4;
-        *pos = realloc(*pos, *allocated * sizeof(**pos));
-        *win = realloc(*win, *allocated * sizeof(**win));
+    int n;
+    if (*size >= *allocated) {
+        n = *allocated ? *allocated * 2 : 64;
+        *pos = grow(arena, *pos, *allocated * sizeof(**pos), n * sizeof(**pos));
+        *win = grow(arena, *win, *allocated * sizeof(**win), n * sizeof(**win));
+        *allocated = n;
     }
     memcpy((*pos)[*size], p, sizeof(**pos));
     memcpy((*win)[*size], w, sizeof(**win));
@@ -145,7 +160,7 @@ static void clip_to_win(const projection_t *proj,
 
 static void line_tesselate_(void (*func)(void *user, double t, double pos[3]),
                             const projection_t *proj,
-                            void *user, double t0, double t1,
+                            void *user, arena_t *arena, double t0, double t1,
                             double (**out_pos)[3],
                             double (**out_win)[3],
                             int level, int min_level,
@@ -177,21 +192,21 @@ static void line_tesselate_(void (*func)(void *user, double t, double pos[3]),
     if (    clipped || level > max_level ||
             line_point_dist(w0, w1, wm) < max_dist)
     {
-        line_push_point(out_pos, out_win, p1, w1, size, allocated);
+        line_push_point(arena, out_pos, out_win, p1, w1, size, allocated);
         return;
     }
 
 split:
-    line_tesselate_(func, proj, user, t0, tm, out_pos, out_win, level + 1,
-                    min_level, size, allocated);
-    line_tesselate_(func, proj, user, tm, t1, out_pos, out_win, level + 1,
-                    min_level, size, allocated);
+    line_tesselate_(func, proj, user, arena, t0, tm, out_pos, out_win,
+                    level + 1, min_level, size, allocated);
+    line_tesselate_(func, proj, user, arena, tm, t1, out_pos, out_win,
+                    level + 1, min_level, size, allocated);
 }
 
 
 int line_tesselate(void (*func)(void *user, double t, double pos[3]),
                    const projection_t *proj,
-                   void *user, int split,
+                   void *user, int split, arena_t *arena,
                    double (**out_pos)[3],
                    double (**out_win)[3])
 {
@@ -202,8 +217,8 @@ int line_tesselate(void (*func)(void *user, double t, double pos[3]),
 
     if (split > 0) {
         size = split + 1;
-        *out_pos = calloc(size, sizeof(**out_pos));
-        *out_win = calloc(size, sizeof(**out_win));
+        *out_pos = alloc(arena, size, sizeof(**out_pos));
+        *out_win = alloc(arena, size, sizeof(**out_win));
         for (i = 0; i < size; i++) {
             func(user, (double)i / split, pos);
             project_to_win(proj, pos, win);
@@ -214,8 +229,9 @@ int line_tesselate(void (*func)(void *user, double t, double pos[3]),
         min_level = -split;
         func(user, 0, pos);
         project_to_win(proj, pos, win);
-        line_push_point(out_pos, out_win, pos, win, &size, &allocated);
-        line_tesselate_(func, proj, user, 0, 1, out_pos, out_win, 0,
+        line_push_point(arena, out_pos, out_win, pos, win, &size,
+                        &allocated);
+        line_tesselate_(func, proj, user, arena, 0, 1, out_pos, out_win, 0,
                         min_level, &size, &allocated);
     }
     return size;
@@ -13,6 +13,7 @@
 #include <stdint.h>
 
 #include "projection.h"
+#include "utils/arena.h"
 
 /*
  * File: line.h
@@ -46,14 +47,15 @@ typedef struct line_mesh
  *   win    - Pre projected window coordinates.
  *   size   - Number of points in the line array.
  *   width  - width of the line.
+ *   arena  - Optional arena used for the allocations.
  *
  * Return:
- *   A new <line_mesh_t> instance, that should be released with
- *   <line_mesh_delete>.
+ *   A new <line_mesh_t> instance.  If arena is NULL it should be released
+ *   with <line_mesh_delete>.
  */
 line_mesh_t *line_to_mesh(const double (*line)[3],
                           const double (*win)[3],
-                          int size, double width);
+                          int size, double width, arena_t *arena);
 
 /*
  * Function: line_mesh_delete
@@ -73,6 +75,8 @@ void line_mesh_delete(line_mesh_t *mesh);
  *   split  - Number of segments requested in the output.  If < 0 use
  *            an adaptive algorithm, where -split is the minimum level
  *            of split.
+ *   arena  - Optional arena used to allocate the outputs.  If NULL the
+ *            outputs should be released with free.
  *   out_pos - Allocated out line points in view coordinates.
  *   out_win - Allocated out line points in windows coordinates.
  *
@@ -82,7 +86,7 @@ void line_mesh_delete(line_mesh_t *mesh);
  */
 int line_tesselate(void (*func)(void *user, double t, double pos[3]),
                    const projection_t *proj,
-                   void *user, int split,
+                   void *user, int split, arena_t *arena,
                    double (**out_pos)[3],
                    double (**out_win)[3]);
 
@@ -217,52 +217,59 @@ static int load_data_mpc(comets_t *comets, const char *data, int size,
     return nb;
 }
 
-static int load_data_stel_jsonl(
-        const char *url, comets_t *comets, const char *data, int size,
-        double *last_epoch)
+typedef struct {
+    comets_t    *comets;
+    const char  *url;
+    int         line_idx;
+    int         nb;
+    double      last_epoch;
+} load_ctx_t;
+
+static int on_stel_jsonl_line(void *user, const char *line, int len)
 {
-    const char *line = NULL;
-    char *uncompressed_data;
+    load_ctx_t *ctx = user;
     comet_t *comet;
-    int len, line_idx = 0, nb = 0;
     json_value *json;
 
-    uncompressed_data = z_uncompress_gz(data, size, &size);
-    if (!uncompressed_data) {
-        LOG_E("Cannot uncompress gz file: %s", url);
-        return -1;
+    ctx->line_idx++;
+    json = json_parse(line, len);
+    if (!json) goto error;
+    comet = (void*)module_add_new(&ctx->comets->obj, "mpc_comet", json);
+    json_value_free(json);
+    if (!comet) goto error;
+    ctx->last_epoch = fmax(ctx->last_epoch, comet->epoch);
+    ctx->nb++;
+
+    // Check for historical comets, where we change the h and g values
+    // around a peak date.  Only support Neowise for the moment.
+    if (strcmp(comet->name, "C/2020 F3 (NEOWISE)") == 0) {
+        comet->history = (typeof(comet->history)) {
+            .time = date2mjd(2020, 7, 3),
+            .duration = 30,
+            .peak_vmag = 1,
+            .h = 7.5,
+            .g = 5.2,
+        };
     }
-    data = uncompressed_data;
-    *last_epoch = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        (void)line_idx; // Suppress unused warning
-        json = json_parse(line, len);
-        if (!json) goto error;
-        comet = (void*)module_add_new(&comets->obj, "mpc_comet", json);
-        json_value_free(json);
-        if (!comet) goto error;
-        *last_epoch = fmax(*last_epoch, comet->epoch);
-        nb++;
-
-        // Check for historical comets, where we change the h and g values
-        // around a peak date.  Only support Neowise for the moment.
-        if (strcmp(comet->name, "C/2020 F3 (NEOWISE)") == 0) {
-            comet->history = (typeof(comet->history)) {
-                .time = date2mjd(2020, 7, 3),
-                .duration = 30,
-                .peak_vmag = 1,
-                .h = 7.5,
-                .g = 5.2,
-            };
-        }
+    return 0;
 
-        continue;
 error:
-        LOG_E("Cannot create comet from %s:%d", url, line_idx);
+    LOG_E("Cannot create comet from %s:%d", ctx->url, ctx->line_idx);
+    return 0;
+}
+
+static int load_data_stel_jsonl(
+        const char *url, comets_t *comets, const char *data, int size,
+        double *last_epoch)
+{
+    load_ctx_t ctx = {.comets = comets, .url = url};
+
+    if (z_iter_gz_lines(data, size, &ctx, on_stel_jsonl_line)) {
+        LOG_E("Cannot uncompress gz file: %s", url);
+        return -1;
     }
-    free(uncompressed_data);
-    return nb;
+    *last_epoch = ctx.last_epoch;
+    return ctx.nb;
 }
 
 static void comet_get_h_g(const comet_t *comet, double tt, double *h, double *g)
@@ -539,7 +546,8 @@ static int comets_update(obj_t *obj, double dt)
     if (comets->parsed || !comets->source_url)
         return 0;
 
-    data = asset_get_data2(comets->source_url, ASSET_USED_ONCE, &size, &code);
+    data = asset_get_data2(comets->source_url,
+                           ASSET_USED_ONCE | ASSET_CATALOG, &size, &code);
     if (!code) return 0; // Still loading.
     comets->parsed = true;
     if (!data) {
@@ -559,7 +559,8 @@ static bool constellation_lines_in_view(const constellation_t *con,
         return false;
 
     // Clipping test.
-    pos = calloc(con->lines.nb_stars, sizeof(*pos));
+    pos = painter_alloc(painter, con->lines.nb_stars * sizeof(*pos));
+    memset(pos, 0, con->lines.nb_stars * sizeof(*pos));
     for (i = 0; i < con->lines.nb_stars; i++) {
         if (!con->lines.stars[i]) continue;
         convert_frame(painter->obs, FRAME_ICRF, FRAME_VIEW, true,
@@ -567,10 +568,7 @@ static bool constellation_lines_in_view(const constellation_t *con,
         project_to_clip(painter->proj, pos[nb], pos[nb]);
         nb++;
     }
-    if (nb == 0) {
-        free(pos);
-        return true;
-    }
+    if (nb == 0) return true;
     // Compute margins in NDC.
     mx = m * painter->pixel_scale / painter->fb_size[0] * 2;
     my = m * painter->pixel_scale / painter->fb_size[1] * 2;
@@ -578,7 +576,6 @@ static bool constellation_lines_in_view(const constellation_t *con,
     my = fmin(my, 0.5);
 
     ret = !is_clipped(con->lines.nb_stars, pos, mx, my);
-    free(pos);
     return ret;
 }
 
@@ -653,7 +650,7 @@ static int render_lines(constellation_t *con, const painter_t *_painter,
     vec4_set(lines_color, 0.65, 1.0, 1.0, 0.4);
     vec4_emul(lines_color, painter.color, painter.color);
 
-    lines = calloc(con->lines.nb_stars, sizeof(*lines));
+    lines = painter_alloc(&painter, con->lines.nb_stars * sizeof(*lines));
     for (i = 0; i < con->lines.nb_stars; i++) {
         if (!con->lines.stars[i]) continue;
         vec3_copy(con->lines.stars_pos[i], lines[i]);
@@ -687,8 +684,6 @@ static int render_lines(constellation_t *con, const painter_t *_painter,
                    PAINTER_SKIP_DISCONTINUOUS);
     }
 
-    free(lines);
-
     return 0;
 }
 
@@ -18,6 +18,16 @@
 
 #define DSO_DEFAULT_VMAG 16.0
 
+// Version of the tiles snapshots format.  Increase it each time we change
+// the tiles data layout.
+#define SNAPSHOT_VERSION 1
+
+#define ALIGN16(x) (((x) + 15) & ~15)
+
+// Max number of tiles we visit in a single frame, starting from the most
+// important ones on screen.
+#define RENDER_MAX_TILES 4096
+
 static obj_klass_t dso_klass;
 
 /*
@@ -60,6 +70,9 @@ typedef struct {
 /*
  * Type: tile_t
  * Custom tile structure for the dso HiPS survey.
+ *
+ * The sources, the clipping data and all the strings are allocated in a
+ * single block, see tile_create.
  */
 typedef struct tile {
     int         flags;
@@ -68,6 +81,10 @@ typedef struct tile {
     int         nb;
     dso_t       *sources;
     dso_clip_data_t *sources_quick;
+    void        *buf;
+    int         buf_size;
+    char        *strings;   // Names and morpho strings of the sources.
+    int         strings_size;
 } tile_t;
 
 typedef struct survey survey_t;
@@ -201,6 +218,21 @@ static int dso_init(obj_t *obj, json_value *args)
     return 0;
 }
 
+static tile_t *tile_create(int nb, int strings_size)
+{
+    tile_t *tile = calloc(1, sizeof(*tile));
+    const int sources_size = ALIGN16(nb * sizeof(*tile->sources));
+    const int quick_size = ALIGN16(nb * sizeof(*tile->sources_quick));
+    tile->nb = nb;
+    tile->buf_size = sources_size + quick_size + strings_size;
+    tile->buf = calloc(1, tile->buf_size);
+    tile->sources = tile->buf;
+    tile->sources_quick = tile->buf + sources_size;
+    tile->strings = tile->buf + sources_size + quick_size;
+    tile->strings_size = strings_size;
+    return tile;
+}
+
 // Used by the cache.
 static int del_tile(void *data)
 {
@@ -211,17 +243,31 @@ static int del_tile(void *data)
     for (i = 0; i < tile->nb; i++) {
         if (tile->sources[i].obj.ref > 1) return CACHE_KEEP;
     }
-
-    for (i = 0; i < tile->nb; i++) {
-        free(tile->sources[i].names);
-        free(tile->sources[i].morpho);
-    }
-    free(tile->sources);
-    free(tile->sources_quick);
+    free(tile->buf);
     free(tile);
     return 0;
 }
 
+// Size of a list of names, including the final extra '\0'.
+static int names_size(const char *names)
+{
+    const char *p = names;
+    while (*p) p += strlen(p) + 1;
+    return p - names + 1;
+}
+
+// Copy a string into the tile strings block.
+static char *tile_add_string(tile_t *tile, int *ofs, const char *str,
+                             int size)
+{
+    char *ret;
+    if (!str) return NULL;
+    ret = tile->strings + *ofs;
+    memcpy(ret, str, size);
+    *ofs += size;
+    return ret;
+}
+
 static int dso_cmp(const void *a, const void *b)
 {
     return cmp(((const dso_t*)a)->display_vmag,
@@ -253,12 +299,15 @@ static int on_file_tile_loaded(const char type[4],
                                void *user)
 {
     tile_t *tile;
-    dso_t *s;
+    dso_t *s, *sources;
     int nb, i, j, version, data_ofs = 0, flags, row_size, order, pix;
-    int children_mask;
-    char morpho[32], ids[256] = {};
-    double bmag, temp_mag, tmp_ra, tmp_de, tmp_smax, tmp_smin, tmp_angle;
+    int children_mask, r = 0, strings_size = 0, ofs = 0;
+    char morpho[33], ids[257];
     void *tile_data;
+    float *fcols;
+    char *scols[3];
+    enum {C_TYPE, C_VMAG, C_BMAG, C_RA, C_DE, C_SMAX, C_SMIN, C_ANGL, C_MORP,
+          C_IDS};
     tile_t **out = USER_GET(user, 1); // Receive the tile.
     int *transparency = USER_GET(user, 2);
 
@@ -286,48 +335,59 @@ static int on_file_tile_loaded(const char type[4],
         LOG_E("Cannot parse file");
         return -1;
     }
-    tile_data = eph_read_compressed_block(data, size, &data_ofs, &size);
+    tile_data = eph_read_table_block(data, size, &data_ofs, &size,
+                                     flags, row_size, nb);
     if (!tile_data) return -1;
-    data_ofs = 0;
-    if (flags & 1) {
-        eph_shuffle_bytes(tile_data + data_ofs, row_size, nb);
-    }
 
-    tile = calloc(1, sizeof(*tile));
-    tile->mag_min = DBL_MAX;
-    tile->mag_max = -DBL_MAX;
-    tile->nb = nb;
-
-    tile->sources = calloc(tile->nb, sizeof(dso_t));
+    // Decode all the columns at once.  The float columns are stored
+    // together, from vmag to angl.
+    #define FCOL(c) (fcols + ((c) - C_VMAG) * nb)
+    fcols = malloc((C_ANGL - C_VMAG + 1) * nb * sizeof(*fcols));
+    for (i = C_VMAG; i <= C_ANGL; i++)
+        r |= eph_read_table_column(tile_data, size, nb, &columns[i], FCOL(i));
+    for (i = 0; i < 3; i++) {
+        j = (int[]){C_TYPE, C_MORP, C_IDS}[i];
+        scols[i] = malloc(nb * columns[j].size);
+        r |= eph_read_table_column(tile_data, size, nb, &columns[j],
+                                   scols[i]);
+    }
+    free(tile_data);
+    if (r) {
+        LOG_E("Cannot parse table data");
+        free(fcols);
+        for (i = 0; i < 3; i++) free(scols[i]);
+        return -1;
+    }
 
-    for (i = 0; i < tile->nb; i++) {
-        s = &tile->sources[i];
+    // Parse all the sources first, so that we know the size of the strings
+    // before we create the tile.
+    sources = calloc(nb, sizeof(*sources));
+    for (i = 0; i < nb; i++) {
+        s = &sources[i];
         s->obj.ref = 1;
         s->obj.klass = &dso_klass;
-        eph_read_table_row(tile_data, size, &data_ofs,
-                           ARRAY_SIZE(columns), columns,
-                           s->obj.type,
-                           &temp_mag, &bmag, &tmp_ra, &tmp_de,
-                           &tmp_smax, &tmp_smin, &tmp_angle,
-                           morpho, ids);
-        s->ra = tmp_ra;
-        s->de = tmp_de;
-
-        s->smax = tmp_smax;
-        s->smin = tmp_smin;
-        s->angle = tmp_angle;
+        memcpy(s->obj.type, scols[0] + i * columns[C_TYPE].size,
+               columns[C_TYPE].size < 4 ? columns[C_TYPE].size : 4);
+        snprintf(morpho, sizeof(morpho), "%.*s", columns[C_MORP].size,
+                 scols[1] + i * columns[C_MORP].size);
+        snprintf(ids, sizeof(ids), "%.*s", columns[C_IDS].size,
+                 scols[2] + i * columns[C_IDS].size);
+        s->ra = FCOL(C_RA)[i];
+        s->de = FCOL(C_DE)[i];
+
+        s->smax = FCOL(C_SMAX)[i];
+        s->smin = FCOL(C_SMIN)[i];
+        s->angle = FCOL(C_ANGL)[i];
         if (!s->smin && s->smax) {
             s->smin = s->smax;
             s->angle = NAN;
         }
 
-        s->vmag = temp_mag;
+        s->vmag = FCOL(C_VMAG)[i];
         // For the moment use bmag as fallback vmag value
-        if (isnan(s->vmag)) s->vmag = bmag;
+        if (isnan(s->vmag)) s->vmag = FCOL(C_BMAG)[i];
         if (memchr(s->obj.type, ' ', 4)) LOG_W_ONCE("Malformated otype");
         s->display_vmag = isnan(s->vmag) ? DSO_DEFAULT_VMAG : s->vmag;
-        tile->mag_min = fmin(tile->mag_min, s->display_vmag);
-        tile->mag_max = fmax(tile->mag_max, s->display_vmag);
 
         if (*morpho) s->morpho = strdup(morpho);
         s->symbol = symbols_get_for_otype(s->obj.type);
@@ -343,15 +403,35 @@ static int on_file_tile_loaded(const char type[4],
         // Compute the cap containing this DSO
         s->bounding_cap[3] = cosf(fmaxf(s->smin, s->smax));
         vec3_from_sphe(s->ra, s->de, s->bounding_cap);
+        if (s->names) strings_size += names_size(s->names);
+        if (s->morpho) strings_size += strlen(s->morpho) + 1;
     }
-    free(tile_data);
+    #undef FCOL
+    free(fcols);
+    for (i = 0; i < 3; i++) free(scols[i]);
 
     // Sort DSO in tile by display magnitude
-    qsort(tile->sources, tile->nb, sizeof(dso_t), dso_cmp);
-    // Create a small table with all data used for fast tile iteration
-    tile->sources_quick = calloc(tile->nb, sizeof(dso_clip_data_t));
-    for (i = 0; i < tile->nb; ++i)
-        tile->sources_quick[i] = tile->sources[i].clip_data;
+    qsort(sources, nb, sizeof(dso_t), dso_cmp);
+
+    tile = tile_create(nb, strings_size);
+    tile->mag_min = DBL_MAX;
+    tile->mag_max = -DBL_MAX;
+    for (i = 0; i < nb; i++) {
+        s = &tile->sources[i];
+        *s = sources[i];
+        s->names = tile_add_string(tile, &ofs, s->names,
+                                   s->names ? names_size(s->names) : 0);
+        s->morpho = tile_add_string(tile, &ofs, s->morpho,
+                                    s->morpho ? strlen(s->morpho) + 1 : 0);
+        free(sources[i].names);
+        free(sources[i].morpho);
+        tile->mag_min = fmin(tile->mag_min, s->display_vmag);
+        tile->mag_max = fmax(tile->mag_max, s->display_vmag);
+        // Small table with all data used for fast tile iteration
+        tile->sources_quick[i] = s->clip_data;
+    }
+    assert(ofs == strings_size);
+    free(sources);
 
     // If we have a json header, check for a children mask value.
     if (json) {
@@ -373,7 +453,93 @@ static void *dsos_create_tile(void *user, int order, int pix,
     survey_t *survey = user;
     eph_load(data, size, USER_PASS(survey, &tile, transparency),
              on_file_tile_loaded);
-    if (tile) *cost = tile->nb * sizeof(*tile->sources);
+    if (tile) *cost = sizeof(*tile) + tile->buf_size;
+    return tile;
+}
+
+/*
+ * Type: snapshot_header_t
+ * Header of the tiles snapshots, followed by a copy of the tile block,
+ * where the strings pointers are replaced by offsets.
+ */
+typedef struct {
+    uint32_t    version;
+    int32_t     nb;
+    int32_t     strings_size;
+    double      mag_min;
+    double      mag_max;
+} snapshot_header_t;
+
+#define SNAPSHOT_HEADER_SIZE ALIGN16(sizeof(snapshot_header_t))
+
+// Convert a pointer into the tile strings block to a relocatable offset,
+// and back.  Zero is used for NULL.
+static char *string_to_ofs(const tile_t *tile, const char *str)
+{
+    return str ? (char*)(uintptr_t)(str - tile->strings + 1) : NULL;
+}
+
+static char *ofs_to_string(const tile_t *tile, const char *ofs)
+{
+    return ofs ? tile->strings + (uintptr_t)ofs - 1 : NULL;
+}
+
+static void *dsos_snapshot_tile(void *user, const void *tile_, int *size)
+{
+    const tile_t *tile = tile_;
+    snapshot_header_t *header;
+    dso_t *sources;
+    void *ret;
+    int i;
+
+    *size = SNAPSHOT_HEADER_SIZE + tile->buf_size;
+    ret = calloc(1, *size);
+    header = ret;
+    header->version = SNAPSHOT_VERSION;
+    header->nb = tile->nb;
+    header->strings_size = tile->strings_size;
+    header->mag_min = tile->mag_min;
+    header->mag_max = tile->mag_max;
+    memcpy(ret + SNAPSHOT_HEADER_SIZE, tile->buf, tile->buf_size);
+    sources = ret + SNAPSHOT_HEADER_SIZE;
+    for (i = 0; i < tile->nb; i++) {
+        // The objects header is only valid in this process.
+        memset(&sources[i].obj, 0, sizeof(sources[i].obj));
+        memcpy(sources[i].obj.type, tile->sources[i].obj.type, 4);
+        sources[i].names = string_to_ofs(tile, sources[i].names);
+        sources[i].morpho = string_to_ofs(tile, sources[i].morpho);
+    }
+    return ret;
+}
+
+static void *dsos_create_tile_from_snapshot(
+        void *user, int order, int pix, const void *data, int size,
+        int *cost)
+{
+    const snapshot_header_t *header = data;
+    tile_t *tile;
+    dso_t *s;
+    int i;
+
+    if (size < SNAPSHOT_HEADER_SIZE || header->version != SNAPSHOT_VERSION)
+        return NULL;
+    tile = tile_create(header->nb, header->strings_size);
+    if (SNAPSHOT_HEADER_SIZE + tile->buf_size != size) {
+        LOG_W("Wrong dso tile snapshot size");
+        del_tile(tile);
+        return NULL;
+    }
+    memcpy(tile->buf, data + SNAPSHOT_HEADER_SIZE, tile->buf_size);
+    tile->mag_min = header->mag_min;
+    tile->mag_max = header->mag_max;
+    for (i = 0; i < tile->nb; i++) {
+        s = &tile->sources[i];
+        s->obj.ref = 1;
+        s->obj.klass = &dso_klass;
+        s->names = ofs_to_string(tile, s->names);
+        s->morpho = ofs_to_string(tile, s->morpho);
+    }
+    *cost = sizeof(*tile) + tile->buf_size;
     return tile;
 }
 
@@ -621,12 +787,11 @@ void dso_get_designations(
     }
 }
 
-static int render_visitor(int order, int pix, void *user)
+static int render_visitor(survey_t *survey, int order, int pix,
+                          const painter_t *painter_,
+                          int *nb_tot, int *nb_loaded)
 {
-    painter_t painter = *(const painter_t*)USER_GET(user, 0);
-    int *nb_tot = USER_GET(user, 1);
-    int *nb_loaded = USER_GET(user, 2);
-    survey_t *survey = USER_GET(user, 3);
+    painter_t painter = *painter_;
     tile_t *tile;
     int i, ret, code;
     uint64_t hint;
@@ -661,14 +826,26 @@ static int dsos_update(obj_t *obj, double dt)
 static int dsos_render(obj_t *obj, const painter_t *painter_)
 {
     const dsos_t *dsos = (const dsos_t*)obj;
-    int nb_tot = 0, nb_loaded = 0;
+    int nb_tot = 0, nb_loaded = 0, order, pix, r, max_order;
     painter_t painter = *painter_;
     survey_t *survey;
+    hips_iterator_t iter;
 
     painter.color[3] *= dsos->visible.value;
     DL_FOREACH(dsos->surveys, survey) {
-        hips_traverse(USER_PASS(&painter, &nb_tot, &nb_loaded, survey),
-                      render_visitor);
+        hips_iter_init(&iter);
+        iter.is_render = true;
+        hips_iter_set_view_priority(&iter, FRAME_ICRF);
+        hips_iter_set_budget(&iter, RENDER_MAX_TILES, 0);
+        max_order = 0;
+        while (hips_iter_next(&iter, &order, &pix)) {
+            max_order = fmax(max_order, order);
+            r = render_visitor(survey, order, pix, &painter,
+                               &nb_tot, &nb_loaded);
+            if (r == 1) hips_iter_push_children(&iter, order, pix);
+        }
+        hips_iter_release(&iter);
+        hips_prefetch(survey->hips, max_order);
     }
     progressbar_report("DSO", "DSO", nb_loaded, nb_tot, -1);
     return 0;
@@ -702,7 +879,10 @@ static int dsos_list(const obj_t *obj,
         hips_iter_init(&iter);
         while (hips_iter_next(&iter, &order, &pix)) {
             tile = get_tile(survey, order, pix, false, &code);
-            if (!tile && !code) return MODULE_AGAIN;
+            if (!tile && !code) {
+                hips_iter_release(&iter);
+                return MODULE_AGAIN;
+            }
             if (!tile || tile->mag_min >= max_mag) continue;
             for (i = 0; i < tile->nb; i++) {
                 vmag = tile->sources[i].vmag;
@@ -713,6 +893,7 @@ static int dsos_list(const obj_t *obj,
             if (i < tile->nb) break;
             hips_iter_push_children(&iter, order, pix);
         }
+        hips_iter_release(&iter);
         return 0;
     }
 
@@ -738,6 +919,8 @@ static int dsos_add_data_source(obj_t *obj, const char *url, const char *key)
     hips_settings_t survey_settings = {
         .create_tile = dsos_create_tile,
         .delete_tile = del_tile,
+        .snapshot_tile = dsos_snapshot_tile,
+        .create_tile_from_snapshot = dsos_create_tile_from_snapshot,
     };
     DL_COUNT(dsos->surveys, survey, idx);
     survey = calloc(1, sizeof(*survey));
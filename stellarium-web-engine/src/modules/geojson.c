@@ -615,6 +615,7 @@ int geojson_survey_query_rendered_features(
                                            tiles + nb, index + nb);
             if (nb >= max_ret) break;
         }
+        hips_iter_release(&iter);
         return nb;
     }
 
@@ -628,6 +629,7 @@ int geojson_survey_query_rendered_features(
                                            tiles + nb, index + nb);
         if (nb >= max_ret) break;
     }
+    hips_iter_release(&iter);
     return nb;
 }
 
@@ -754,6 +756,7 @@ static int survey_render(obj_t *obj, const painter_t *painter)
 
     if (!hips_is_ready(hips)) return 0;
     hips_iter_init(&iter);
+    iter.is_render = true;
     while (survey_iter_visible_tiles(survey, painter, &iter, &order, &pix,
                                      &code, &tile)) {
         nb_tot++;
@@ -761,6 +764,7 @@ static int survey_render(obj_t *obj, const painter_t *painter)
         if (!tile) continue;
         image_render((obj_t*)tile, painter);
     }
+    hips_iter_release(&iter);
 
     progressbar_report(survey->hips->url, survey->hips->label,
                        nb_loaded, nb_tot, -1);
@@ -195,6 +195,7 @@ static int labels_render(obj_t *obj, const painter_t *painter_)
         paint_text(&painter, label->render_text, pos, NULL,
                    label->align, label->effects, label->size,
                    label->angle);
+        profiler_count(PROFILE_LABELS, 1);
     }
     return 0;
 }
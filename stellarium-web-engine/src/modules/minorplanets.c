@@ -411,7 +411,7 @@ static int mplanets_update(obj_t *obj, double dt)
     mplanets_t *mps = (void*)obj;
 
     if (!mps->parsed && mps->source_url) {
-        data = asset_get_data(mps->source_url, &size, &code);
+        data = asset_get_data2(mps->source_url, ASSET_CATALOG, &size, &code);
         if (!code) return 0; // Still loading.
         mps->parsed = true;
         if (!data) {
@@ -897,6 +897,7 @@ static void planet_render_hips(const planet_t *planet,
     // Iter the HiPS pixels and render them.
     hips_update(hips);
     hips_iter_init(&iter);
+    iter.is_render = true;
     while (hips_iter_next(&iter, &order, &pix)) {
         if (painter_is_planet_healpix_clipped(&painter, mat, order, pix))
             continue;
@@ -908,6 +909,7 @@ static void planet_render_hips(const planet_t *planet,
         on_render_tile(hips, &painter, mat, order, pix, split, flags,
                        planet, &nb_tot, &nb_loaded);
     }
+    hips_iter_release(&iter);
 
     if (planet->rings.tex)
         render_rings(planet, &painter, mat);
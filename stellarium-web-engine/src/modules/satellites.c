@@ -85,42 +85,47 @@ static int satellites_add_data_source(
     return 0;
 }
 
-static int load_jsonl_data(satellites_t *sats, const char *data, int size,
-                           const char *url, double *last_epoch)
+typedef struct {
+    satellites_t    *sats;
+    const char      *url;
+    int             line_idx;
+    int             nb;
+    double          last_epoch;
+} load_ctx_t;
+
+static int on_jsonl_line(void *user, const char *line, int len)
 {
-    const char *line = NULL;
-    int len, line_idx = 0, nb = 0;
-    char *uncompressed_data;
+    load_ctx_t *ctx = user;
     json_value *json;
     satellite_t *sat;
 
-    // XXX: should use a more robust gz uncompression function for external
-    // data.
-    uncompressed_data = z_uncompress_gz(data, size, &size);
-    if (!uncompressed_data) {
+    ctx->line_idx++;
+    json = json_parse(line, len);
+    if (!json) goto error;
+    sat = (void*)module_add_new(&ctx->sats->obj, "tle_satellite", json);
+    json_value_free(json);
+    if (!sat) goto error;
+    ctx->last_epoch = fmax(ctx->last_epoch, sgp4_get_satepoch(sat->elsetrec));
+    ctx->nb++;
+    return 0;
+error:
+    LOG_E("Cannot create sat from %s:%d", ctx->url, ctx->line_idx);
+    return 0;
+}
+
+static int load_jsonl_data(satellites_t *sats, const char *data, int size,
+                           const char *url, double *last_epoch)
+{
+    load_ctx_t ctx = {.sats = sats, .url = url};
+
+    // Parse the lines as we uncompress them, so that we never have the full
+    // uncompressed file in memory.
+    if (z_iter_gz_lines(data, size, &ctx, on_jsonl_line)) {
         LOG_E("Cannot uncompress gz file: %s", url);
         return -1;
     }
-
-    data = uncompressed_data;
-
-    *last_epoch = 0;
-    while (iter_lines(data, size, &line, &len)) {
-        line_idx++;
-        json = json_parse(line, len);
-        if (!json) goto error;
-        sat = (void*)module_add_new(&sats->obj, "tle_satellite", json);
-        json_value_free(json);
-        if (!sat) goto error;
-        *last_epoch = fmax(*last_epoch, sgp4_get_satepoch(sat->elsetrec));
-        nb++;
-        continue;
-error:
-        LOG_E("Cannot create sat from %s:%d", url, line_idx);
-    }
-
-    free(uncompressed_data);
-    return nb;
+    *last_epoch = ctx.last_epoch;
+    return ctx.nb;
 }
 
 static int satellites_update(obj_t *obj, double dt)
@@ -134,7 +139,8 @@ static int satellites_update(obj_t *obj, double dt)
     if (sats->loaded) return 0;
     if (!sats->jsonl_url) return 0;
 
-    data = asset_get_data2(sats->jsonl_url, ASSET_USED_ONCE, &size, &code);
+    data = asset_get_data2(sats->jsonl_url, ASSET_USED_ONCE | ASSET_CATALOG,
+                           &size, &code);
     if (!code) return 0; // Sill loading.
     if (!data) return 0; // Got error;
     nb = load_jsonl_data(sats, data, size, sats->jsonl_url, &last_epoch);
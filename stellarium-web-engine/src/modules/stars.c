@@ -20,23 +20,65 @@
 
 static const double LABEL_SPACING = 4;
 
+// Max error of the cached stars astrometric directions (rad).
+static const double ASTROM_CACHE_PRECISION = 0.01 * ERFA_DAS2R;
+// Max speed of the earth relative to the solar system barycenter (AU/day).
+static const double EARTH_MAX_SPEED = 0.0175;
+
+// Version of the tiles snapshots format.  Increase it each time we change
+// the tiles data layout.
+#define SNAPSHOT_VERSION 2
+
+// The stars of a tile are grouped by healpix pixel at this many orders
+// below the tile order, so that at deep zoom we can skip the parts of the
+// tile that are out of the screen.
+#define TILE_BUCKETS_DEPTH 2
+#define TILE_NB_BUCKETS (1 << (2 * TILE_BUCKETS_DEPTH))
+
+// Min number of stars to render in a tile before we start to test the
+// buckets clipping.  Below that, projecting the stars is faster.
+#define BUCKETS_CULL_MIN_STARS 64
+
+// Max number of tiles we visit in a single frame.  The tiles are visited
+// by order of importance on screen, so if we reach the limit we only skip
+// the smallest tiles on the border of the view.
+#define RENDER_MAX_TILES 4096
+
+#define ALIGN16(x) (((x) + 15) & ~15)
+
 static obj_klass_t star_klass;
 
 typedef struct stars stars_t;
+typedef struct tile tile_t;
+
+/*
+ * Type: star_data_t
+ * Catalog data of a star that is not needed for rendering.
+ */
 typedef struct {
-    obj_t   obj;
     uint64_t gaia;  // Gaia source id (0 if none)
     int     hip;    // HIP number.
-    float   vmag;
-    float   plx;    // Parallax (arcsec) (Note: could be computed from pvo).
+    char    type[4] NONSTRING;
+    float   plx;    // Parallax (arcsec).
     float   bv;
-    float   illuminance; // (lux)
-    // Normalized Astrometric direction + movement.
-    double  pvo[2][3];
-    double  distance;    // Distance in AU
     // List of extra names, separated by '\0', terminated by two '\0'.
     char    *names;
     char    *sp_type;
+} star_data_t;
+
+/*
+ * Type: star_t
+ * Object for a single star.
+ *
+ * The stars in the tiles are plain catalog records, we only create the
+ * star objects when we need them (for selection, labels, search...).  The
+ * objects are then owned by the tile, so that the same star always
+ * returns the same object as long as the tile is in the cache.
+ */
+typedef struct {
+    obj_t   obj;
+    tile_t  *tile;  // Tile holding the star data.
+    int     idx;    // Index of the star in the tile arrays.
 } star_t;
 
 typedef struct survey survey_t;
@@ -72,15 +114,152 @@ static stars_t *g_stars = NULL;
 /*
  * Type: tile_t
  * Custom tile structure for the stars hips survey.
+ *
+ * The stars are stored as separate arrays, so that the render loop only
+ * touches the data it needs.  The rest of the stars data is in the
+ * 'sources' side table.
+ *
+ * The stars are grouped into buckets, one per healpix child pixel at
+ * TILE_BUCKETS_DEPTH orders below the tile, and sorted by vmag inside each
+ * bucket.
  */
-typedef struct tile {
-    int         flags;
+struct tile {
     double      mag_min;
     double      mag_max;
     double      illuminance; // Totall illuminance (lux).
     int         nb;
-    star_t      *sources;
-} tile_t;
+    struct {
+        int     start;      // Index of the first star of the bucket.
+        int     nb;
+    } buckets[TILE_NB_BUCKETS];
+    // Hot data, used for rendering.
+    double      (*pos)[3];  // Barycentric position at J2000 (AU).
+    double      (*vel)[3];  // Space motion (AU/day).
+    float       *vmag;
+    float       *lux;       // Illuminance of each star (lux).
+    uint8_t     (*color)[4]; // RGBA color computed from the B-V index.
+    // Cache of the astrometric directions, see tile_get_astrom.
+    struct {
+        double  (*dirs)[3];
+        // Number of directions computed so far in each bucket.
+        int     nb[TILE_NB_BUCKETS];
+        double  tt;         // Epoch of the directions (MJD).
+        double  earth[3];   // Earth barycentric position at tt (AU).
+        double  max_dt;     // Validity of the cache around tt (day).
+    } astrom;
+    // Cold data.
+    star_data_t *sources;
+    // All the arrays above are allocated in a single block, followed by the
+    // stars names and spectral types.  See tile_create.
+    void        *buf;
+    int         buf_size;
+    char        *strings;
+    int         strings_size;
+    // Stars objects created so far, allocated on first use.
+    star_t      **objs;
+    // Set for the single star tiles owned by stars created from json.
+    bool        standalone;
+};
+
+/*
+ * Function: tile_create
+ * Create a tile with all its arrays allocated in a single block.
+ *
+ * Parameters:
+ *   nb             - Number of stars.
+ *   strings_size   - Size reserved after the arrays for the stars names
+ *                    and spectral types.
+ */
+static tile_t *tile_create(int nb, int strings_size)
+{
+    int i, ofs[7], size = 0;
+    tile_t *tile = calloc(1, sizeof(*tile));
+    const int sizes[7] = {
+        nb * sizeof(*tile->pos),
+        nb * sizeof(*tile->vel),
+        nb * sizeof(*tile->vmag),
+        nb * sizeof(*tile->lux),
+        nb * sizeof(*tile->color),
+        nb * sizeof(*tile->sources),
+        strings_size,
+    };
+    for (i = 0; i < 7; i++) {
+        ofs[i] = size;
+        size += ALIGN16(sizes[i]);
+    }
+    tile->buf = calloc(1, size);
+    tile->buf_size = size;
+    tile->pos = tile->buf + ofs[0];
+    tile->vel = tile->buf + ofs[1];
+    tile->vmag = tile->buf + ofs[2];
+    tile->lux = tile->buf + ofs[3];
+    tile->color = tile->buf + ofs[4];
+    tile->sources = tile->buf + ofs[5];
+    tile->strings = tile->buf + ofs[6];
+    tile->strings_size = strings_size;
+    return tile;
+}
+
+// Free the tile arrays, but not the stars names if they were allocated
+// outside of the tile block, or the stars objects.
+static void tile_delete(tile_t *tile)
+{
+    free(tile->buf);
+    free(tile->objs);
+    free(tile->astrom.dirs);
+    free(tile);
+}
+
+/*
+ * Function: tile_get_star
+ * Return the object of a star in a tile, creating it if needed.
+ *
+ * The returned object is owned by the tile, call obj_retain to keep it.
+ */
+static star_t *tile_get_star(tile_t *tile, int idx)
+{
+    star_t *star;
+    if (!tile->objs) tile->objs = calloc(tile->nb, sizeof(*tile->objs));
+    if (tile->objs[idx]) return tile->objs[idx];
+    star = calloc(1, sizeof(*star));
+    star->obj.ref = 1;
+    star->obj.klass = &star_klass;
+    memcpy(star->obj.type, tile->sources[idx].type, 4);
+    star->tile = tile;
+    star->idx = idx;
+    tile->objs[idx] = star;
+    return star;
+}
+
+// Test if a star is the current selection without creating its object.
+static bool tile_star_is_selected(const tile_t *tile, int idx)
+{
+    return core->selection && tile->objs && tile->objs[idx] &&
+           &tile->objs[idx]->obj == core->selection;
+}
+
+// Set the render data of a star from its vmag and bv.
+static void tile_set_mag(tile_t *tile, int i, double vmag, double bv)
+{
+    double color[3];
+    tile->vmag[i] = vmag;
+    tile->lux[i] = core_mag_to_illuminance(vmag);
+    bv_to_rgb(isnan(bv) ? 0 : bv, color);
+    tile->color[i][0] = color[0] * 255;
+    tile->color[i][1] = color[1] * 255;
+    tile->color[i][2] = color[2] * 255;
+    tile->color[i][3] = 255;
+}
+
+static inline float star_vmag(const star_t *s)
+{
+    return s->tile->vmag[s->idx];
+}
+
+static inline const star_data_t *star_data(const star_t *s)
+{
+    return &s->tile->sources[s->idx];
+}
 
 static void nuniq_to_pix(uint64_t nuniq, int *order, int *pix)
 {
@@ -98,8 +277,10 @@ static void nuniq_to_pix(uint64_t nuniq, int *order, int *pix)
  *   plx    - Parallax (arcseconds).
  */
 static void compute_pv(double ra, double de, double pra, double pde,
-                       double plx, double epoch, star_t *s)
+                       double plx, double epoch, double pos[3],
+                       double vel[3])
 {
+    double pvo[2][3];
     int r;
     double djm0, djm = 0;
 
@@ -114,7 +295,7 @@ static void compute_pv(double ra, double de, double pra, double pde,
 
     // Pre-compute 3D position and speed in catalog/barycentric position
     // at epoch 2000, to broadly match DSS images.
-    r = eraStarpv(ra, de, pra / cos(de), pde, plx, 0, s->pvo);
+    r = eraStarpv(ra, de, pra / cos(de), pde, plx, 0, pvo);
     if (r & (2 | 4)) {
         LOG_W("Wrong star coordinates");
         if (r & 2) LOG_W("Excessive speed");
@@ -124,16 +305,12 @@ static void compute_pv(double ra, double de, double pra, double pde,
               ra * DR2D, de * DR2D, pra * DR2MAS, pde * DR2MAS,
               plx * 1000);
     }
-    if (r & 1) {
-        s->distance = NAN;
-    } else {
-        s->distance = vec3_norm(s->pvo[0]);
-    }
 
     // Apply proper motion to bring from catalog epoch to 2000.0 epoch
     eraEpb2jd(epoch, &djm0, &djm);
     double dt = ERFA_DJM00 - djm;
-    vec3_addk(s->pvo[0], s->pvo[1], dt, s->pvo[0]);
+    vec3_addk(pvo[0], pvo[1], dt, pos);
+    vec3_copy(pvo[1], vel);
 }
 
 // Turn a json array of string into a '\0' separated C string.
@@ -157,53 +334,116 @@ static int star_init(obj_t *obj, json_value *args)
 {
     // Support creating a star using noctuasky model data json values.
     star_t *star = (star_t*)obj;
+    star_data_t *data;
     json_value *model, *names;
-    double epoch, ra, de, pra, pde;
-
+    double epoch, ra, de, pra, pde, vmag;
+
+    // The star data is in its own single star tile.
+    star->tile = tile_create(1, 0);
+    star->tile->nb = 1;
+    star->tile->buckets[0].nb = 1;
+    star->tile->standalone = true;
+    star->tile->objs = calloc(1, sizeof(*star->tile->objs));
+    star->tile->objs[0] = star;
+    data = &star->tile->sources[0];
+    tile_set_mag(star->tile, 0, 0, 0);
     model= json_get_attr(args, "model_data", json_object);
     if (model) {
         ra = json_get_attr_f(model, "ra", 0) * DD2R;
         de = json_get_attr_f(model, "de", 0) * DD2R;
-        star->plx = json_get_attr_f(model, "plx", 0) / 1000.0;
+        data->plx = json_get_attr_f(model, "plx", 0) / 1000.0;
         pra = json_get_attr_f(model, "pm_ra", 0) * ERFA_DMAS2R;
         pde = json_get_attr_f(model, "pm_de", 0) * ERFA_DMAS2R;
-        star->vmag = json_get_attr_f(model, "Vmag", NAN);
-        if (isnan(star->vmag))
-            star->vmag = json_get_attr_f(model, "vmag", NAN);  // Also try lowercase
+        vmag = json_get_attr_f(model, "Vmag", NAN);
+        if (isnan(vmag))
+            vmag = json_get_attr_f(model, "vmag", NAN);  // Also try lowercase
         epoch = json_get_attr_f(model, "epoch", 2000);
-        if (isnan(star->vmag))
-            star->vmag = json_get_attr_f(model, "Bmag", NAN);
-        if (isnan(star->vmag))
-            star->vmag = json_get_attr_f(model, "bmag", NAN);  // Also try lowercase
-        star->illuminance = core_mag_to_illuminance(star->vmag);
-        compute_pv(ra, de, pra, pde, star->plx, epoch, star);
+        if (isnan(vmag))
+            vmag = json_get_attr_f(model, "Bmag", NAN);
+        if (isnan(vmag))
+            vmag = json_get_attr_f(model, "bmag", NAN);  // Also try lowercase
+        tile_set_mag(star->tile, 0, vmag, data->bv);
+        compute_pv(ra, de, pra, pde, data->plx, epoch,
+                   star->tile->pos[0], star->tile->vel[0]);
     }
 
     names = json_get_attr(args, "names", json_array);
     if (names)
-        star->names = parse_json_names(names);
+        data->names = parse_json_names(names);
     return 0;
 }
 
+static void star_del(obj_t *obj)
+{
+    star_t *star = (star_t*)obj;
+    // Stars from the surveys are deleted with their tiles.
+    if (star->tile && star->tile->standalone) {
+        free(star->tile->sources[0].names);
+        free(star->tile->sources[0].sp_type);
+        tile_delete(star->tile);
+    }
+}
+
 // Return the star astrometric position, that is as seen from earth center
 // after applying proper motion and parallax.
-static void star_get_astrom(const star_t *s, const observer_t *obs,
-                            double v[3])
+static void star_get_astrom(const double pos[3], const double vel[3],
+                            const observer_t *obs, double v[3])
 {
     // Apply proper motion
     double dt = obs->tt - ERFA_DJM00;
-    vec3_addk(s->pvo[0], s->pvo[1], dt, v);
+    vec3_addk(pos, vel, dt, v);
     // Move to geocentric to get the astrometric position (apply parallax)
     vec3_sub(v, obs->earth_pvb[0], v);
     vec3_normalize(v, v);
 }
 
+/*
+ * Return the astrometric directions of the first nb stars of a tile
+ * bucket.
+ *
+ * The stars move very slowly, so we cache the directions and only
+ * recompute them when the time gets too far from the cache epoch.  The
+ * validity window is computed from the fastest star of the tile (proper
+ * motion plus parallax shift due to the earth motion), so that the error
+ * stays below ASTROM_CACHE_PRECISION.
+ */
+static const double (*tile_get_astrom(tile_t *tile, const observer_t *obs,
+                                      int bucket, int nb))[3]
+{
+    int i;
+    double rate = 0, v[3];
+    const int start = tile->buckets[bucket].start;
+
+    if (!tile->astrom.dirs) {
+        tile->astrom.dirs = malloc(tile->nb * sizeof(*tile->astrom.dirs));
+        for (i = 0; i < tile->nb; i++) {
+            rate = fmax(rate, (vec3_norm(tile->vel[i]) + EARTH_MAX_SPEED) /
+                              vec3_norm(tile->pos[i]));
+        }
+        tile->astrom.max_dt = ASTROM_CACHE_PRECISION / rate;
+    }
+    if (fabs(obs->tt - tile->astrom.tt) > tile->astrom.max_dt) {
+        memset(tile->astrom.nb, 0, sizeof(tile->astrom.nb));
+        tile->astrom.tt = obs->tt;
+        vec3_copy(obs->earth_pvb[0], tile->astrom.earth);
+    }
+    // Same as star_get_astrom, but at the cache epoch.
+    for (i = start + tile->astrom.nb[bucket]; i < start + nb; i++) {
+        vec3_addk(tile->pos[i], tile->vel[i],
+                  tile->astrom.tt - ERFA_DJM00, v);
+        vec3_sub(v, tile->astrom.earth, v);
+        vec3_normalize(v, tile->astrom.dirs[i]);
+    }
+    if (nb > tile->astrom.nb[bucket]) tile->astrom.nb[bucket] = nb;
+    return (const double (*)[3])tile->astrom.dirs + start;
+}
+
 // Return position and velocity in ICRF with origin on observer (AU).
 static int star_get_pvo(const obj_t *obj, const observer_t *obs,
                         double pvo[2][4])
 {
     const star_t *s = (const star_t*)obj;
-    star_get_astrom(s, obs, pvo[0]);
+    star_get_astrom(s->tile->pos[s->idx], s->tile->vel[s->idx], obs, pvo[0]);
     convert_frame(obs, FRAME_ASTROM, FRAME_ICRF, true, pvo[0], pvo[0]);
     pvo[0][3] = 0.0;
     pvo[1][0] = pvo[1][1] = pvo[1][2] = pvo[1][3] = 0.0;
@@ -219,10 +459,12 @@ static int star_get_info(const obj_t *obj, const observer_t *obs, int info,
         star_get_pvo(obj, obs, out);
         return 0;
     case INFO_VMAG:
-        *(double*)out = star->vmag;
+        *(double*)out = star_vmag(star);
         return 0;
     case INFO_DISTANCE:
-        *(double*)out = star->distance;
+        // Without parallax the position is at an arbitrary distance.
+        *(double*)out = star_data(star)->plx > 0 ?
+                        vec3_norm(star->tile->pos[star->idx]) : NAN;
         return 0;
     default:
         return 1;
@@ -231,7 +473,7 @@ static int star_get_info(const obj_t *obj, const observer_t *obs, int info,
 
 static json_value *star_get_json_data(const obj_t *obj)
 {
-    const star_t *star = (const star_t*)obj;
+    const star_data_t *star = star_data((const star_t*)obj);
     json_value* ret = json_object_new(0);
     json_value* md = json_object_new(0);
     if (star->hip) {
@@ -266,7 +508,8 @@ static json_value *star_get_json_data(const obj_t *obj)
  * Return:
  *   true if a label was found, false otherwise.
  */
-static bool star_get_skycultural_name(const star_t *s, char *out, int size)
+static bool star_get_skycultural_name(const star_data_t *s,
+                                      char *out, int size)
 {
     const char *name;
     char hip_buf[128];
@@ -297,7 +540,7 @@ static bool name_is_bayer(const char* name) {
  * Return:
  *   true if a label was found, false otherwise.
  */
-static bool star_get_bayer_name(const star_t *s, char *out, int size,
+static bool star_get_bayer_name(const star_data_t *s, char *out, int size,
                                 int flags)
 {
     const char *names = s->names;
@@ -318,7 +561,9 @@ static bool star_get_bayer_name(const star_t *s, char *out, int size,
 }
 
 
-static void star_render_name(const painter_t *painter, const star_t *s,
+// Render the label of a star of a tile.  The star object is only created
+// if we actually add a label.
+static void star_render_name(const painter_t *painter, tile_t *tile, int idx,
                              int frame, const double pos[3],
                              const double win_pos[2], double radius,
                              double color[3])
@@ -327,7 +572,8 @@ static void star_render_name(const painter_t *painter, const star_t *s,
     static const double white[4] = {1, 1, 1, 1};
     // Custom gold color for custom labels
     static const double gold[4] = {1.0, 0.84, 0.0, 1.0};
-    const bool selected = (&s->obj == core->selection);
+    const star_data_t *s = &tile->sources[idx];
+    const bool selected = tile_star_is_selected(tile, idx);
     int effects = TEXT_FLOAT;
     char buf[128];
     char hip_buf[32];
@@ -337,6 +583,7 @@ static void star_render_name(const painter_t *painter, const star_t *s,
     const char *first_name = NULL;
     const char *custom_label = NULL;
     const char *persistent_label = NULL;
+    const double vmag = tile->vmag[idx];
 
     double lim_mag = painter->hints_limit_mag - 5 + hints_mag_offset;
     double lim_mag2 = painter->hints_limit_mag - 7.5 + hints_mag_offset;
@@ -362,7 +609,8 @@ static void star_render_name(const painter_t *painter, const star_t *s,
         u8_split_line(buf, sizeof(buf), buf, 16);
         labels_add_3d(buf, frame, pos, true,
                      radius, FONT_SIZE_BASE, label_color, 0, 0,
-                     effects | TEXT_MULTILINES, -s->vmag + 10, &s->obj);
+                     effects | TEXT_MULTILINES, -vmag + 10,
+                     &tile_get_star(tile, idx)->obj);
         return;
     }
 
@@ -375,12 +623,13 @@ static void star_render_name(const painter_t *painter, const star_t *s,
         u8_split_line(buf, sizeof(buf), buf, 16);
         labels_add_3d(buf, frame, pos, true,
                      radius, FONT_SIZE_BASE, label_color, 0, 0,
-                     effects | TEXT_MULTILINES, -s->vmag + 10, &s->obj);
+                     effects | TEXT_MULTILINES, -vmag + 10,
+                     &tile_get_star(tile, idx)->obj);
         return;
     }
 
     // Decide whether a label must be displayed
-    if (!selected && s->vmag > lim_mag)
+    if (!selected && vmag > lim_mag)
         return;
 
     buf[0] = 0;
@@ -396,9 +645,9 @@ static void star_render_name(const painter_t *painter, const star_t *s,
 
     // Fallback to international common names/bayer names
     if (first_name && !buf[0]) {
-        if (selected || s->vmag < fmax(3, lim_mag2)) {
+        if (selected || vmag < fmax(3, lim_mag2)) {
             // The star is quite bright or selected, displat a name
-            if (selected || s->vmag < fmax(3, lim_mag3)) {
+            if (selected || vmag < fmax(3, lim_mag3)) {
                 // Use long version of bayer name for very bright stars
                 flags |= BAYER_LATIN_LONG | BAYER_CONST_LONG;
             }
@@ -421,7 +670,8 @@ static void star_render_name(const painter_t *painter, const star_t *s,
     u8_split_line(buf, sizeof(buf), buf, 16);
     labels_add_3d(buf, frame, pos, true,
                  radius, FONT_SIZE_BASE, label_color, 0, 0,
-                 effects | TEXT_MULTILINES, -s->vmag, &s->obj);
+                 effects | TEXT_MULTILINES, -vmag,
+                 &tile_get_star(tile, idx)->obj);
 }
 
 // Render a single star.
@@ -434,25 +684,26 @@ static int star_render(obj_t *obj, const painter_t *painter_)
     double color[3];
     painter_t painter = *painter_;
     point_t point;
+    const uint8_t *rgb = star->tile->color[star->idx];
 
     obj_get_pvo(obj, painter.obs, pvo);
     if (!painter_project(painter_, FRAME_ICRF, pvo[0], true, true, p))
         return 0;
 
-    if (!core_get_point_for_mag(star->vmag, &size, &luminance))
+    if (!core_get_point_for_mag(star_vmag(star), &size, &luminance))
         return 0;
-    bv_to_rgb(isnan(star->bv) ? 0 : star->bv, color);
+    vec3_set(color, rgb[0] / 255., rgb[1] / 255., rgb[2] / 255.);
 
     point = (point_t) {
         .pos = {p[0], p[1]},
         .size = size,
-        .color = {color[0] * 255, color[1] * 255, color[2] * 255,
-                  luminance * 255},
+        .color = {rgb[0], rgb[1], rgb[2], luminance * 255},
         .obj = &star->obj,
     };
     paint_2d_points(&painter, 1, &point);
 
-    star_render_name(&painter, star, FRAME_ICRF, pvo[0], p, size, color);
+    star_render_name(&painter, star->tile, star->idx, FRAME_ICRF, pvo[0], p,
+                     size, color);
     return 0;
 }
 
@@ -461,7 +712,7 @@ void star_get_designations(
     const obj_t *obj, void *user,
     int (*f)(const obj_t *obj, void *user, const char *cat, const char *str))
 {
-    const star_t *star = (const star_t*)obj;
+    const star_data_t *star = star_data((const star_t*)obj);
     const char *names = star->names;
     char buf[128];
 
@@ -482,22 +733,110 @@ static int del_tile(void *data)
     tile_t *tile = data;
 
     // Don't delete the tile if any contained star is used somehwere else.
-    for (i = 0; i < tile->nb; i++) {
-        if (tile->sources[i].obj.ref > 1) return CACHE_KEEP;
+    for (i = 0; tile->objs && i < tile->nb; i++) {
+        if (tile->objs[i] && tile->objs[i]->obj.ref > 1) return CACHE_KEEP;
     }
 
-    for (i = 0; i < tile->nb; i++) {
-        free(tile->sources[i].names);
-        free(tile->sources[i].sp_type);
+    for (i = 0; tile->objs && i < tile->nb; i++) {
+        if (tile->objs[i]) obj_release(&tile->objs[i]->obj);
     }
-    free(tile->sources);
-    free(tile);
+    tile_delete(tile);
     return 0;
 }
 
-static int star_data_cmp(const void *a, const void *b)
+typedef struct {
+    int     bucket;
+    float   vmag;
+    int     idx;
+} star_order_t;
+
+static int star_order_cmp(const void *a_, const void *b_)
+{
+    const star_order_t *a = a_, *b = b_;
+    if (a->bucket != b->bucket) return cmp(a->bucket, b->bucket);
+    return cmp(a->vmag, b->vmag);
+}
+
+// Size of a list of names, including the final extra '\0'.
+static int names_size(const char *names)
 {
-    return cmp(((const star_t*)a)->vmag, ((const star_t*)b)->vmag);
+    const char *p = names;
+    while (*p) p += strlen(p) + 1;
+    return p - names + 1;
+}
+
+// Copy a string into the tile strings block.
+static char *tile_add_string(tile_t *tile, int *ofs, const char *str,
+                             int size)
+{
+    char *ret;
+    if (!str) return NULL;
+    ret = tile->strings + *ofs;
+    memcpy(ret, str, size);
+    *ofs += size;
+    return ret;
+}
+
+/*
+ * Return a copy of a tile with the stars grouped by buckets and sorted by
+ * vmag inside each bucket, so that we can early exit during render.  The
+ * names are moved into the tile block.  The source tile is deleted.
+ *
+ * Parameters:
+ *   src    - The tile to sort.
+ *   order  - Healpix order of the tile.
+ */
+static tile_t *tile_sort(tile_t *src, int order_)
+{
+    int i, j, b, strings_size = 0, ofs = 0;
+    tile_t *tile;
+    star_order_t *order;
+    star_data_t *s;
+    const int nside = 1 << (order_ + TILE_BUCKETS_DEPTH);
+
+    order = malloc(src->nb * sizeof(*order));
+    for (i = 0; i < src->nb; i++) {
+        // The stars are in the tile, so the children pixels at the
+        // buckets order only differ by the last bits.
+        b = healpix_vec2pix(nside, src->pos[i]) % TILE_NB_BUCKETS;
+        order[i] = (star_order_t){b, src->vmag[i], i};
+        s = &src->sources[i];
+        if (s->names) strings_size += names_size(s->names);
+        if (s->sp_type) strings_size += strlen(s->sp_type) + 1;
+    }
+    qsort(order, src->nb, sizeof(*order), star_order_cmp);
+
+    tile = tile_create(src->nb, strings_size);
+    tile->nb = src->nb;
+    tile->mag_min = src->mag_min;
+    tile->mag_max = src->mag_max;
+    tile->illuminance = src->illuminance;
+    for (i = 0; i < src->nb; i++) {
+        j = order[i].idx;
+        vec3_copy(src->pos[j], tile->pos[i]);
+        vec3_copy(src->vel[j], tile->vel[i]);
+        tile->vmag[i] = src->vmag[j];
+        tile->lux[i] = src->lux[j];
+        memcpy(tile->color[i], src->color[j], sizeof(tile->color[i]));
+        s = &src->sources[j];
+        tile->sources[i] = *s;
+        tile->sources[i].names = tile_add_string(
+                tile, &ofs, s->names,
+                s->names ? names_size(s->names) : 0);
+        tile->sources[i].sp_type = tile_add_string(
+                tile, &ofs, s->sp_type,
+                s->sp_type ? strlen(s->sp_type) + 1 : 0);
+        free(s->names);
+        free(s->sp_type);
+    }
+    for (i = src->nb - 1; i >= 0; i--) {
+        tile->buckets[order[i].bucket].start = i;
+        tile->buckets[order[i].bucket].nb++;
+    }
+    assert(ofs == strings_size);
+    free(order);
+    tile_delete(src);
+    return tile;
 }
 
 static int on_file_tile_loaded(const char type[4],
@@ -506,16 +845,22 @@ static int on_file_tile_loaded(const char type[4],
                                void *user)
 {
     int version, nb, data_ofs = 0, row_size, flags, i, j, order, pix;
-    int children_mask;
-    double vmag, gmag, ra, de, pra, pde, plx, bv, epoch;
-    char ids[256] = {};
-    char sp_type[32] = {};
+    int children_mask, r = 0;
+    double vmag, plx, epoch;
+    char ids[257];
+    char sp_type[33];
     survey_t *survey = USER_GET(user, 0);
     tile_t **out = USER_GET(user, 1); // Receive the tile.
     int *transparency = USER_GET(user, 2);
-    tile_t *tile;
     void *table_data;
-    star_t *s;
+    tile_t *tile = NULL;
+    star_data_t *s;
+    float *fcols;
+    char *scols[3];
+    int *hips;
+    uint64_t *gaias;
+    enum {C_TYPE, C_GAIA, C_HIP, C_VMAG, C_GMAG, C_RA, C_DE, C_PLX, C_PRA,
+          C_PDE, C_EPOC, C_BV, C_IDS, C_SPEC};
 
     // All the columns we care about in the source file.
     eph_table_column_t columns[] = {
@@ -550,30 +895,47 @@ static int on_file_tile_loaded(const char type[4],
         return -1;
     }
 
-    table_data = eph_read_compressed_block(data, size, &data_ofs, &size);
+    table_data = eph_read_table_block(data, size, &data_ofs, &size,
+                                      flags, row_size, nb);
     if (!table_data) {
         LOG_E("Cannot get table data");
         return -1;
     }
-    data_ofs = 0;
-    if (flags & 1) eph_shuffle_bytes(table_data, row_size, nb);
 
-    tile = calloc(1, sizeof(*tile));
-    tile->sources = calloc(nb, sizeof(*tile->sources));
+    // Decode all the columns at once.  The float columns are stored
+    // together, from vmag to bv.
+    #define FCOL(c) (fcols + ((c) - C_VMAG) * nb)
+    fcols = malloc((C_BV - C_VMAG + 1) * nb * sizeof(*fcols));
+    hips = malloc(nb * sizeof(*hips));
+    gaias = malloc(nb * sizeof(*gaias));
+    for (i = 0; i < 3; i++) {
+        j = (int[]){C_TYPE, C_IDS, C_SPEC}[i];
+        scols[i] = malloc(nb * columns[j].size);
+        r |= eph_read_table_column(table_data, size, nb, &columns[j],
+                                   scols[i]);
+    }
+    for (i = C_VMAG; i <= C_BV; i++)
+        r |= eph_read_table_column(table_data, size, nb, &columns[i],
+                                   FCOL(i));
+    r |= eph_read_table_column(table_data, size, nb, &columns[C_HIP], hips);
+    r |= eph_read_table_column(table_data, size, nb, &columns[C_GAIA], gaias);
+    if (r) {
+        LOG_E("Cannot parse table data");
+        goto end;
+    }
+
+    tile = tile_create(nb, 0);
     tile->mag_min = DBL_MAX;
     tile->mag_max = -DBL_MAX;
 
     for (i = 0; i < nb; i++) {
         s = &tile->sources[tile->nb];
-        s->obj.ref = 1;
-        s->obj.klass = &star_klass;
-        eph_read_table_row(
-                table_data, size, &data_ofs, ARRAY_SIZE(columns), columns,
-                s->obj.type, &s->gaia, &s->hip, &vmag, &gmag,
-                &ra, &de, &plx, &pra, &pde, &epoch, &bv, ids, sp_type);
-        assert(!isnan(ra));
-        assert(!isnan(de));
-        if (isnan(vmag)) vmag = gmag;
+        vmag = FCOL(C_VMAG)[i];
+        plx = FCOL(C_PLX)[i];
+        epoch = FCOL(C_EPOC)[i];
+        assert(!isnan(FCOL(C_RA)[i]));
+        assert(!isnan(FCOL(C_DE)[i]));
+        if (isnan(vmag)) vmag = FCOL(C_GMAG)[i];
         assert(!isnan(vmag));
 
         // Ignore plx values that are too low.  This is mostly because the
@@ -583,11 +945,19 @@ static int on_file_tile_loaded(const char type[4],
         // Avoid overlapping stars from Gaia survey.
         if (survey->is_gaia && vmag < survey->min_vmag) continue;
 
-        if (!*s->obj.type) strncpy(s->obj.type, "*", 4); // Default type.
+        memcpy(s->type, scols[0] + i * columns[C_TYPE].size,
+               columns[C_TYPE].size < 4 ? columns[C_TYPE].size : 4);
+        s->gaia = gaias[i];
+        s->hip = hips[i];
+        snprintf(ids, sizeof(ids), "%.*s", columns[C_IDS].size,
+                 scols[1] + i * columns[C_IDS].size);
+        snprintf(sp_type, sizeof(sp_type), "%.*s", columns[C_SPEC].size,
+                 scols[2] + i * columns[C_SPEC].size);
+
+        if (!*s->type) strncpy(s->type, "*", 4); // Default type.
         epoch = epoch ?: 2000; // Default epoch.
-        s->vmag = vmag;
         s->plx = plx;
-        s->bv = bv;
+        s->bv = FCOL(C_BV)[i];
 
         // Turn '|' separated ids into '\0' separated values.
         if (*ids) {
@@ -602,23 +972,32 @@ static int on_file_tile_loaded(const char type[4],
         // If we didn't get any ids, but an HIP number, use it.
         if (!s->names && s->hip) {
             // Add a log this this probably means a problem in the data.
-            if (s->vmag < 4) LOG_W_ONCE("HIP %d didn't have any ids", s->hip);
+            if (vmag < 4) LOG_W_ONCE("HIP %d didn't have any ids", s->hip);
             s->names = calloc(1, 16);
             snprintf(s->names, 15, "HIP %d", s->hip);
         }
 
-        compute_pv(ra, de, pra, pde, plx, epoch, s);
-        s->illuminance = core_mag_to_illuminance(vmag);
+        compute_pv(FCOL(C_RA)[i], FCOL(C_DE)[i], FCOL(C_PRA)[i],
+                   FCOL(C_PDE)[i], plx, epoch,
+                   tile->pos[tile->nb], tile->vel[tile->nb]);
+        tile_set_mag(tile, tile->nb, vmag, s->bv);
 
-        tile->illuminance += s->illuminance;
+        tile->illuminance += tile->lux[tile->nb];
         tile->mag_min = fmin(tile->mag_min, vmag);
         tile->mag_max = fmax(tile->mag_max, vmag);
         tile->nb++;
     }
 
-    // Sort the data by vmag, so that we can early exit during render.
-    qsort(tile->sources, tile->nb, sizeof(*tile->sources), star_data_cmp);
+    #undef FCOL
+    tile = tile_sort(tile, order);
+
+end:
     free(table_data);
+    free(fcols);
+    free(hips);
+    free(gaias);
+    for (i = 0; i < 3; i++) free(scols[i]);
+    if (!tile) return -1;
 
     // If we have a json header, check for a children mask value.
     if (json) {
@@ -640,7 +1019,102 @@ static void *stars_create_tile(
     survey_t *survey = user;
     eph_load(data, size, USER_PASS(survey, &tile, transparency),
              on_file_tile_loaded);
-    if (tile) *cost = tile->nb * sizeof(*tile->sources);
+    if (tile) *cost = sizeof(*tile) + tile->buf_size;
+    return tile;
+}
+
+/*
+ * Type: snapshot_header_t
+ * Header of the tiles snapshots, followed by a copy of the tile block,
+ * where the strings pointers are replaced by offsets.
+ */
+typedef struct {
+    uint32_t    version;
+    int32_t     nb;
+    int32_t     strings_size;
+    double      mag_min;
+    double      mag_max;
+    double      illuminance;
+    int32_t     buckets[TILE_NB_BUCKETS][2]; // Start and nb.
+} snapshot_header_t;
+
+#define SNAPSHOT_HEADER_SIZE ALIGN16(sizeof(snapshot_header_t))
+
+// Convert a pointer into the tile strings block to a relocatable offset,
+// and back.  Zero is used for NULL.
+static char *string_to_ofs(const tile_t *tile, const char *str)
+{
+    return str ? (char*)(uintptr_t)(str - tile->strings + 1) : NULL;
+}
+
+static char *ofs_to_string(const tile_t *tile, const char *ofs)
+{
+    return ofs ? tile->strings + (uintptr_t)ofs - 1 : NULL;
+}
+
+static void *stars_snapshot_tile(void *user, const void *tile_, int *size)
+{
+    const tile_t *tile = tile_;
+    snapshot_header_t *header;
+    star_data_t *sources;
+    void *ret;
+    int i;
+
+    *size = SNAPSHOT_HEADER_SIZE + tile->buf_size;
+    ret = calloc(1, *size);
+    header = ret;
+    header->version = SNAPSHOT_VERSION;
+    header->nb = tile->nb;
+    header->strings_size = tile->strings_size;
+    header->mag_min = tile->mag_min;
+    header->mag_max = tile->mag_max;
+    header->illuminance = tile->illuminance;
+    for (i = 0; i < TILE_NB_BUCKETS; i++) {
+        header->buckets[i][0] = tile->buckets[i].start;
+        header->buckets[i][1] = tile->buckets[i].nb;
+    }
+    memcpy(ret + SNAPSHOT_HEADER_SIZE, tile->buf, tile->buf_size);
+    sources = ret + SNAPSHOT_HEADER_SIZE +
+              ((void*)tile->sources - tile->buf);
+    for (i = 0; i < tile->nb; i++) {
+        sources[i].names = string_to_ofs(tile, sources[i].names);
+        sources[i].sp_type = string_to_ofs(tile, sources[i].sp_type);
+    }
+    return ret;
+}
+
+static void *stars_create_tile_from_snapshot(
+        void *user, int order, int pix, const void *data, int size,
+        int *cost)
+{
+    const snapshot_header_t *header = data;
+    tile_t *tile;
+    star_data_t *s;
+    int i;
+
+    if (size < SNAPSHOT_HEADER_SIZE || header->version != SNAPSHOT_VERSION)
+        return NULL;
+    tile = tile_create(header->nb, header->strings_size);
+    if (SNAPSHOT_HEADER_SIZE + tile->buf_size != size) {
+        LOG_W("Wrong stars tile snapshot size");
+        tile_delete(tile);
+        return NULL;
+    }
+    memcpy(tile->buf, data + SNAPSHOT_HEADER_SIZE, tile->buf_size);
+    tile->nb = header->nb;
+    tile->mag_min = header->mag_min;
+    tile->mag_max = header->mag_max;
+    tile->illuminance = header->illuminance;
+    for (i = 0; i < TILE_NB_BUCKETS; i++) {
+        tile->buckets[i].start = header->buckets[i][0];
+        tile->buckets[i].nb = header->buckets[i][1];
+    }
+    for (i = 0; i < tile->nb; i++) {
+        s = &tile->sources[i];
+        s->names = ofs_to_string(tile, s->names);
+        s->sp_type = ofs_to_string(tile, s->sp_type);
+    }
+    *cost = sizeof(*tile) + tile->buf_size;
     return tile;
 }
 
@@ -694,6 +1168,27 @@ static tile_t *get_tile(survey_t *survey, int order, int pix,
     return tile;
 }
 
+/*
+ * Function: get_picked_star
+ * Create the object of a star rendered by render_visitor.
+ *
+ * Called by the areas when the user picks a star, the id packs the
+ * order, pix and index of the star in the tile.
+ */
+static obj_t *get_picked_star(void *user, uint64_t id)
+{
+    survey_t *survey = user;
+    int order = id >> 56, code;
+    int pix = (id >> 24) & 0xffffffff;
+    int idx = id & 0xffffff;
+    tile_t *tile;
+
+    if (!survey->hips) return NULL;
+    tile = hips_get_tile(survey->hips, order, pix, HIPS_CACHED_ONLY, &code);
+    if (!tile || idx >= tile->nb) return NULL;
+    return obj_retain(&tile_get_star(tile, idx)->obj);
+}
+
 static int render_visitor(stars_t *stars, survey_t *survey,
                           int order, int pix,
                           const painter_t *painter_,
@@ -702,13 +1197,16 @@ static int render_visitor(stars_t *stars, survey_t *survey,
 {
     painter_t painter = *painter_;
     tile_t *tile;
-    int i, n = 0, code;
-    star_t *s;
-    double p_win[4], size = 0, luminance = 0, vmag = -DBL_MAX;
+    int i, j, b, n = 0, nb, nb_tot_stars = 0, code;
+    int nbs[TILE_NB_BUCKETS];
+    const uint8_t *rgb;
+    double size, luminance;
     double color[3];
-    double v[3];
+    const double (*astrom)[3];
+    double (*win)[2];
     double limit_mag = fmin(painter.stars_limit_mag, painter.hard_limit_mag);
-    bool selected;
+    bool selected, cull_buckets, *visible;
+    point_t *points;
 
     // Early exit if the tile is clipped.
     if (painter_is_healpix_clipped(&painter, FRAME_ASTROM, order, pix))
@@ -722,44 +1220,70 @@ static int render_visitor(stars_t *stars, survey_t *survey,
     if (!tile) goto end;
     if (tile->mag_min > limit_mag) goto end;
 
-    point_t *points = malloc(tile->nb * sizeof(*points));
-    for (i = 0; i < tile->nb; i++) {
-        s = &tile->sources[i];
-        if (s->vmag > limit_mag) break;
-
-        star_get_astrom(s, painter.obs, v);
-        if (!painter_project(&painter, FRAME_ASTROM, v, true, true, p_win))
+    // Number of stars brighter than the limit mag in each bucket.
+    for (b = 0; b < TILE_NB_BUCKETS; b++) {
+        for (nb = 0; nb < tile->buckets[b].nb &&
+             tile->vmag[tile->buckets[b].start + nb] <= limit_mag; nb++) {}
+        nbs[b] = nb;
+        nb_tot_stars += nb;
+    }
+    // At deep zoom most of the tile can be out of the screen, so it's
+    // worth testing the buckets before projecting their stars.
+    cull_buckets = nb_tot_stars >= BUCKETS_CULL_MIN_STARS;
+    points = painter_alloc(&painter, nb_tot_stars * sizeof(*points));
+
+    for (b = 0; b < TILE_NB_BUCKETS; b++) {
+        nb = nbs[b];
+        if (!nb) continue;
+        if (cull_buckets && painter_is_healpix_clipped(
+                    &painter, FRAME_ASTROM, order + TILE_BUCKETS_DEPTH,
+                    pix * TILE_NB_BUCKETS + b))
             continue;
 
-        (*illuminance) += s->illuminance;
-
-        // No need to recompute the point size and luminance if the last
-        // star had the same vmag (often the case since we sort by vmag).
-        if (s->vmag != vmag) {
-            vmag = s->vmag;
-            core_get_point_for_mag(vmag, &size, &luminance);
+        // Project all the stars of the bucket at once.
+        astrom = tile_get_astrom(tile, painter.obs, b, nb);
+        win = painter_alloc(&painter, nb * sizeof(*win));
+        visible = painter_alloc(&painter, nb * sizeof(*visible));
+        painter_project_n(&painter, FRAME_ASTROM, nb, astrom, true,
+                          win, visible);
+
+        for (j = 0; j < nb; j++) {
+            if (!visible[j]) continue;
+            i = tile->buckets[b].start + j;
+
+            (*illuminance) += tile->lux[i];
+
+            core_get_point_for_mag_fast(tile->vmag[i], &size, &luminance);
+            if (size == 0.0 || luminance == 0.0)
+                continue;
+
+            rgb = tile->color[i];
+            points[n] = (point_t) {
+                .pos = {win[j][0], win[j][1]},
+                .size = size,
+                .color = {rgb[0], rgb[1], rgb[2], luminance * 255},
+            };
+            // This makes very faint stars not selectable.  The objects are
+            // only created if the stars actually get picked.
+            if (luminance > 0.5 && size > 1) {
+                points[n].get_obj = get_picked_star;
+                points[n].obj_user = survey;
+                points[n].obj_id = (uint64_t)order << 56 |
+                                   (uint64_t)pix << 24 | i;
+            }
+            n++;
+            selected = tile_star_is_selected(tile, i);
+            if (selected || (stars->hints_visible && !survey->is_gaia)) {
+                vec3_set(color, rgb[0] / 255., rgb[1] / 255.,
+                         rgb[2] / 255.);
+                star_render_name(&painter, tile, i, FRAME_ASTROM,
+                                 astrom[j], win[j], size, color);
+            }
         }
-        if (size == 0.0 || luminance == 0.0)
-            continue;
-
-        bv_to_rgb(isnan(s->bv) ? 0 : s->bv, color);
-        points[n] = (point_t) {
-            .pos = {p_win[0], p_win[1]},
-            .size = size,
-            .color = {color[0] * 255, color[1] * 255, color[2] * 255,
-                      luminance * 255},
-            // This makes very faint stars not selectable
-            .obj = (luminance > 0.5 && size > 1) ? &s->obj : NULL,
-        };
-        n++;
-        selected = (&s->obj == core->selection);
-        if (selected || (stars->hints_visible && !survey->is_gaia))
-            star_render_name(&painter, s, FRAME_ASTROM, v, p_win, size, color);
     }
     if (n > 0) {
         paint_2d_points(&painter, n, points);
     }
-    free(points);
 
 end:
     // Test if we should go into higher order tiles.
@@ -772,7 +1296,7 @@ end:
 static int stars_render(obj_t *obj, const painter_t *painter_)
 {
     stars_t *stars = (stars_t*)obj;
-    int nb_tot = 0, nb_loaded = 0, order, pix, r;
+    int nb_tot = 0, nb_loaded = 0, order, pix, r, max_order;
     double illuminance = 0; // Totall illuminance
     painter_t painter = *painter_;
     survey_t *survey;
@@ -786,11 +1310,18 @@ static int stars_render(obj_t *obj, const painter_t *painter_)
         if (survey->min_vmag > painter.stars_limit_mag)
             continue;
         hips_iter_init(&iter);
+        iter.is_render = true;
+        hips_iter_set_view_priority(&iter, FRAME_ASTROM);
+        hips_iter_set_budget(&iter, RENDER_MAX_TILES, 0);
+        max_order = 0;
         while (hips_iter_next(&iter, &order, &pix)) {
+            max_order = fmax(max_order, order);
             r = render_visitor(stars, survey, order, pix, &painter,
                                &nb_tot, &nb_loaded, &illuminance);
             if (r == 1) hips_iter_push_children(&iter, order, pix);
         }
+        hips_iter_release(&iter);
+        hips_prefetch(survey->hips, max_order);
     }
 
     /* Get the global stars luminance */
@@ -835,13 +1366,14 @@ static int stars_list(const obj_t *obj,
             tile = get_tile(survey, order, pix, false, &code);
             if (!tile || tile->mag_min >= max_mag) continue;
             for (i = 0; i < tile->nb; i++) {
-                if (tile->sources[i].vmag > max_mag) continue;
-                r = f(user, &tile->sources[i].obj);
+                if (tile->vmag[i] > max_mag) continue;
+                r = f(user, &tile_get_star(tile, i)->obj);
                 if (r) break;
             }
             if (i < tile->nb) break;
             hips_iter_push_children(&iter, order, pix);
         }
+        hips_iter_release(&iter);
         return 0;
     }
 
@@ -853,7 +1385,7 @@ static int stars_list(const obj_t *obj,
         return -1;
     }
     for (i = 0; i < tile->nb; i++) {
-        r = f(user, &tile->sources[i].obj);
+        r = f(user, &tile_get_star(tile, i)->obj);
         if (r) break;
     }
     return 0;
@@ -913,6 +1445,8 @@ static int stars_add_data_source(obj_t *obj, const char *url, const char *key)
     hips_settings_t survey_settings = {
         .create_tile = stars_create_tile,
         .delete_tile = del_tile,
+        .snapshot_tile = stars_snapshot_tile,
+        .create_tile_from_snapshot = stars_create_tile_from_snapshot,
     };
     int i, code;
     double release_date = 0;
@@ -994,7 +1528,7 @@ obj_t *obj_get_by_hip(int hip, int *code)
             if (!tile) continue;
             for (i = 0; i < tile->nb; i++) {
                 if (tile->sources[i].hip == hip) {
-                    return obj_retain(&tile->sources[i].obj);
+                    return obj_retain(&tile_get_star(tile, i)->obj);
                 }
             }
         }
@@ -1011,6 +1545,7 @@ static obj_klass_t star_klass = {
     .id         = "star",
     .init       = star_init,
     .size       = sizeof(star_t),
+    .del        = star_del,
     .get_info   = star_get_info,
     .get_json_data = star_get_json_data,
     .render     = star_render,
@@ -1064,4 +1599,85 @@ static void test_create_from_json(void)
 }
 TEST_REGISTER(NULL, test_create_from_json, TEST_AUTO);
 
+static void test_astrom_cache(void)
+{
+    star_t *star;
+    double utc, v[3];
+    const double (*dirs)[3];
+    observer_t *obs = core->observer;
+    // Barnard's star, one of the fastest proper motion.
+    const char *data =
+        "{\"model_data\": {\"Vmag\": 9.5, \"ra\": 269.452,"
+        " \"de\": 4.6934, \"plx\": 548.31, \"pm_ra\": -801.551,"
+        " \"pm_de\": 10362.394}}";
+
+    star = (star_t*)obj_create_str("star", data);
+    assert(star);
+    for (utc = 58000; utc < 58002; utc += 0.1) {
+        obj_set_attr((obj_t*)obs, "utc", utc);
+        observer_update(obs, false);
+        dirs = tile_get_astrom(star->tile, obs, 0, 1);
+        star_get_astrom(star->tile->pos[0], star->tile->vel[0], obs, v);
+        assert(vec3_sep(dirs[0], v) <= ASTROM_CACHE_PRECISION);
+    }
+    // The cache has been recomputed at least once.
+    assert(star->tile->astrom.tt > 58000);
+    obj_release(&star->obj);
+}
+TEST_REGISTER(NULL, test_astrom_cache, TEST_AUTO);
+
+static void test_snapshot(void)
+{
+    tile_t *tile, *tile2;
+    void *snapshot, *copy;
+    int i, b, size, cost;
+    const double vmags[3] = {6, 2, 4};
+
+    tile = tile_create(3, 0);
+    tile->nb = 3;
+    for (i = 0; i < 3; i++) {
+        tile_set_mag(tile, i, vmags[i], 0.5);
+        vec3_set(tile->pos[i], 1, 2, 3 + i * 0.001);
+        tile->sources[i].hip = i + 1;
+    }
+    tile->sources[0].names = calloc(1, 16);
+    memcpy(tile->sources[0].names, "A\0B", 3);
+    tile->sources[1].sp_type = strdup("G2V");
+    // All the stars in the same bucket.
+    tile = tile_sort(tile, 0);
+    b = healpix_vec2pix(4, tile->pos[0]) % 16;
+    assert(tile->buckets[b].start == 0 && tile->buckets[b].nb == 3);
+    assert(tile->sources[0].hip == 2 && tile->sources[2].hip == 1);
+
+    snapshot = stars_snapshot_tile(NULL, tile, &size);
+    // Make sure we don't depend on the snapshot address.
+    copy = malloc(size);
+    memcpy(copy, snapshot, size);
+    free(snapshot);
+    tile2 = stars_create_tile_from_snapshot(NULL, 0, 0, copy, size, &cost);
+    free(copy);
+    assert(tile2 && tile2->nb == 3);
+    assert(cost == sizeof(*tile) + tile->buf_size);
+    assert(memcmp(tile2->buckets, tile->buckets, sizeof(tile->buckets)) == 0);
+    for (i = 0; i < 3; i++) {
+        assert(tile2->vmag[i] == tile->vmag[i]);
+        assert(tile2->pos[i][2] == tile->pos[i][2]);
+        assert(tile2->sources[i].hip == tile->sources[i].hip);
+    }
+    assert(strcmp(tile2->sources[2].names, "A") == 0);
+    assert(strcmp(tile2->sources[2].names + 2, "B") == 0);
+    assert(strcmp(tile2->sources[0].sp_type, "G2V") == 0);
+    assert(!tile2->sources[1].names && !tile2->sources[1].sp_type);
+
+    // Wrong version.
+    snapshot = stars_snapshot_tile(NULL, tile, &size);
+    ((snapshot_header_t*)snapshot)->version++;
+    assert(!stars_create_tile_from_snapshot(NULL, 0, 0, snapshot, size,
+                                            &cost));
+    free(snapshot);
+    del_tile(tile);
+    del_tile(tile2);
+}
+TEST_REGISTER(NULL, test_snapshot, TEST_AUTO);
+
 #endif
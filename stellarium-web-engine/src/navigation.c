@@ -175,6 +175,51 @@ void core_update_fov(double dt)
         module_changed((obj_t*)core, "fov");
 }
 
+void core_update_view_motion(double dt)
+{
+    typeof(core->view_motion) *m = &core->view_motion;
+    const observer_t *obs = core->observer;
+    double k;
+
+    if (m->fov) {
+        // Exponential smoothing of the speeds over about 0.1 sec, so that
+        // a single irregular frame doesn't change the prediction too much.
+        k = 1.0 - exp(-dt / 0.1);
+        m->yaw_speed = mix(m->yaw_speed, eraAnpm(obs->yaw - m->yaw) / dt, k);
+        m->pitch_speed = mix(m->pitch_speed, (obs->pitch - m->pitch) / dt, k);
+        m->fov_speed = mix(m->fov_speed, log(core->fov / m->fov) / dt, k);
+    }
+    m->yaw = obs->yaw;
+    m->pitch = obs->pitch;
+    m->fov = core->fov;
+}
+
+void core_predict_view(double t, double *yaw, double *pitch, double *fov)
+{
+    const typeof(core->target) *target = &core->target;
+    const typeof(core->fov_animation) *fov_anim = &core->fov_animation;
+    const typeof(core->view_motion) *m = &core->view_motion;
+    double v[4] = {1, 0, 0, 0}, q[4], k;
+
+    if (target->src_time && (!target->lock || target->move_to_lock)) {
+        k = smoothstep(target->src_time, target->dst_time, core->clock + t);
+        quat_slerp(target->src_q, target->dst_q, k, q);
+        quat_mul_vec3(q, v, v);
+        vec3_to_sphe(v, yaw, pitch);
+    } else {
+        *yaw = core->observer->yaw + m->yaw_speed * t;
+        *pitch = clamp(core->observer->pitch + m->pitch_speed * t,
+                       -M_PI / 2, M_PI / 2);
+    }
+
+    if (fov_anim->src_time && fov_anim->dst_fov) {
+        k = smoothstep(fov_anim->src_time, fov_anim->dst_time, core->clock + t);
+        *fov = mix(fov_anim->src_fov, fov_anim->dst_fov, k);
+    } else {
+        *fov = core->fov * exp(m->fov_speed * t);
+    }
+    *fov = clamp(*fov, CORE_MIN_FOV, 2 * M_PI);
+}
 
 // Weak so that we can easily replace the navigation algorithm.
 __attribute__((weak))
@@ -185,3 +230,43 @@ void core_update_observer(double dt)
     core_update_direction(dt);
     core_update_mount(dt);
 }
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_predict_view(void)
+{
+    double yaw, pitch, fov, dt = 1 / 60.;
+    double saved_yaw, saved_pitch, saved_fov;
+    int i;
+
+    core_init(100, 100, 1.0);
+    saved_yaw = core->observer->yaw;
+    saved_pitch = core->observer->pitch;
+    saved_fov = core->fov;
+    memset(&core->view_motion, 0, sizeof(core->view_motion));
+    core->observer->yaw = 0;
+    core->observer->pitch = 0;
+    core->fov = 1.0;
+
+    // Constant pan and zoom.
+    for (i = 0; i < 60; i++) {
+        core->observer->yaw += 0.5 * dt;
+        core->fov *= exp(-1 * dt);
+        core_update_view_motion(dt);
+    }
+    core_predict_view(0.2, &yaw, &pitch, &fov);
+    assert(fabs(yaw - (core->observer->yaw + 0.1)) < 0.001);
+    assert(fabs(pitch) < 0.001);
+    assert(fabs(fov - core->fov * exp(-0.2)) < 0.001);
+
+    core->observer->yaw = saved_yaw;
+    core->observer->pitch = saved_pitch;
+    core->fov = saved_fov;
+    memset(&core->view_motion, 0, sizeof(core->view_motion));
+}
+
+TEST_REGISTER(NULL, test_predict_view, TEST_AUTO);
+
+#endif
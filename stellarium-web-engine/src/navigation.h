@@ -22,3 +22,26 @@
  * Should be called at each frame.
  */
 void core_update_observer(double dt);
+
+/*
+ * Function: core_update_view_motion
+ * Update the estimation of the view speed and zoom rate.
+ *
+ * Should be called at each frame, after the observer has been updated.
+ */
+void core_update_view_motion(double dt);
+
+/*
+ * Function: core_predict_view
+ * Predict the view direction and fov in a given amount of time.
+ *
+ * If there is an animation running we use its target, otherwise we
+ * extrapolate the current view motion.
+ *
+ * Parameters:
+ *   t      - Time in the future (sec).
+ *   yaw    - Get the predicted yaw of the view, in the mount frame.
+ *   pitch  - Get the predicted pitch of the view, in the mount frame.
+ *   fov    - Get the predicted fov.
+ */
+void core_predict_view(double t, double *yaw, double *pitch, double *fov);
@@ -8,6 +8,7 @@
  */
 
 #include "swe.h"
+#include "replay.h"
 #include <inttypes.h>
 
 // Global list of all the registered klasses.
@@ -535,6 +536,9 @@ char *obj_call_json_str(obj_t *obj, const char *attr, const char *args)
     int size;
 
     jargs = args ? json_parse(args, strlen(args)) : NULL;
+    if (jargs && replay_is_recording()) {
+        replay_on_set_attr(obj, obj_get_attr_(obj, attr), jargs);
+    }
     jret = obj_call_json(obj, attr, jargs);
     if (!jret) return NULL;
     size = json_measure(jret);
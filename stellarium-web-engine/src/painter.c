@@ -148,6 +148,11 @@ int paint_finish(const painter_t *painter)
     return 0;
 }
 
+void *painter_alloc(const painter_t *painter, size_t size)
+{
+    return arena_alloc(render_get_arena(painter->rend), size);
+}
+
 /*
  * Set the current painter texture.
  *
@@ -171,12 +176,14 @@ void painter_set_texture(painter_t *painter, int slot, texture_t *tex,
 
 int paint_2d_points(const painter_t *painter, int n, const point_t *points)
 {
+    profiler_count(PROFILE_POINTS, n);
     render_points_2d(painter->rend, painter, n, points);
     return 0;
 }
 
 int paint_3d_points(const painter_t *painter, int n, const point_3d_t *points)
 {
+    profiler_count(PROFILE_POINTS, n);
     render_points_3d(painter->rend, painter, n, points);
     return 0;
 }
@@ -324,11 +331,10 @@ int paint_line(const painter_t *painter,
 
     size = line_tesselate(line_func, painter->proj,
                           USER_PASS(painter, &frame, line, map),
-                          split, &pos_line, &win_line);
+                          split, render_get_arena(painter->rend),
+                          &pos_line, &win_line);
     if (size < 0) goto split;
     render_line(painter->rend, painter, pos_line, win_line, size);
-    free(win_line);
-    free(pos_line);
     return 0;
 
 split:
@@ -350,16 +356,14 @@ int paint_linestring(const painter_t *painter, int frame,
     double (*win_line)[3];
     double (*pos_line)[3];
     int i;
-    win_line = calloc(size, sizeof(*win_line));
-    pos_line = calloc(size, sizeof(*pos_line));
+    win_line = painter_alloc(painter, size * sizeof(*win_line));
+    pos_line = painter_alloc(painter, size * sizeof(*pos_line));
     for (i = 0; i < size; i++) {
         convert_frame(painter->obs, frame, FRAME_VIEW, true,
                       points[i], pos_line[i]);
         project_to_win(painter->proj, pos_line[i], win_line[i]);
     }
     render_line(painter->rend, painter, pos_line, win_line, size);
-    free(win_line);
-    free(pos_line);
     return 0;
 }
 
@@ -966,6 +970,29 @@ bool painter_project(const painter_t *painter, int frame,
     return is_visible_win(v, painter->proj->window_size);
 }
 
+int painter_project_n(const painter_t *painter, int frame, int n,
+                      const double (*pos)[3], bool at_inf,
+                      double (*win_pos)[2], bool *visible)
+{
+    int i, nb = 0;
+    double (*v)[3];
+
+    if (n <= 0) return 0;
+    for (i = 0; i < n; i++)
+        visible[i] = !painter_is_point_clipped_fast(painter, frame, pos[i],
+                                                    at_inf);
+    v = painter_alloc(painter, n * sizeof(*v));
+    convert_frame_to_view_n(painter->obs, frame, at_inf, n, pos, v, visible);
+    project_to_win_n(painter->proj, n, (const double (*)[3])v, v);
+    for (i = 0; i < n; i++) {
+        if (!visible[i]) continue;
+        vec2_copy(v[i], win_pos[i]);
+        visible[i] = is_visible_win(v[i], painter->proj->window_size);
+        nb += visible[i];
+    }
+    return nb;
+}
+
 bool painter_unproject(const painter_t *painter, int frame,
                      const double win_pos[2], double pos[3]) {
     double p[4] = {win_pos[0], win_pos[1], 0};
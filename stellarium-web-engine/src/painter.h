@@ -75,6 +75,11 @@ struct point
     double  size;       // Radius in window pixel (pixel with density scale).
     uint8_t color[4];
     const obj_t *obj;
+    // Alternative to obj, to only create the object if the point gets
+    // picked.  See <areas_add_circle_deferred>.
+    obj_t   *(*get_obj)(void *user, uint64_t id);
+    void    *obj_user;
+    uint64_t obj_id;
 };
 
 struct point_3d
@@ -192,6 +197,16 @@ int paint_prepare(painter_t *painter, double win_w, double win_h,
                   double scale);
 int paint_finish(const painter_t *painter);
 
+/*
+ * Function: painter_alloc
+ * Allocate transient memory valid until the end of the frame.
+ *
+ * Use this for the scratch buffers of the render functions.  The memory
+ * comes from the renderer frame arena and is released all at once in
+ * paint_finish, so never free it.
+ */
+void *painter_alloc(const painter_t *painter, size_t size);
+
 /*
  * Set the current painter texture.
  *
@@ -614,6 +629,33 @@ void painter_project_ellipse(const painter_t *painter, int frame,
 bool painter_project(const painter_t *painter, int frame, const double pos[3],
                      bool at_inf, bool clip_first, double win_pos[2]);
 
+/*
+ * Function: painter_project_n
+ * Project an array of points to the screen.
+ *
+ * This is the same as calling painter_project with clip_first set for each
+ * point, but faster for large arrays, since the frame conversion and the
+ * projection are done in batches.
+ *
+ * Parameters:
+ *   painter    - The painter.
+ *   frame      - The frame in which the points are defined.
+ *   n          - Number of points.
+ *   pos        - The points 3D coordinates.
+ *   at_inf     - true for fixed objects (far away from the solar system).
+ *                For such objects, pos is assumed to be normalized.
+ *   win_pos    - The points positions in screen coordinates (px).
+ *   visible    - Get, for each point, the value painter_project would
+ *                return.  The positions of the points not visible are
+ *                undefined.
+ *
+ * Returns:
+ *   The number of visible points.
+ */
+int painter_project_n(const painter_t *painter, int frame, int n,
+                      const double (*pos)[3], bool at_inf,
+                      double (*win_pos)[2], bool *visible);
+
 
 /*
  * Function: painter_unproject
@@ -73,6 +73,65 @@ bool project_to_win(const projection_t *proj, const double input[3],
     return true;
 }
 
+// Apply the projection matrix and viewport transformation, same as the
+// end of project_to_win.
+static inline void clip_to_win(const projection_t *proj, const double p[3],
+                               double out[3])
+{
+    const double (*m)[4] = proj->mat;
+    double x, y, z, w;
+    x = m[0][0] * p[0] + m[1][0] * p[1] + m[2][0] * p[2] + m[3][0];
+    y = m[0][1] * p[0] + m[1][1] * p[1] + m[2][1] * p[2] + m[3][1];
+    z = m[0][2] * p[0] + m[1][2] * p[1] + m[2][2] * p[2] + m[3][2];
+    w = m[0][3] * p[0] + m[1][3] * p[1] + m[2][3] * p[2] + m[3][3];
+    if (!w) {
+        out[0] = out[1] = out[2] = NAN;
+        return;
+    }
+    w = 1.0 / w;
+    out[0] = (+x * w + 1) / 2 * proj->window_size[0];
+    out[1] = (-y * w + 1) / 2 * proj->window_size[1];
+    out[2] = (z * w + 1) / 2;
+}
+
+void project_to_win_n(const projection_t *proj, int n,
+                      const double (*in)[3], double (*out)[3])
+{
+    int i;
+    double p[3], d, k;
+
+    switch (proj->klass->id) {
+    case PROJ_PERSPECTIVE:
+        for (i = 0; i < n; i++)
+            clip_to_win(proj, in[i], out[i]);
+        return;
+
+    // Inlined version of proj_stereographic_project.
+    case PROJ_STEREOGRAPHIC:
+        for (i = 0; i < n; i++) {
+            d = vec3_norm(in[i]);
+            vec3_mul(1. / d, in[i], p);
+            if (p[2] == 1.0) { // Discontinuity.
+                vec3_set(p, 0, 0, 0);
+            } else {
+                k = 1.0 / (0.5 * (1.0 - p[2]));
+                p[0] *= k;
+                p[1] *= k;
+                p[2] = -1;
+                vec3_mul(d, p, p);
+            }
+            clip_to_win(proj, p, out[i]);
+        }
+        return;
+
+    default:
+        for (i = 0; i < n; i++) {
+            if (!project_to_win(proj, in[i], out[i]))
+                vec3_set(out[i], NAN, NAN, NAN);
+        }
+    }
+}
+
 bool project_to_win_xy(const projection_t *proj, const double input[3],
                        double out[2])
 {
@@ -135,6 +135,25 @@ void projection_init(projection_t *proj, int type, double fovy,
 bool project_to_win(const projection_t *proj, const double input[S 3],
                     double out[S 3]);
 
+/*
+ * Function: project_to_win_n
+ * Project an array of points from view coordinates to windows coordinates.
+ *
+ * Same as calling project_to_win on each point, but with a specialized
+ * loop for the perspective and stereographic projections, without
+ * function pointer calls.  The points that cannot be projected are set to
+ * NAN.
+ *
+ * Parameters:
+ *   proj   - A projection.
+ *   n      - Number of points.
+ *   in     - Input points in view coordinates.
+ *   out    - Output points in windows coordinates.  Can be the same as the
+ *            input.
+ */
+void project_to_win_n(const projection_t *proj, int n,
+                      const double (*in)[3], double (*out)[3]);
+
 /*
  * Function: project_to_win_xy
  * Similar to project_to_win, but only returns the x and y coordinates.
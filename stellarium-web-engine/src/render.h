@@ -15,6 +15,7 @@
 #include "json.h"
 
 
+typedef struct arena arena_t;
 typedef struct renderer renderer_t;
 typedef struct painter painter_t;
 typedef struct point point_t;
@@ -35,6 +36,12 @@ void render_prepare(renderer_t *rend,
 
 void render_finish(renderer_t *rend);
 
+/*
+ * Function: render_get_arena
+ * Return the renderer frame allocator, reset at each render_finish.
+ */
+arena_t *render_get_arena(renderer_t *rend);
+
 void render_points_2d(renderer_t *rend, const painter_t *painter,
                       int n, const point_t *points);
 
@@ -7,6 +7,8 @@
  * repository.
  */
 
+#ifndef NO_GL
+
 #include "render.h"
 #include "swe.h"
 
@@ -291,6 +293,7 @@ struct renderer {
 
     item_t  *items;
     cache_t *grid_cache;
+    arena_t arena;  // Frame allocator for the items and their buffers.
 
 };
 
@@ -414,6 +417,16 @@ static item_t *get_item(renderer_t *rend, int type,
     return NULL;
 }
 
+// Allocate an item buffer data in the frame arena.
+static void item_buf_alloc(renderer_t *rend, gl_buf_t *buf,
+                           const gl_buf_info_t *info, int capacity)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->info = info;
+    buf->data = arena_alloc(&rend->arena, capacity * info->size);
+    buf->capacity = capacity;
+}
+
 void render_points_2d(renderer_t *rend, const painter_t *painter,
                       int n, const point_t *points)
 {
@@ -434,10 +447,10 @@ void render_points_2d(renderer_t *rend, const painter_t *painter,
         item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_POINTS;
         item->flags = painter->flags;
-        gl_buf_alloc(&item->buf, &POINTS_BUF, MAX_POINTS);
+        item_buf_alloc(rend, &item->buf, &POINTS_BUF, MAX_POINTS);
         vec4_to_float(painter->color, item->color);
         item->points.halo = painter->points_halo;
         DL_APPEND(rend->items, item);
@@ -454,10 +467,15 @@ void render_points_2d(renderer_t *rend, const painter_t *painter,
 
         // Add the point int the global list of rendered points.
         // XXX: could be done in the painter.
-        if (p.obj) {
+        if (p.obj || p.get_obj) {
             p.pos[0] = (+p.pos[0] + 1) / 2 * core->win_size[0];
             p.pos[1] = (-p.pos[1] + 1) / 2 * core->win_size[1];
-            areas_add_circle(core->areas, p.pos, p.size, p.obj);
+            if (p.get_obj) {
+                areas_add_circle_deferred(core->areas, p.pos, p.size,
+                                          p.get_obj, p.obj_user, p.obj_id);
+            } else {
+                areas_add_circle(core->areas, p.pos, p.size, p.obj);
+            }
         }
     }
 }
@@ -483,10 +501,10 @@ void render_points_3d(renderer_t *rend, const painter_t *painter,
         item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_POINTS_3D;
         item->flags = painter->flags;
-        gl_buf_alloc(&item->buf, &POINTS_3D_BUF, MAX_POINTS);
+        item_buf_alloc(rend, &item->buf, &POINTS_3D_BUF, MAX_POINTS);
         vec4_to_float(painter->color, item->color);
         item->points.halo = painter->points_halo;
         DL_APPEND(rend->items, item);
@@ -514,11 +532,11 @@ void render_points_3d(renderer_t *rend, const painter_t *painter,
 
 /*
  * Function: get_grid
- * Compute an uv_map grid, and cache it if possible.
+ * Compute an uv_map grid, and cache it if possible.  If we cannot cache it
+ * the grid is allocated in the frame arena.
  */
 static const double (*get_grid(renderer_t *rend,
-                               const uv_map_t *map, int split,
-                               bool *should_delete))[4]
+                               const uv_map_t *map, int split))[4]
 {
     int n = split + 1;
     double (*grid)[4];
@@ -531,7 +549,6 @@ static const double (*get_grid(renderer_t *rend,
     _Static_assert(sizeof(key) == 16, "");
     bool can_cache = map->type == UV_MAP_HEALPIX && map->at_infinity;
 
-    *should_delete = !can_cache;
     if (can_cache) {
         if (!rend->grid_cache)
             rend->grid_cache = cache_create(GRID_CACHE_SIZE, 1);
@@ -540,7 +557,10 @@ static const double (*get_grid(renderer_t *rend,
             return grid;
     }
 
-    grid = malloc(n * n * sizeof(*grid));
+    if (can_cache)
+        grid = malloc(n * n * sizeof(*grid));
+    else
+        grid = arena_alloc(&rend->arena, n * n * sizeof(*grid));
     uv_map_grid(map, split, grid, NULL);
 
     if (can_cache) {
@@ -590,10 +610,10 @@ static void quad_planet(
     n = grid_size + 1;
 
     assert(painter->flags & PAINTER_ENABLE_DEPTH);
-    item = calloc(1, sizeof(*item));
+    item = arena_calloc(&rend->arena, 1, sizeof(*item));
     item->type = ITEM_PLANET;
-    gl_buf_alloc(&item->buf, &PLANET_BUF, n * n * 4);
-    gl_buf_alloc(&item->indices, &INDICES_BUF, n * n * 6);
+    item_buf_alloc(rend, &item->buf, &PLANET_BUF, n * n * 4);
+    item_buf_alloc(rend, &item->indices, &INDICES_BUF, n * n * 6);
     vec4_to_float(painter->color, item->color);
     item->flags = painter->flags;
     item->planet.shadow_color_tex = painter->planet.shadow_color_tex;
@@ -694,7 +714,6 @@ void render_quad(renderer_t *rend, const painter_t *painter,
     double p[4], tex_pos[2], ndc_p[4];
     float lum;
     const double (*grid)[4] = NULL;
-    bool should_delete_grid;
     texture_t *tex = painter->textures[PAINTER_TEX_COLOR].tex;
 
     // Special case for planet shader.
@@ -712,27 +731,27 @@ void render_quad(renderer_t *rend, const painter_t *painter,
                 memcmp(item->atm.sun, painter->atm.sun, sizeof(item->atm.sun))))
             item = NULL;
         if (!item) {
-            item = calloc(1, sizeof(*item));
+            item = arena_calloc(&rend->arena, 1, sizeof(*item));
             item->type = ITEM_ATMOSPHERE;
-            gl_buf_alloc(&item->buf, &ATMOSPHERE_BUF, 256);
-            gl_buf_alloc(&item->indices, &INDICES_BUF, 256 * 6);
+            item_buf_alloc(rend, &item->buf, &ATMOSPHERE_BUF, 256);
+            item_buf_alloc(rend, &item->indices, &INDICES_BUF, 256 * 6);
             memcpy(item->atm.p, painter->atm.p, sizeof(item->atm.p));
             memcpy(item->atm.sun, painter->atm.sun, sizeof(item->atm.sun));
         }
     } else if (painter->flags & PAINTER_FOG_SHADER) {
         item = get_item(rend, ITEM_FOG, n * n, grid_size * grid_size * 6, tex);
         if (!item) {
-            item = calloc(1, sizeof(*item));
+            item = arena_calloc(&rend->arena, 1, sizeof(*item));
             item->type = ITEM_FOG;
             vec4_copy(painter->color, item->color);
-            gl_buf_alloc(&item->buf, &FOG_BUF, 256);
-            gl_buf_alloc(&item->indices, &INDICES_BUF, 256 * 6);
+            item_buf_alloc(rend, &item->buf, &FOG_BUF, 256);
+            item_buf_alloc(rend, &item->indices, &INDICES_BUF, 256 * 6);
         }
     } else {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_TEXTURE;
-        gl_buf_alloc(&item->buf, &TEXTURE_BUF, n * n);
-        gl_buf_alloc(&item->indices, &INDICES_BUF, n * n * 6);
+        item_buf_alloc(rend, &item->buf, &TEXTURE_BUF, n * n);
+        item_buf_alloc(rend, &item->indices, &INDICES_BUF, n * n * 6);
     }
 
     ofs = item->buf.nb;
@@ -741,7 +760,7 @@ void render_quad(renderer_t *rend, const painter_t *painter,
     vec4_to_float(painter->color, item->color);
     item->flags = painter->flags;
 
-    grid = get_grid(rend, map, grid_size, &should_delete_grid);
+    grid = get_grid(rend, map, grid_size);
     for (i = 0; i < n; i++)
     for (j = 0; j < n; j++) {
         vec3_set(p, (double)j / grid_size, (double)i / grid_size, 1.0);
@@ -766,7 +785,6 @@ void render_quad(renderer_t *rend, const painter_t *painter,
         }
         gl_buf_next(&item->buf);
     }
-    if (should_delete_grid) free((void*)grid);
 
     // Set the index buffer.
     for (i = 0; i < grid_size; i++)
@@ -797,11 +815,11 @@ static void texture_2d(renderer_t *rend, texture_t *tex,
     if (item && memcmp(item->color, color, sizeof(color))) item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_TEXTURE_2D;
         item->flags = flags;
-        gl_buf_alloc(&item->buf, &TEXTURE_2D_BUF, 64 * 4);
-        gl_buf_alloc(&item->indices, &INDICES_BUF, 64 * 6);
+        item_buf_alloc(rend, &item->buf, &TEXTURE_2D_BUF, 64 * 4);
+        item_buf_alloc(rend, &item->indices, &INDICES_BUF, 64 * 6);
         item->tex = tex;
         item->tex->ref++;
         memcpy(item->color, color, sizeof(color));
@@ -928,9 +946,10 @@ static void text_using_texture(renderer_t *rend,
         img = (void*)sys_render_text(text, size * scale, effects, align, &w, &h,
                                      &xoff, &yoff);
         // Shadow effect, into a texture with one pixel extra border.
+        // The texture upload copies the image, so it can be transient.
         w += 2;
         h += 2;
-        img_rgba = malloc(w * h * 4);
+        img_rgba = arena_alloc(&rend->arena, w * h * 4);
         text_shadow_effect(img, img_rgba, w, h, color);
         free(img);
         ctex = calloc(1, sizeof(*ctex));
@@ -941,7 +960,6 @@ static void text_using_texture(renderer_t *rend,
         ctex->text = strdup(text);
         ctex->tex = texture_from_data(img_rgba, w, h, 4, 0, 0, w, h, 0);
         vec3_copy(color, ctex->color);
-        free(img_rgba);
         DL_APPEND(rend->tex_cache, ctex);
     }
 
@@ -1063,7 +1081,7 @@ static void text_using_nanovg(renderer_t *rend,
     }
 
     if (!bounds) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_TEXT;
         item->flags = painter->flags;
         vec4_to_float(color, item->color);
@@ -1697,6 +1715,7 @@ static void item_gltf_render(renderer_t *rend, const item_t *item)
 static void rend_flush(renderer_t *rend)
 {
     item_t *item, *tmp;
+    TRACE_SCOPE("render", "rend_flush");
 
     // Compute depth range.
     if (rend->depth_min == DBL_MAX) {
@@ -1784,9 +1803,6 @@ static void rend_flush(renderer_t *rend)
             texture_release(item->planet.normalmap);
         if (item->type == ITEM_GLTF)
             json_builder_free(item->gltf.args);
-        gl_buf_release(&item->buf);
-        gl_buf_release(&item->indices);
-        free(item);
     }
     // Reset to default OpenGL settings.
     GL(glDepthMask(GL_TRUE));
@@ -1796,6 +1812,12 @@ static void rend_flush(renderer_t *rend)
 void render_finish(renderer_t *rend)
 {
     rend_flush(rend);
+    arena_reset(&rend->arena);
+}
+
+arena_t *render_get_arena(renderer_t *rend)
+{
+    return &rend->arena;
 }
 
 void render_line(renderer_t *rend, const painter_t *painter,
@@ -1811,11 +1833,12 @@ void render_line(renderer_t *rend, const painter_t *painter,
     if (size <= 1) return;
     assert(painter->lines.glow); // Only glowing lines supported for now.
     vec4_to_float(painter->color, color);
-    mesh = line_to_mesh(line, win, size, fmax(10, painter->lines.width + 2));
+    mesh = line_to_mesh(line, win, size, fmax(10, painter->lines.width + 2),
+                        &rend->arena);
 
     if (mesh->indices_count >= SIZE || mesh->verts_count >= SIZE) {
         LOG_W("Too many points in lines! (size: %d)", size);
-        goto end;
+        return;
     }
 
     // Get the item.
@@ -1836,11 +1859,11 @@ void render_line(renderer_t *rend, const painter_t *painter,
         item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_LINES;
         item->flags = painter->flags;
-        gl_buf_alloc(&item->buf, &LINES_BUF, SIZE);
-        gl_buf_alloc(&item->indices, &INDICES_BUF, SIZE);
+        item_buf_alloc(rend, &item->buf, &LINES_BUF, SIZE);
+        item_buf_alloc(rend, &item->indices, &INDICES_BUF, SIZE);
         item->lines.width = painter->lines.width;
         item->lines.glow = painter->lines.glow;
         item->lines.dash_length = painter->lines.dash_length;
@@ -1872,9 +1895,6 @@ void render_line(renderer_t *rend, const painter_t *painter,
         gl_buf_1i(&item->indices, -1, 0, mesh->indices[i] + ofs);
         gl_buf_next(&item->indices);
     }
-
-end:
-    line_mesh_delete(mesh);
 }
 
 void render_mesh(renderer_t *rend, const painter_t *painter,
@@ -1899,13 +1919,14 @@ void render_mesh(renderer_t *rend, const painter_t *painter,
     if (item && item->mesh.stroke_width != painter->lines.width) item = NULL;
 
     if (!item) {
-        item = calloc(1, sizeof(*item));
+        item = arena_calloc(&rend->arena, 1, sizeof(*item));
         item->type = ITEM_MESH;
         item->mesh.mode = mode;
         item->mesh.stroke_width = painter->lines.width;
         item->mesh.use_stencil = use_stencil;
-        gl_buf_alloc(&item->buf, &MESH_BUF, fmax(verts_count, 1024));
-        gl_buf_alloc(&item->indices, &INDICES_BUF, fmax(indices_count, 1024));
+        item_buf_alloc(rend, &item->buf, &MESH_BUF, fmax(verts_count, 1024));
+        item_buf_alloc(rend, &item->indices, &INDICES_BUF,
+                       fmax(indices_count, 1024));
         DL_APPEND(rend->items, item);
     }
 
@@ -1933,7 +1954,7 @@ void render_ellipse_2d(renderer_t *rend, const painter_t *painter,
                        double angle, double dashes)
 {
     item_t *item;
-    item = calloc(1, sizeof(*item));
+    item = arena_calloc(&rend->arena, 1, sizeof(*item));
     item->type = ITEM_VG_ELLIPSE;
     vec2_to_float(pos, item->vg.pos);
     vec2_to_float(size, item->vg.size);
@@ -1949,7 +1970,7 @@ void render_rect_2d(renderer_t *rend, const painter_t *painter,
                     double angle)
 {
     item_t *item;
-    item = calloc(1, sizeof(*item));
+    item = arena_calloc(&rend->arena, 1, sizeof(*item));
     item->type = ITEM_VG_RECT;
     vec2_to_float(pos, item->vg.pos);
     vec2_to_float(size, item->vg.size);
@@ -1963,7 +1984,7 @@ void render_line_2d(renderer_t *rend, const painter_t *painter,
                     const double p1[2], const double p2[2])
 {
     item_t *item;
-    item = calloc(1, sizeof(*item));
+    item = arena_calloc(&rend->arena, 1, sizeof(*item));
     item->type = ITEM_VG_LINE;
     vec2_to_float(p1, item->vg.pos);
     vec2_to_float(p2, item->vg.pos2);
@@ -2025,7 +2046,7 @@ void render_model_3d(renderer_t *rend, const painter_t *painter,
     item_t *item;
     double depth_range[2];
 
-    item = calloc(1, sizeof(*item));
+    item = arena_calloc(&rend->arena, 1, sizeof(*item));
     item->type = ITEM_GLTF;
     item->gltf.model = model;
     item->flags = painter->flags;
@@ -2152,3 +2173,5 @@ renderer_t* render_create(void)
 
     return rend;
 }
+
+#endif // NO_GL
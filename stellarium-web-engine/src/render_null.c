@@ -0,0 +1,431 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+/*
+ * Renderer backend used when we compile without OpenGL (NO_GL), for
+ * example for the headless native benchmark.
+ *
+ * By default all the rendering calls are ignored, we only return some
+ * approximate text bounds so that the labels layout logic still runs.
+ * See render_null.h for the optional commands recording and points and
+ * lines rasterization.
+ */
+
+#ifdef NO_GL
+
+#include "render_null.h"
+#include "swe.h"
+
+// Max radius of the rasterized points, in framebuffer pixels.
+#define MAX_POINT_RADIUS 32
+
+struct renderer {
+    projection_t proj;
+    int fb_size[2];
+    double scale;
+
+    bool record;
+    bool rasterize;
+
+    render_cmd_t *cmds;
+    int nb_cmds;
+    int cmds_allocated;
+
+    uint8_t *raster;        // RGBA buffer of fb_size.
+    int raster_size[2];
+
+    arena_t arena;          // Frame allocator.
+};
+
+renderer_t* render_create(void)
+{
+    renderer_t *rend;
+    rend = calloc(1, sizeof(*rend));
+    return rend;
+}
+
+void render_null_set_recording(renderer_t *rend, bool record, bool rasterize)
+{
+    rend->record = record;
+    rend->rasterize = rasterize;
+}
+
+const render_cmd_t *render_null_get_cmds(const renderer_t *rend, int *nb)
+{
+    *nb = rend->nb_cmds;
+    return rend->cmds;
+}
+
+const uint8_t *render_null_get_raster(const renderer_t *rend, int *w, int *h)
+{
+    if (!rend->rasterize) return NULL;
+    *w = rend->raster_size[0];
+    *h = rend->raster_size[1];
+    return rend->raster;
+}
+
+void render_null_delete(renderer_t *rend)
+{
+    if (!rend) return;
+    free(rend->cmds);
+    free(rend->raster);
+    arena_release(&rend->arena);
+    free(rend);
+}
+
+void render_prepare(renderer_t *rend,
+                    const projection_t *proj,
+                    double win_w, double win_h, double scale,
+                    bool cull_flipped)
+{
+    int size;
+    rend->fb_size[0] = win_w * scale;
+    rend->fb_size[1] = win_h * scale;
+    rend->scale = scale;
+    rend->proj = *proj;
+    rend->nb_cmds = 0;
+
+    if (!rend->rasterize) return;
+    if (rend->raster_size[0] != rend->fb_size[0] ||
+        rend->raster_size[1] != rend->fb_size[1]) {
+        free(rend->raster);
+        rend->raster_size[0] = rend->fb_size[0];
+        rend->raster_size[1] = rend->fb_size[1];
+        size = rend->raster_size[0] * rend->raster_size[1] * 4;
+        rend->raster = malloc(size);
+    }
+    memset(rend->raster, 0,
+           rend->raster_size[0] * rend->raster_size[1] * 4);
+}
+
+void render_finish(renderer_t *rend)
+{
+    arena_reset(&rend->arena);
+}
+
+arena_t *render_get_arena(renderer_t *rend)
+{
+    return &rend->arena;
+}
+
+// Add a new command to the list, and compare it to the previous one to
+// tell if it would need a new draw call.
+static void record(renderer_t *rend, const painter_t *painter, int type,
+                   int nb_verts, int nb_indices, const texture_t *tex)
+{
+    render_cmd_t *cmd, *prev;
+    if (!rend->record) return;
+    if (rend->nb_cmds >= rend->cmds_allocated) {
+        rend->cmds_allocated = rend->cmds_allocated * 2 ?: 64;
+        rend->cmds = realloc(rend->cmds,
+                             rend->cmds_allocated * sizeof(*rend->cmds));
+    }
+    prev = rend->nb_cmds ? &rend->cmds[rend->nb_cmds - 1] : NULL;
+    cmd = &rend->cmds[rend->nb_cmds++];
+    *cmd = (render_cmd_t) {
+        .type = type,
+        .nb_verts = nb_verts,
+        .nb_indices = nb_indices,
+        .flags = painter ? painter->flags : 0,
+        .tex = tex ? tex->id : 0,
+    };
+    cmd->tex_bind = cmd->tex && (!prev || prev->tex != cmd->tex);
+    cmd->state_change = !prev || prev->type != cmd->type ||
+                        prev->flags != cmd->flags;
+}
+
+static const texture_t *get_color_tex(const painter_t *painter)
+{
+    return painter->textures[PAINTER_TEX_COLOR].tex;
+}
+
+// Blend a color into a pixel of the raster buffer, with 'over' operator.
+static void blend_pixel(renderer_t *rend, int x, int y, const double c[4])
+{
+    uint8_t *dst;
+    int i;
+    if (x < 0 || y < 0 || x >= rend->raster_size[0] ||
+        y >= rend->raster_size[1]) return;
+    dst = &rend->raster[(y * rend->raster_size[0] + x) * 4];
+    for (i = 0; i < 3; i++)
+        dst[i] = round(c[i] * c[3] * 255 + dst[i] * (1 - c[3]));
+    dst[3] = round((c[3] + dst[3] / 255. * (1 - c[3])) * 255);
+}
+
+// Rasterize a disk, position in window coordinates.
+static void raster_point(renderer_t *rend, const double win[2], double size,
+                         const double color[4])
+{
+    double c[2], r;
+    int x, y;
+    c[0] = win[0] * rend->scale;
+    c[1] = win[1] * rend->scale;
+    r = fmin(fmax(size * rend->scale, 0.5), MAX_POINT_RADIUS);
+    for (y = floor(c[1] - r); y <= ceil(c[1] + r); y++) {
+        for (x = floor(c[0] - r); x <= ceil(c[0] + r); x++) {
+            if (pow(x + 0.5 - c[0], 2) + pow(y + 0.5 - c[1], 2) > r * r)
+                continue;
+            blend_pixel(rend, x, y, color);
+        }
+    }
+}
+
+// Rasterize a one pixel wide segment, positions in window coordinates.
+static void raster_line(renderer_t *rend, const double p1[2],
+                        const double p2[2], const double color[4])
+{
+    double a[2], b[2], k;
+    int i, n;
+    vec2_mul(rend->scale, p1, a);
+    vec2_mul(rend->scale, p2, b);
+    // Skip the segments far outside the screen.
+    if (fmax(fabs(a[0]), fabs(b[0])) > 4 * rend->raster_size[0] + 1000 ||
+        fmax(fabs(a[1]), fabs(b[1])) > 4 * rend->raster_size[1] + 1000)
+        return;
+    n = ceil(fmax(fabs(b[0] - a[0]), fabs(b[1] - a[1])));
+    for (i = 0; i <= n; i++) {
+        k = n ? (double)i / n : 0;
+        blend_pixel(rend, floor(a[0] + (b[0] - a[0]) * k),
+                          floor(a[1] + (b[1] - a[1]) * k), color);
+    }
+}
+
+// Color of a point multiplied by the painter color.
+static void point_color(const painter_t *painter, const uint8_t color[4],
+                        double out[4])
+{
+    int i;
+    for (i = 0; i < 4; i++)
+        out[i] = color[i] / 255. * painter->color[i];
+}
+
+void render_points_2d(renderer_t *rend, const painter_t *painter,
+                      int n, const point_t *points)
+{
+    int i;
+    double color[4];
+    const point_t *p;
+
+    record(rend, painter, RENDER_CMD_POINTS_2D, n, 0, NULL);
+    // Add the points in the global list of rendered points, as the gl
+    // renderer does, so that we can still pick them.
+    for (i = 0; i < n; i++) {
+        p = &points[i];
+        if (p->get_obj) {
+            areas_add_circle_deferred(core->areas, p->pos, p->size,
+                                      p->get_obj, p->obj_user, p->obj_id);
+        } else if (p->obj) {
+            areas_add_circle(core->areas, p->pos, p->size, p->obj);
+        }
+    }
+    if (!rend->rasterize) return;
+    for (i = 0; i < n; i++) {
+        point_color(painter, points[i].color, color);
+        raster_point(rend, points[i].pos, points[i].size, color);
+    }
+}
+
+void render_points_3d(renderer_t *rend, const painter_t *painter,
+                      int n, const point_3d_t *points)
+{
+    int i;
+    double color[4], win[3];
+
+    record(rend, painter, RENDER_CMD_POINTS_3D, n, 0, NULL);
+    for (i = 0; i < n; i++) {
+        if (!points[i].obj) continue;
+        if (project_to_win_xy(painter->proj, points[i].pos, win))
+            areas_add_circle(core->areas, win, points[i].size, points[i].obj);
+    }
+    if (!rend->rasterize) return;
+    for (i = 0; i < n; i++) {
+        if (!project_to_win(&rend->proj, points[i].pos, win)) continue;
+        if (win[2] < 0 || win[2] > 1) continue;
+        point_color(painter, points[i].color, color);
+        raster_point(rend, win, points[i].size, color);
+    }
+}
+
+void render_quad(renderer_t *rend, const painter_t *painter,
+                 int frame, int grid_size, const uv_map_t *map)
+{
+    record(rend, painter, RENDER_CMD_QUAD,
+           (grid_size + 1) * (grid_size + 1), grid_size * grid_size * 6,
+           get_color_tex(painter));
+}
+
+void render_texture(renderer_t *rend, texture_t *tex,
+                    const double uv[4][2], const double pos[2], double size,
+                    const double color[4], double angle)
+{
+    record(rend, NULL, RENDER_CMD_TEXTURE, 4, 6, tex);
+}
+
+void render_text(renderer_t *rend, const painter_t *painter,
+                 const char *text, const double win_pos[2],
+                 const double view_pos[3],
+                 int align, int effects, double size,
+                 const double color[4], double angle,
+                 double bounds[4])
+{
+    int nb_lines = 1, line_len = 0, max_len = 0;
+    const char *c;
+    double w, h;
+
+    assert(win_pos);
+    record(rend, painter, RENDER_CMD_TEXT, 0, 0, NULL);
+    if (!bounds) return;
+
+    // Estimate the text size assuming an average glyph width of 0.6 em.
+    for (c = text; *c; c++) {
+        if (*c == '\n') {
+            nb_lines++;
+            line_len = 0;
+            continue;
+        }
+        if ((*c & 0xc0) != 0x80) line_len++; // Skip utf8 continuation bytes.
+        if (line_len > max_len) max_len = line_len;
+    }
+    w = max_len * size * 0.6;
+    h = nb_lines * size;
+
+    bounds[0] = win_pos[0];
+    bounds[1] = win_pos[1];
+    if (align & ALIGN_RIGHT)    bounds[0] += -w;
+    if (align & ALIGN_CENTER)   bounds[0] += -w / 2;
+    if (align & ALIGN_BOTTOM)   bounds[1] += -h;
+    if (align & ALIGN_MIDDLE)   bounds[1] += -h / 2;
+    if (align & ALIGN_BASELINE) bounds[1] += -h;
+    bounds[2] = bounds[0] + w;
+    bounds[3] = bounds[1] + h;
+}
+
+void render_line(renderer_t *rend, const painter_t *painter,
+                 const double (*pos)[3], const double (*win)[3], int size)
+{
+    int i;
+    record(rend, painter, RENDER_CMD_LINE, size, 0, NULL);
+    if (!rend->rasterize) return;
+    for (i = 0; i < size - 1; i++)
+        raster_line(rend, win[i], win[i + 1], painter->color);
+}
+
+void render_mesh(renderer_t *rend, const painter_t *painter,
+                 int frame, int mode, int verts_count,
+                 const double verts[][3], int indices_count,
+                 const uint16_t indices[], bool use_stencil)
+{
+    record(rend, painter, RENDER_CMD_MESH, verts_count, indices_count,
+           NULL);
+}
+
+void render_ellipse_2d(renderer_t *rend, const painter_t *painter,
+                       const double pos[2], const double size[2],
+                       double angle, double dashes)
+{
+    record(rend, painter, RENDER_CMD_ELLIPSE_2D, 0, 0, NULL);
+}
+
+void render_rect_2d(renderer_t *rend, const painter_t *painter,
+                    const double pos[2], const double size[2],
+                    double angle)
+{
+    record(rend, painter, RENDER_CMD_RECT_2D, 0, 0, NULL);
+}
+
+void render_line_2d(renderer_t *rend, const painter_t *painter,
+                    const double p1[2], const double p2[2])
+{
+    record(rend, painter, RENDER_CMD_LINE_2D, 2, 0, NULL);
+    if (rend->rasterize) raster_line(rend, p1, p2, painter->color);
+}
+
+void render_model_3d(renderer_t *rend, const painter_t *painter,
+                     const char *model, const double model_mat[4][4],
+                     const double view_mat[4][4], const double proj_mat[4][4],
+                     const double light_dir[3], const json_value *args)
+{
+    record(rend, painter, RENDER_CMD_MODEL_3D, 0, 0, NULL);
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static obj_t *test_get_obj(void *user, uint64_t id)
+{
+    assert(id == 42);
+    return obj_retain(user);
+}
+
+static void test_render_null(void)
+{
+    renderer_t *rend;
+    projection_t proj;
+    painter_t painter = {.color = {1, 1, 1, 1}};
+    obj_t obj = {.ref = 1};
+    const point_t points[2] = {
+        {.pos = {10, 10}, .size = 2, .color = {255, 0, 0, 255}},
+        {.pos = {30, 10}, .size = 2, .color = {0, 255, 0, 255},
+         .get_obj = test_get_obj, .obj_user = &obj, .obj_id = 42},
+    };
+    const render_cmd_t *cmds;
+    const uint8_t *raster;
+    int nb, w, h;
+
+    core_init(64, 32, 1.0);
+    areas_clear_all(core->areas);
+    rend = render_create();
+    painter.rend = rend;
+    projection_init(&proj, PROJ_PERSPECTIVE, 60 * DD2R, 64, 32);
+    render_null_set_recording(rend, true, true);
+    render_prepare(rend, &proj, 64, 32, 2, false);
+    render_points_2d(rend, &painter, 2, points);
+    render_points_2d(rend, &painter, 2, points);
+    painter.flags = PAINTER_ADD;
+    render_line_2d(rend, &painter, VEC(0, 20), VEC(63, 20));
+    render_finish(rend);
+
+    cmds = render_null_get_cmds(rend, &nb);
+    assert(nb == 3);
+    assert(cmds[0].type == RENDER_CMD_POINTS_2D && cmds[0].nb_verts == 2);
+    assert(cmds[0].state_change && !cmds[1].state_change);
+    assert(cmds[2].type == RENDER_CMD_LINE_2D && cmds[2].state_change);
+
+    // The raster uses the framebuffer size, so positions are scaled by 2.
+    raster = render_null_get_raster(rend, &w, &h);
+    assert(raster && w == 128 && h == 64);
+    assert(memcmp(&raster[(20 * w + 20) * 4], (uint8_t[]){255, 0, 0, 255},
+                  4) == 0);
+    assert(memcmp(&raster[(20 * w + 60) * 4], (uint8_t[]){0, 255, 0, 255},
+                  4) == 0);
+    assert(raster[(40 * w + 100) * 4 + 3] == 255);
+    assert(raster[(0 * w + 0) * 4 + 3] == 0);
+
+    // The points can be picked, and the object is only created then.
+    assert(obj.ref == 1);
+    assert(areas_lookup(core->areas, VEC(31, 10), 5) == &obj);
+    assert(obj.ref == 2);
+    obj_release(&obj);
+    assert(!areas_lookup(core->areas, VEC(10, 10), 5));
+    areas_clear_all(core->areas);
+
+    // A new frame resets everything.
+    render_prepare(rend, &proj, 64, 32, 2, false);
+    render_null_get_cmds(rend, &nb);
+    assert(nb == 0);
+    assert(raster[(20 * w + 20) * 4 + 3] == 0);
+    render_null_delete(rend);
+}
+
+TEST_REGISTER(NULL, test_render_null, TEST_AUTO);
+
+#endif
+
+#endif // NO_GL
@@ -0,0 +1,116 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef RENDER_NULL_H
+#define RENDER_NULL_H
+
+/*
+ * File: render_null.h
+ * Extra functions of the CPU renderer used when we compile with NO_GL.
+ *
+ * The renderer can record all the render calls of a frame into a list of
+ * commands, and optionally rasterize the points and lines into a RGBA
+ * buffer, so that we can test and benchmark the CPU side of the rendering
+ * without a GPU.
+ */
+
+#include "render.h"
+
+/*
+ * Enum: RENDER_CMD
+ * Type of the recorded render commands, one per render function.
+ */
+enum {
+    RENDER_CMD_POINTS_2D = 1,
+    RENDER_CMD_POINTS_3D,
+    RENDER_CMD_QUAD,
+    RENDER_CMD_TEXTURE,
+    RENDER_CMD_TEXT,
+    RENDER_CMD_LINE,
+    RENDER_CMD_MESH,
+    RENDER_CMD_ELLIPSE_2D,
+    RENDER_CMD_RECT_2D,
+    RENDER_CMD_LINE_2D,
+    RENDER_CMD_MODEL_3D,
+    RENDER_CMD_COUNT
+};
+
+/*
+ * Type: render_cmd_t
+ * A recorded render call.
+ *
+ * Fields:
+ *   type           - One of the <RENDER_CMD> values.
+ *   nb_verts       - Number of vertices (points, line points, quad grid
+ *                    vertices...).
+ *   nb_indices     - Number of indices, for meshes only.
+ *   flags          - The painter flags.
+ *   tex            - Id of the bound color texture, or zero.
+ *   tex_bind       - Set if the texture differs from the previous command.
+ *   state_change   - Set if the type or flags differ from the previous
+ *                    command, that is the GL backend would have to start a
+ *                    new draw call.
+ */
+typedef struct render_cmd {
+    int         type;
+    int         nb_verts;
+    int         nb_indices;
+    int         flags;
+    uint32_t    tex;
+    bool        tex_bind;
+    bool        state_change;
+} render_cmd_t;
+
+/*
+ * Function: render_null_set_recording
+ * Enable or disable the commands recording and rasterization.
+ *
+ * The recorded commands and the raster buffer are reset at each call to
+ * render_prepare.
+ *
+ * Parameters:
+ *   rend       - The renderer.
+ *   record     - Record the render calls.
+ *   rasterize  - Also draw the points and lines in a RGBA buffer of the
+ *                framebuffer size.
+ */
+void render_null_set_recording(renderer_t *rend, bool record, bool rasterize);
+
+/*
+ * Function: render_null_get_cmds
+ * Return the commands recorded since the last call to render_prepare.
+ *
+ * Parameters:
+ *   rend   - The renderer.
+ *   nb     - Get the number of commands.
+ */
+const render_cmd_t *render_null_get_cmds(const renderer_t *rend, int *nb);
+
+/*
+ * Function: render_null_get_raster
+ * Return the RGBA buffer of the rasterized points and lines.
+ *
+ * Parameters:
+ *   rend   - The renderer.
+ *   w      - Get the width of the buffer in pixels.
+ *   h      - Get the height of the buffer in pixels.
+ *
+ * Return:
+ *   The RGBA pixels, rows from top to bottom, or NULL if the rasterization
+ *   is not enabled.
+ */
+const uint8_t *render_null_get_raster(const renderer_t *rend, int *w, int *h);
+
+/*
+ * Function: render_null_delete
+ * Release a renderer created with render_create.
+ */
+void render_null_delete(renderer_t *rend);
+
+#endif // RENDER_NULL_H
@@ -0,0 +1,285 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "replay.h"
+#include "swe.h"
+
+struct replay {
+    json_value  *record;
+    const json_value *events;
+    int         next;       // Index of the next event to apply.
+};
+
+// The current record.
+static struct {
+    bool        recording;
+    double      start;
+    json_value  *record;
+    json_value  *events;
+} g_rec = {};
+
+// Compute the path of an object that we can later pass to core_get_module.
+static int get_obj_path(const obj_t *obj, char *buf, int size)
+{
+    int len;
+    if (obj == &core->obj) return snprintf(buf, size, "core") >= size;
+    if (obj == &core->observer->obj)
+        return snprintf(buf, size, "core.observer") >= size;
+    if (!obj->id || !obj->parent) return -1;
+    if (get_obj_path(obj->parent, buf, size)) return -1;
+    len = strlen(buf);
+    return snprintf(buf + len, size - len, ".%s", obj->id) >= size - len;
+}
+
+static obj_t *get_obj(const char *path)
+{
+    if (strcmp(path, "core.observer") == 0) return &core->observer->obj;
+    return core_get_module(path);
+}
+
+void replay_record_start(void)
+{
+    json_value *init;
+    const observer_t *obs = core->observer;
+
+    if (g_rec.record) json_builder_free(g_rec.record);
+    g_rec.start = sys_get_unix_time();
+    g_rec.record = json_object_new(0);
+    json_object_push(g_rec.record, "version", json_integer_new(1));
+    init = json_object_push(g_rec.record, "init", json_object_new(0));
+    json_object_push(init, "clock", json_double_new(g_rec.start));
+    json_object_push(init, "win_size", json_vector_new(2, core->win_size));
+    json_object_push(init, "utc", json_double_new(obs->utc));
+    json_object_push(init, "latitude", json_double_new(obs->phi));
+    json_object_push(init, "longitude", json_double_new(obs->elong));
+    json_object_push(init, "elevation", json_double_new(obs->hm));
+    json_object_push(init, "yaw", json_double_new(obs->yaw));
+    json_object_push(init, "pitch", json_double_new(obs->pitch));
+    json_object_push(init, "fov", json_double_new(core->fov));
+    json_object_push(init, "time_speed", json_double_new(core->time_speed));
+    g_rec.events = json_object_push(g_rec.record, "events",
+                                    json_array_new(0));
+    g_rec.recording = true;
+}
+
+void replay_record_stop(void)
+{
+    g_rec.recording = false;
+}
+
+bool replay_is_recording(void)
+{
+    return g_rec.recording;
+}
+
+json_value *replay_get_record(void)
+{
+    if (!g_rec.record) return json_object_new(0);
+    return json_copy(g_rec.record);
+}
+
+// Add a new event to the record, and return it so that we can add more
+// attributes.
+static json_value *add_event(const char *type, int nb, const double *args)
+{
+    json_value *event;
+    event = json_array_push(g_rec.events, json_object_new(0));
+    json_object_push(event, "t",
+                     json_double_new(sys_get_unix_time() - g_rec.start));
+    json_object_push(event, "type", json_string_new(type));
+    if (nb) json_object_push(event, "args", json_vector_new(nb, args));
+    return event;
+}
+
+void replay_on_mouse(int id, int state, double x, double y, int buttons)
+{
+    if (!g_rec.recording) return;
+    add_event("mouse", 5, (double[]){id, state, x, y, buttons});
+}
+
+void replay_on_zoom(double k, double x, double y)
+{
+    if (!g_rec.recording) return;
+    add_event("zoom", 3, (double[]){k, x, y});
+}
+
+void replay_on_set_time(double utc, double duration)
+{
+    if (!g_rec.recording) return;
+    add_event("set_time", 2, (double[]){utc, duration});
+}
+
+void replay_on_lookat(const double pos[3], double duration)
+{
+    if (!g_rec.recording) return;
+    add_event("lookat", 4, (double[]){pos[0], pos[1], pos[2], duration});
+}
+
+void replay_on_set_attr(const obj_t *obj, const attribute_t *attr,
+                        const json_value *args)
+{
+    char path[256];
+    json_value *event;
+    if (!g_rec.recording) return;
+    if (!attr || !attr->is_prop || !args) return;
+    if (args->type == json_array && !args->u.array.length) return;
+    // We cannot replay pointers to objects.
+    if (attr->type == TYPE_OBJ) return;
+    // Don't record the recording control itself.
+    if (strncmp(attr->name, "replay_", 7) == 0) return;
+    if (get_obj_path(obj, path, sizeof(path))) return;
+    event = add_event("attr", 0, NULL);
+    json_object_push(event, "obj", json_string_new(path));
+    json_object_push(event, "attr", json_string_new(attr->name));
+    json_object_push(event, "args", json_copy(args));
+}
+
+replay_t *replay_create(const json_value *record)
+{
+    replay_t *replay;
+    const json_value *events;
+    events = json_get_attr(record, "events", json_array);
+    if (!events) {
+        LOG_E("Replay record without events");
+        return NULL;
+    }
+    replay = calloc(1, sizeof(*replay));
+    replay->record = json_copy(record);
+    replay->events = json_get_attr(replay->record, "events", json_array);
+    return replay;
+}
+
+void replay_init(replay_t *replay, double *clock, double win_size[2])
+{
+    const json_value *init, *size;
+    obj_t *obs = &core->observer->obj;
+
+    init = json_get_attr(replay->record, "init", json_object);
+    if (!init) return;
+    if (clock) *clock = json_get_attr_f(init, "clock", *clock);
+    size = json_get_attr(init, "win_size", json_array);
+    if (size && win_size) json_parse_vector(size, 2, win_size);
+
+#define SET_ATTR(obj, name, default_) \
+    obj_set_attr(obj, name, json_get_attr_f(init, name, default_))
+    SET_ATTR(obs, "latitude", core->observer->phi);
+    SET_ATTR(obs, "longitude", core->observer->elong);
+    SET_ATTR(obs, "elevation", core->observer->hm);
+    SET_ATTR(obs, "utc", core->observer->utc);
+    SET_ATTR(obs, "yaw", core->observer->yaw);
+    SET_ATTR(obs, "pitch", core->observer->pitch);
+    SET_ATTR(&core->obj, "fov", core->fov);
+    SET_ATTR(&core->obj, "time_speed", core->time_speed);
+#undef SET_ATTR
+}
+
+static void apply_event(const json_value *event)
+{
+    const char *type, *path, *attr;
+    const json_value *args;
+    double v[5] = {};
+    obj_t *obj;
+
+    type = json_get_attr_s(event, "type");
+    if (!type) return;
+    if (strcmp(type, "attr") == 0) {
+        path = json_get_attr_s(event, "obj");
+        attr = json_get_attr_s(event, "attr");
+        args = json_get_attr(event, "args", 0);
+        obj = path ? get_obj(path) : NULL;
+        if (!obj || !attr || !args || !obj_has_attr(obj, attr)) {
+            LOG_W("Cannot replay attribute %s of %s", attr, path);
+            return;
+        }
+        json_builder_free(obj_call_json(obj, attr, args));
+        return;
+    }
+
+    args = json_get_attr(event, "args", json_array);
+    if (args)
+        json_parse_vector(args, fmin(args->u.array.length, 5), v);
+    if (strcmp(type, "mouse") == 0)
+        core_on_mouse(v[0], v[1], v[2], v[3], v[4]);
+    else if (strcmp(type, "zoom") == 0)
+        core_on_zoom(v[0], v[1], v[2]);
+    else if (strcmp(type, "set_time") == 0)
+        core_set_time(v[0], v[1]);
+    else if (strcmp(type, "lookat") == 0)
+        core_lookat(v, v[3]);
+    else
+        LOG_W("Unknown replay event type: %s", type);
+}
+
+int replay_apply(replay_t *replay, double t)
+{
+    const json_value *event;
+    const int nb = replay->events->u.array.length;
+    while (replay->next < nb) {
+        event = replay->events->u.array.values[replay->next];
+        if (json_get_attr_f(event, "t", 0) > t) break;
+        apply_event(event);
+        replay->next++;
+    }
+    return nb - replay->next;
+}
+
+double replay_get_duration(const replay_t *replay)
+{
+    const int nb = replay->events->u.array.length;
+    if (!nb) return 0;
+    return json_get_attr_f(replay->events->u.array.values[nb - 1], "t", 0);
+}
+
+void replay_delete(replay_t *replay)
+{
+    if (!replay) return;
+    json_builder_free(replay->record);
+    free(replay);
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+static void test_replay(void)
+{
+    json_value *record;
+    replay_t *replay;
+    obj_t *stars;
+    bool visible;
+
+    core_init(100, 100, 1.0);
+    stars = core_get_module("stars");
+    obj_set_attr(stars, "visible", true);
+
+    replay_record_start();
+    free(obj_call_json_str(stars, "visible", "false"));
+    replay_on_zoom(1.5, 10, 20);
+    replay_record_stop();
+    replay_on_zoom(1.5, 10, 20); // Not recorded.
+    record = replay_get_record();
+    assert(json_get_attr(record, "events", json_array)->u.array.length == 2);
+
+    obj_set_attr(stars, "visible", true);
+    replay = replay_create(record);
+    assert(replay_apply(replay, -1) == 2);
+    assert(replay_apply(replay, 1000) == 0);
+    obj_get_attr(stars, "visible", &visible);
+    assert(!visible);
+    obj_set_attr(stars, "visible", true);
+    replay_delete(replay);
+    json_builder_free(record);
+    json_builder_free(g_rec.record);
+    g_rec.record = NULL;
+    g_rec.events = NULL;
+}
+
+TEST_REGISTER(NULL, test_replay, TEST_AUTO);
+
+#endif
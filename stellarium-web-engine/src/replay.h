@@ -0,0 +1,120 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * File: replay.h
+ * Record the user navigation and replay it, so that we can benchmark the
+ * engine with reproducible navigation patterns.
+ *
+ * A record is a json document of the form:
+ *
+ *   {
+ *     "version": 1,
+ *     "init": {"clock": <unix time>, "win_size": [w, h],
+ *              "utc": <mjd>, "latitude": <rad>, "longitude": <rad>,
+ *              "elevation": <m>, "yaw": <rad>, "pitch": <rad>,
+ *              "fov": <rad>, "time_speed": <float>},
+ *     "events": [
+ *       {"t": 0.5, "type": "mouse", "args": [id, state, x, y, buttons]},
+ *       {"t": 0.6, "type": "zoom", "args": [k, x, y]},
+ *       {"t": 1.0, "type": "set_time", "args": [utc, duration]},
+ *       {"t": 2.0, "type": "lookat", "args": [x, y, z, duration]},
+ *       {"t": 3.0, "type": "attr", "obj": "core.stars", "attr": "visible",
+ *        "args": false}
+ *     ]
+ *   }
+ *
+ * Where "t" is the time in seconds since the start of the record.  All
+ * the "init" values are optional.
+ */
+
+#include "obj.h"
+
+typedef struct replay replay_t;
+
+/*
+ * Function: replay_record_start
+ * Start recording the navigation, with the current core state as
+ * initial state.
+ */
+void replay_record_start(void);
+
+/*
+ * Function: replay_record_stop
+ * Stop recording.  The record is kept until the next recording starts.
+ */
+void replay_record_stop(void);
+
+/*
+ * Function: replay_is_recording
+ * Return whether we are currently recording.
+ */
+bool replay_is_recording(void);
+
+/*
+ * Function: replay_get_record
+ * Return a copy of the current record, or an empty object if we never
+ * recorded anything.
+ */
+json_value *replay_get_record(void);
+
+// Recording hooks, called by the core entry points.
+void replay_on_mouse(int id, int state, double x, double y, int buttons);
+void replay_on_zoom(double k, double x, double y);
+void replay_on_set_time(double utc, double duration);
+void replay_on_lookat(const double pos[3], double duration);
+void replay_on_set_attr(const obj_t *obj, const attribute_t *attr,
+                        const json_value *args);
+
+/*
+ * Function: replay_create
+ * Create a replay from a record.
+ *
+ * Return:
+ *   The replay, or NULL if the record is not valid.
+ */
+replay_t *replay_create(const json_value *record);
+
+/*
+ * Function: replay_init
+ * Set the core and observer to the initial state of the record.
+ *
+ * Parameters:
+ *   replay     - A replay.
+ *   clock      - Get the unix time of the record start.
+ *   win_size   - Get the window size of the record, unchanged if the record
+ *                doesn't specify it.
+ */
+void replay_init(replay_t *replay, double *clock, double win_size[2]);
+
+/*
+ * Function: replay_apply
+ * Apply all the events of the record up to a given time.
+ *
+ * Parameters:
+ *   replay - A replay.
+ *   t      - Time since the start of the replay (sec).
+ *
+ * Return:
+ *   The number of events still to apply after this time.
+ */
+int replay_apply(replay_t *replay, double t);
+
+/*
+ * Function: replay_get_duration
+ * Return the time of the last event of the record.
+ */
+double replay_get_duration(const replay_t *replay);
+
+void replay_delete(replay_t *replay);
+
+#endif // REPLAY_H
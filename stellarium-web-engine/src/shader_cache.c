@@ -7,6 +7,8 @@
  * repository.
  */
 
+#ifndef NO_GL
+
 #include "shader_cache.h"
 
 #define MAX_NB_SHADERS 32
@@ -99,3 +101,5 @@ gl_shader_t *shader_get(const char *name, const shader_define_t *defines,
     if (on_created) on_created(s->shader);
     return s->shader;
 }
+
+#endif // NO_GL
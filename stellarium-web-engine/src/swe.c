@@ -139,6 +139,8 @@ char *a2af_json(int resolution, double angle)
 
 #if COMPILE_TESTS
 
+#include <zlib.h>
+
 /*
     Some data from USNO to test from.
 
@@ -388,6 +390,69 @@ static void test_iter_lines(void)
     assert(!iter_lines(data, strlen(data) - 1, &line, &len));
 }
 
+typedef struct {
+    const char  *src;
+    int         ofs;
+    int         nb;
+} gz_lines_test_t;
+
+static int on_gz_line(void *user, const char *line, int len)
+{
+    gz_lines_test_t *t = user;
+    const char *end = strchr(t->src + t->ofs, '\n');
+    assert(end && end - (t->src + t->ofs) == len);
+    assert(memcmp(line, t->src + t->ofs, len) == 0);
+    t->ofs += len + 1;
+    t->nb++;
+    return 0;
+}
+
+static void test_z_iter_gz_lines(void)
+{
+    z_stream stream = {};
+    UT_string src;
+    uint8_t *gz;
+    char *data, *long_line;
+    int i, gz_size, size;
+    gz_lines_test_t t = {};
+
+    // Many short lines and a few lines longer than the uncompress chunks.
+    long_line = calloc(1, 200001);
+    memset(long_line, 'x', 200000);
+    utstring_init(&src);
+    for (i = 0; i < 20000; i++) {
+        utstring_printf(&src, "{\"id\": %d}\n", i);
+        if (i % 5000 == 0) utstring_printf(&src, "%s\n", long_line);
+    }
+    free(long_line);
+
+    deflateInit2(&stream, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    gz_size = deflateBound(&stream, utstring_len(&src));
+    gz = malloc(gz_size);
+    stream.next_in = (void*)utstring_body(&src);
+    stream.avail_in = utstring_len(&src);
+    stream.next_out = gz;
+    stream.avail_out = gz_size;
+    assert(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    gz_size = stream.total_out;
+    deflateEnd(&stream);
+
+    t.src = utstring_body(&src);
+    assert(z_iter_gz_lines(gz, gz_size, &t, on_gz_line) == 0);
+    assert(t.nb == 20004 && t.ofs == utstring_len(&src));
+
+    data = z_uncompress_gz(gz, gz_size, &size);
+    assert(size == utstring_len(&src));
+    assert(strcmp(data, utstring_body(&src)) == 0);
+    free(data);
+
+    // Truncated data.
+    t = (gz_lines_test_t) {.src = utstring_body(&src)};
+    assert(z_iter_gz_lines(gz, gz_size / 2, &t, on_gz_line) == -1);
+    free(gz);
+    utstring_done(&src);
+}
+
 static void test_jcon(void)
 {
     const char *str;
@@ -455,6 +520,7 @@ TEST_REGISTER(NULL, test_ephemeris, TEST_AUTO);
 TEST_REGISTER(NULL, test_epv00, TEST_AUTO);
 TEST_REGISTER(NULL, test_clipping, TEST_AUTO);
 TEST_REGISTER(NULL, test_iter_lines, TEST_AUTO);
+TEST_REGISTER(NULL, test_z_iter_gz_lines, TEST_AUTO);
 TEST_REGISTER(NULL, test_jcon, TEST_AUTO);
 TEST_REGISTER(NULL, test_u8, TEST_AUTO);
 
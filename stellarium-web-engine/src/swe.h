@@ -33,15 +33,19 @@
 #include "log.h"
 #include "tests.h"
 
+#include "utils/arena.h"
 #include "utils/cache.h"
 #include "utils/fader.h"
 #include "utils/gesture.h"
+#include "utils/profiler.h"
 #include "utils/progressbar.h"
 #include "utils/texture.h"
+#include "utils/tile_pack.h"
 #include "utils/utils.h"
 #include "utils/utils_json.h"
 #include "utils/utf8.h"
 #include "utils/request.h"
+#include "utils/trace.h"
 #include "utils/vec.h"
 #include "utils/worker.h"
 
@@ -41,6 +41,8 @@ void sys_log(const char *msg)
 double sys_get_unix_time(void)
 {
     struct timeval tv;
+    if (sys_callbacks.get_time)
+        return sys_callbacks.get_time(sys_callbacks.user);
     gettimeofday(&tv, NULL);
     return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
 }
@@ -144,6 +144,9 @@ typedef struct {
                          int align, int *w, int *h, int *xoffset, int *yoffset);
     int (*list_dir)(void *user, const char *dir, void *cuser,
                     int (*f)(void *user, const char *path, int is_dir));
+    // Override the clock returned by sys_get_unix_time, for example to
+    // replay a navigation record at a fixed frame rate.
+    double (*get_time)(void *user);
 } sys_callbacks_t;
 
 extern sys_callbacks_t sys_callbacks;
@@ -0,0 +1,165 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN 16
+#define ALIGN_UP(x) (((x) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+// Min size of the blocks.
+#define MIN_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+    arena_block_t   *next;
+    size_t          size;
+    size_t          used;
+};
+
+#define HEADER_SIZE ALIGN_UP(sizeof(arena_block_t))
+
+static uint8_t *block_data(arena_block_t *block)
+{
+    return (uint8_t*)block + HEADER_SIZE;
+}
+
+static arena_block_t *add_block(arena_t *arena, size_t size)
+{
+    arena_block_t *block;
+    block = malloc(HEADER_SIZE + size);
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->capacity += size;
+    arena->nb_mallocs++;
+    return block;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    arena_block_t *block = arena->blocks;
+    void *ret;
+    size_t block_size;
+
+    size = ALIGN_UP(size ?: 1);
+    if (!block || block->used + size > block->size) {
+        // Double the capacity each time, so that we quickly reach the
+        // amount of memory we need for a full frame.
+        block_size = arena->capacity > MIN_BLOCK_SIZE ?
+                     arena->capacity : MIN_BLOCK_SIZE;
+        if (block_size < size) block_size = size;
+        block = add_block(arena, block_size);
+    }
+    ret = block_data(block) + block->used;
+    block->used += size;
+    arena->used += size;
+    return ret;
+}
+
+void *arena_calloc(arena_t *arena, size_t n, size_t size)
+{
+    void *ret = arena_alloc(arena, n * size);
+    memset(ret, 0, n * size);
+    return ret;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size)
+{
+    arena_block_t *block = arena->blocks;
+    void *ret;
+
+    if (!ptr) return arena_alloc(arena, size);
+    if (size <= old_size) return ptr;
+    old_size = ALIGN_UP(old_size ?: 1);
+    size = ALIGN_UP(size);
+    // Last allocation of the current block: grow in place.
+    if (block_data(block) + block->used - old_size == (uint8_t*)ptr &&
+            block->used - old_size + size <= block->size) {
+        block->used += size - old_size;
+        arena->used += size - old_size;
+        return ptr;
+    }
+    ret = arena_alloc(arena, size);
+    memcpy(ret, ptr, old_size);
+    return ret;
+}
+
+void arena_reset(arena_t *arena)
+{
+    arena_block_t *block, *next;
+    size_t capacity = arena->capacity;
+
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    arena->used = 0;
+    if (!arena->blocks) return;
+    // Replace all the blocks by a single one, so that next time all the
+    // allocations fit without new mallocs.
+    if (arena->blocks->next) {
+        for (block = arena->blocks; block; block = next) {
+            next = block->next;
+            free(block);
+        }
+        arena->blocks = NULL;
+        arena->capacity = 0;
+        add_block(arena, capacity);
+    }
+    arena->blocks->used = 0;
+}
+
+void arena_release(arena_t *arena)
+{
+    arena_block_t *block, *next;
+    for (block = arena->blocks; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include <assert.h>
+
+static void test_arena(void)
+{
+    arena_t arena = {};
+    int frame, i, nb_mallocs = 0;
+    uint8_t *p, *q;
+
+    for (frame = 0; frame < 3; frame++) {
+        for (i = 0; i < 100; i++) {
+            p = arena_alloc(&arena, 1000 + i);
+            assert(((uintptr_t)p - (uintptr_t)arena.blocks) % ALIGN == 0);
+            memset(p, i, 1000 + i);
+        }
+        p = arena_calloc(&arena, 10, 8);
+        assert(p[0] == 0 && p[79] == 0);
+        q = arena_realloc(&arena, p, 80, 160);
+        assert(p == q); // Last allocation, grown in place.
+        if (frame == 1) nb_mallocs = arena.nb_mallocs;
+        arena_reset(&arena);
+    }
+    // After the first frame we don't need any new block.
+    assert(arena.nb_mallocs == nb_mallocs);
+    assert(arena.blocks && !arena.blocks->next);
+    assert(arena.peak >= 100 * 1000);
+    arena_release(&arena);
+    assert(!arena.blocks && !arena.capacity);
+}
+
+TEST_REGISTER(NULL, test_arena, TEST_AUTO);
+
+#endif
@@ -0,0 +1,81 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * File: arena.h
+ * Simple linear allocator for transient memory.
+ *
+ * All the allocations are released at once with arena_reset.  After a reset
+ * we keep a single block big enough for all the previous allocations, so
+ * that if we use the arena for per frame scratch buffers, we stop calling
+ * malloc after the first few frames.
+ */
+
+#include <stddef.h>
+
+typedef struct arena_block arena_block_t;
+
+/*
+ * Type: arena_t
+ * A linear allocator.  Zero initialize it before use.
+ */
+typedef struct arena {
+    arena_block_t   *blocks;    // Current block first.
+    size_t          capacity;   // Total size of all the blocks.
+    size_t          used;       // Bytes allocated since the last reset.
+    size_t          peak;       // Max value of used before a reset.
+    int             nb_mallocs; // Number of blocks allocated so far.
+} arena_t;
+
+/*
+ * Function: arena_alloc
+ * Allocate memory from an arena.
+ *
+ * The memory is aligned to 16 bytes, and valid until the next call to
+ * arena_reset.  Never call free on it.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/*
+ * Function: arena_calloc
+ * Same as arena_alloc, but initialize the memory to zero.
+ */
+void *arena_calloc(arena_t *arena, size_t n, size_t size);
+
+/*
+ * Function: arena_realloc
+ * Grow an allocation.
+ *
+ * If ptr is the last allocation of the arena we grow it in place, otherwise
+ * we allocate a new buffer and copy the data.
+ *
+ * Parameters:
+ *   arena      - An arena.
+ *   ptr        - Memory allocated from the arena, or NULL.
+ *   old_size   - Size of the current allocation.
+ *   size       - New size.
+ */
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size);
+
+/*
+ * Function: arena_reset
+ * Release all the allocations of an arena, but keep the memory for reuse.
+ */
+void arena_reset(arena_t *arena);
+
+/*
+ * Function: arena_release
+ * Release all the memory of an arena.
+ */
+void arena_release(arena_t *arena);
+
+#endif // ARENA_H
@@ -9,27 +9,35 @@
 
 #include "cache.h"
 #include "uthash.h"
+#include "utlist.h"
 #include <assert.h>
 #include <sys/time.h>
 
 typedef struct item item_t;
 struct item {
     UT_hash_handle  hh;
+    item_t          *prev, *next; // LRU list, least recently used first.
     char            key[256];
     void            *data;
     int             cost;
     int             (*delfunc)(void *data);
-    // Used to give a grace period before we remove an item from the cache.
-    double          grace_time;
+    // Time of the last use, used to give a grace period before we remove
+    // an item from the cache.
+    double          last_used;
 };
 
 struct cache {
-    item_t *items;
+    item_t *items;  // Hash table of all the items.
+    item_t *lru;    // Same items, sorted from least to most recently used.
     int size;
     int max_size;
     double grace_period;
+    cache_stats_t stats;
 };
 
+// Clock shared by all the caches.  If never set we use the system clock.
+static double g_clock = 0;
+
 static double get_unix_time(void)
 {
     struct timeval tv;
@@ -37,6 +45,16 @@ static double get_unix_time(void)
     return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
 }
 
+static double get_time(void)
+{
+    return g_clock ?: get_unix_time();
+}
+
+void cache_set_clock(double time)
+{
+    g_clock = time;
+}
+
 cache_t *cache_create(int size, double grace_period_sec)
 {
     cache_t *cache = calloc(1, sizeof(*cache));
@@ -47,22 +65,27 @@ cache_t *cache_create(int size, double grace_period_sec)
 
 static void cleanup(cache_t *cache)
 {
-    item_t *item, *tmp;
-    double time = get_unix_time();
-    HASH_ITER(hh, cache->items, item, tmp) {
-        if (!item->grace_time) {
-            item->grace_time = time;
-            continue;
-        }
-        if (time - item->grace_time < cache->grace_period) continue;
+    item_t *item;
+    double time = get_time();
+    int n = HASH_COUNT(cache->items);
 
+    // Remove the least recently used items first.  Since the list is sorted
+    // we can stop as soon as we reach an item still in its grace period.
+    // Each item is visited at most once, in case all of them refuse to go.
+    while ((item = cache->lru) && n--) {
+        if (time - item->last_used < cache->grace_period) return;
         if (item->delfunc && item->delfunc(item->data) == CACHE_KEEP) {
-            item->grace_time = 0;
+            // Give the item a new grace period.
+            cache->stats.keep_refusals++;
+            item->last_used = time;
+            DL_DELETE(cache->lru, item);
+            DL_APPEND(cache->lru, item);
             continue;
         }
         HASH_DEL(cache->items, item);
-        assert(item != cache->items);
+        DL_DELETE(cache->lru, item);
         cache->size -= item->cost;
+        cache->stats.evictions++;
         free(item);
         if (cache->size < cache->max_size) return;
     }
@@ -80,21 +103,36 @@ void cache_add(cache_t *cache, const void *key, int len, void *data,
     item->data = data;
     item->cost = cost;
     item->delfunc = delfunc;
+    item->last_used = get_time();
     HASH_ADD(hh, cache->items, key, len, item);
+    DL_APPEND(cache->lru, item);
 }
 
 void *cache_get(cache_t *cache, const void *key, int keylen)
 {
     item_t *item;
     HASH_FIND(hh, cache->items, key, keylen, item);
-    if (!item) return NULL;
-    item->grace_time = 0;
-    // Reinsert item on top of the hash list so that it stays sorted.
-    HASH_DEL(cache->items, item);
-    HASH_ADD(hh, cache->items, key, keylen, item);
+    if (!item) {
+        cache->stats.misses++;
+        return NULL;
+    }
+    cache->stats.hits++;
+    item->last_used = get_time();
+    // Move the item at the end of the LRU list.
+    if (item->next) {
+        DL_DELETE(cache->lru, item);
+        DL_APPEND(cache->lru, item);
+    }
     return item->data;
 }
 
+void *cache_peek(const cache_t *cache, const void *key, int keylen)
+{
+    item_t *item;
+    HASH_FIND(hh, cache->items, key, keylen, item);
+    return item ? item->data : NULL;
+}
+
 void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost)
 {
     item_t *item;
@@ -106,6 +144,12 @@ void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost)
     if (cache->size >= cache->max_size) cleanup(cache);
 }
 
+void cache_set_max_size(cache_t *cache, int size)
+{
+    cache->max_size = size;
+    if (cache->size >= cache->max_size) cleanup(cache);
+}
+
 /*
  * Function: cache_get_current_size
  * Return the total cost of all the currently cached items
@@ -114,3 +158,79 @@ int cache_get_current_size(const cache_t *cache)
 {
     return cache->size;
 }
+
+void cache_get_stats(const cache_t *cache, cache_stats_t *stats)
+{
+    *stats = cache->stats;
+    stats->size = cache->size;
+    stats->max_size = cache->max_size;
+    stats->nb_items = HASH_COUNT(cache->items);
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+
+static int test_delfunc(void *data)
+{
+    return *(int*)data ? CACHE_KEEP : 0;
+}
+
+static void test_cache(void)
+{
+    cache_t *cache;
+    cache_stats_t stats;
+    int i, keep[4] = {0, 1, 0, 0};
+
+    cache_set_clock(1000);
+    cache = cache_create(3, 1);
+    for (i = 0; i < 3; i++)
+        cache_add(cache, &i, sizeof(i), &keep[i], 1, test_delfunc);
+    // Still in grace period: we go over the max size.
+    i = 3;
+    cache_add(cache, &i, sizeof(i), &keep[i], 1, test_delfunc);
+    assert(cache_get_current_size(cache) == 4);
+
+    // Touch item 0, so that it becomes the most recently used.
+    cache_set_clock(1010);
+    i = 0;
+    assert(cache_get(cache, &i, sizeof(i)) == &keep[0]);
+    i = 4;
+    assert(cache_get(cache, &i, sizeof(i)) == NULL);
+    // Peeking doesn't touch the items or the counters.
+    i = 2;
+    assert(cache_peek(cache, &i, sizeof(i)) == &keep[2]);
+    i = 4;
+    assert(cache_peek(cache, &i, sizeof(i)) == NULL);
+
+    // Trigger a cleanup: item 1 refuses to go, so item 2 gets evicted,
+    // then item 3.
+    cache_set_cost(cache, &i, sizeof(i), 1); // Unknown key, no effect.
+    i = 0;
+    cache_set_cost(cache, &i, sizeof(i), 1);
+    cache_get_stats(cache, &stats);
+    assert(stats.hits == 1 && stats.misses == 1);
+    assert(stats.keep_refusals == 1);
+    assert(stats.evictions == 2);
+    assert(stats.nb_items == 2 && stats.size == 2);
+    i = 1;
+    assert(cache_get(cache, &i, sizeof(i)) == &keep[1]);
+    i = 2;
+    assert(cache_get(cache, &i, sizeof(i)) == NULL);
+
+    // Reduce the max size: item 0 gets evicted, item 1 still refuses.
+    cache_set_clock(1020);
+    cache_set_max_size(cache, 1);
+    cache_get_stats(cache, &stats);
+    assert(stats.evictions == 3 && stats.nb_items == 1);
+    assert(stats.max_size == 1);
+    i = 0;
+    assert(cache_get(cache, &i, sizeof(i)) == NULL);
+    cache_set_clock(0);
+}
+
+TEST_REGISTER(NULL, test_cache, TEST_AUTO);
+
+#endif
@@ -11,8 +11,13 @@
  * File: cache.h
  *
  * Utils to store values in cache.
+ *
+ * The items are kept sorted by last use time, so that getting, adding and
+ * evicting items are all constant time operations.
  */
 
+#include <stdint.h>
+
 /*
  * Enum: CACHE_KEEP
  * The cache delete function callback can return this value to tell the
@@ -26,6 +31,29 @@
  */
 typedef struct cache cache_t;
 
+/*
+ * Type: cache_stats_t
+ * Statistics about a cache usage, as returned by <cache_get_stats>.
+ *
+ * Attributes:
+ *   hits          - Number of successful cache_get calls.
+ *   misses        - Number of cache_get calls that didn't find the key.
+ *   evictions     - Number of items removed from the cache.
+ *   keep_refusals - Number of times a delete function returned CACHE_KEEP.
+ *   size          - Current total cost of the items.
+ *   max_size      - Max size as passed to cache_create.
+ *   nb_items      - Current number of items.
+ */
+typedef struct cache_stats {
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    evictions;
+    uint64_t    keep_refusals;
+    int         size;
+    int         max_size;
+    int         nb_items;
+} cache_stats_t;
+
 /*
  * Function: cache_create
  * Create a new cache with a given max size.
@@ -68,6 +96,15 @@ void cache_add(cache_t *cache, const void *key, int keylen, void *data,
  */
 void *cache_get(cache_t *cache, const void *key, int keylen);
 
+/*
+ * Function: cache_peek
+ * Same as cache_get, but without marking the item as used.
+ *
+ * Use it when we only want to know if an item is in the cache, so that we
+ * don't change the order of the evictions, or the hits and misses counters.
+ */
+void *cache_peek(const cache_t *cache, const void *key, int keylen);
+
 /*
  * Function: cache_set_cost
  * Change the cost of an item already in the cache.
@@ -76,9 +113,34 @@ void *cache_get(cache_t *cache, const void *key, int keylen);
  */
 void cache_set_cost(cache_t *cache, const void *key, int keylen, int cost);
 
+/*
+ * Function: cache_set_max_size
+ * Change the maximum size of a cache, evicting items if needed.
+ */
+void cache_set_max_size(cache_t *cache, int size);
+
 /*
  * Function: cache_get_current_size
  * Return the total cost of all the currently cached items
  */
 int cache_get_current_size(const cache_t *cache);
 
+/*
+ * Function: cache_get_stats
+ * Get the hits, misses and evictions counters of a cache.
+ */
+void cache_get_stats(const cache_t *cache, cache_stats_t *stats);
+
+/*
+ * Function: cache_set_clock
+ * Set the time used by all the caches for the grace periods.
+ *
+ * This is an optimization so that we don't have to read the system clock
+ * each time we access an item.  It should be called once per frame.  If
+ * never called, the caches use the system clock.
+ *
+ * Parameters:
+ *   time - Current time in seconds.
+ */
+void cache_set_clock(double time);
+
@@ -0,0 +1,480 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "disk_cache.h"
+#include "log.h"
+#include "uthash.h"
+#include "utlist.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <zlib.h> // For crc32.
+
+// Version of the index file format.
+#define INDEX_VERSION 1
+
+// Max number of entries removed at each update.
+#define MAX_EVICTIONS_PER_UPDATE 16
+
+// Min time between two saves of the index (sec).
+#define SAVE_INTERVAL 10.0
+
+typedef struct entry entry_t;
+struct entry {
+    UT_hash_handle  hh;
+    entry_t         *prev, *next; // LRU list, least recently used first.
+    char            *key;
+    char            *etag;
+    double          expiration;
+    double          last_access;
+    int             size;
+    uint32_t        crc;
+};
+
+struct disk_cache {
+    char        *dir;
+    int64_t     max_size;
+    int64_t     size;       // Total size of the entries data.
+    entry_t     *entries;   // Hash table of all the entries.
+    entry_t     *lru;       // All the entries sorted by last access.
+    bool        dirty;      // Set if the index changed since the last save.
+    double      last_save;
+};
+
+/*
+ * Type: index_header_t
+ * Header of the index file.
+ */
+typedef struct {
+    char        magic[4];   // "SWDC"
+    uint32_t    version;    // INDEX_VERSION.
+    uint32_t    nb;         // Number of records.
+    uint32_t    data_size;  // Size of the records after the header.
+    uint32_t    crc;        // crc32 of the records.
+} index_header_t;
+
+/*
+ * Type: index_record_t
+ * Record of an entry in the index file, followed by the key and the etag
+ * strings without null terminators.  The records are saved in LRU order.
+ */
+typedef struct {
+    double      expiration;
+    double      last_access;
+    int32_t     size;
+    uint32_t    crc;
+    uint16_t    key_len;
+    uint16_t    etag_len;
+} index_record_t;
+
+static double get_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
+}
+
+// Create a directory and its parents.
+static int mkdir_p(const char *path)
+{
+    char tmp[1024];
+    char *p;
+    snprintf(tmp, sizeof(tmp), "%s/", path);
+    for (p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if ((mkdir(tmp, S_IRWXU) != 0) && (errno != EEXIST)) return -1;
+        *p = '/';
+    }
+    return 0;
+}
+
+// Path of the file of an entry: the 64 bits FNV-1a hash of its key.
+static void get_path(const disk_cache_t *cache, const char *key,
+                     char *buf, int size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *key; key++) {
+        hash ^= (uint8_t)*key;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(buf, size, "%s/%016" PRIx64, cache->dir, hash);
+}
+
+static void entry_delete(disk_cache_t *cache, entry_t *entry,
+                         bool remove_file)
+{
+    char path[1024];
+    if (remove_file) {
+        get_path(cache, entry->key, path, sizeof(path));
+        unlink(path);
+    }
+    cache->size -= entry->size;
+    HASH_DEL(cache->entries, entry);
+    DL_DELETE(cache->lru, entry);
+    free(entry->key);
+    free(entry->etag);
+    free(entry);
+    cache->dirty = true;
+}
+
+static void entry_touch(disk_cache_t *cache, entry_t *entry)
+{
+    entry->last_access = get_time();
+    DL_DELETE(cache->lru, entry);
+    DL_APPEND(cache->lru, entry);
+    cache->dirty = true;
+}
+
+static int load_index(disk_cache_t *cache)
+{
+    char path[1024];
+    FILE *file;
+    index_header_t header;
+    index_record_t rec;
+    char *data = NULL, *p, *end;
+    entry_t *entry;
+    int i, ret = -1;
+
+    snprintf(path, sizeof(path), "%s/index", cache->dir);
+    file = fopen(path, "rb");
+    if (!file) return 0; // New cache.
+    if (fread(&header, sizeof(header), 1, file) != 1) goto end;
+    if (memcmp(header.magic, "SWDC", 4) != 0) goto end;
+    if (header.version != INDEX_VERSION) goto end;
+    data = malloc(header.data_size + 1);
+    if (header.data_size && fread(data, header.data_size, 1, file) != 1)
+        goto end;
+    if (crc32(0, (void*)data, header.data_size) != header.crc) goto end;
+
+    p = data;
+    end = data + header.data_size;
+    for (i = 0; i < header.nb; i++) {
+        if (p + sizeof(rec) > end) goto end;
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+        if (p + rec.key_len + rec.etag_len > end) goto end;
+        entry = calloc(1, sizeof(*entry));
+        entry->key = strndup(p, rec.key_len);
+        p += rec.key_len;
+        entry->etag = strndup(p, rec.etag_len);
+        p += rec.etag_len;
+        entry->expiration = rec.expiration;
+        entry->last_access = rec.last_access;
+        entry->size = rec.size;
+        entry->crc = rec.crc;
+        HASH_ADD_KEYPTR(hh, cache->entries, entry->key, strlen(entry->key),
+                        entry);
+        DL_APPEND(cache->lru, entry);
+        cache->size += entry->size;
+    }
+    ret = 0;
+end:
+    fclose(file);
+    free(data);
+    return ret;
+}
+
+// Remove all the files of the cache, used if we lost the index.
+static void remove_all_files(disk_cache_t *cache)
+{
+    DIR *dir;
+    struct dirent *dirent;
+    char path[1024];
+    const char *name;
+
+    dir = opendir(cache->dir);
+    if (!dir) return;
+    while ((dirent = readdir(dir))) {
+        name = dirent->d_name;
+        if (name[0] == '.') continue;
+        // Only touch the files we created.
+        if (strspn(name, "0123456789abcdef") != 16) continue;
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, name);
+        unlink(path);
+    }
+    closedir(dir);
+}
+
+disk_cache_t *disk_cache_create(const char *dir, int64_t max_size)
+{
+    disk_cache_t *cache = calloc(1, sizeof(*cache));
+    cache->dir = strdup(dir);
+    cache->max_size = max_size;
+    cache->last_save = get_time();
+    if (mkdir_p(dir)) LOG_W("Cannot create cache dir %s", dir);
+    if (load_index(cache) != 0) {
+        LOG_W("Invalid disk cache index, clear the cache: %s", dir);
+        while (cache->lru) entry_delete(cache, cache->lru, false);
+        remove_all_files(cache);
+        cache->size = 0;
+    }
+    return cache;
+}
+
+void disk_cache_delete(disk_cache_t *cache)
+{
+    if (!cache) return;
+    if (cache->dirty) disk_cache_save(cache);
+    while (cache->lru) entry_delete(cache, cache->lru, false);
+    free(cache->dir);
+    free(cache);
+}
+
+void disk_cache_set_max_size(disk_cache_t *cache, int64_t max_size)
+{
+    cache->max_size = max_size;
+}
+
+bool disk_cache_get_info(disk_cache_t *cache, const char *key,
+                         const char **etag, double *expiration)
+{
+    entry_t *entry;
+    HASH_FIND_STR(cache->entries, key, entry);
+    if (!entry) return false;
+    if (etag) *etag = entry->etag;
+    if (expiration) *expiration = entry->expiration;
+    return true;
+}
+
+void *disk_cache_read(disk_cache_t *cache, const char *key, int *size)
+{
+    entry_t *entry;
+    char path[1024];
+    FILE *file;
+    char *data = NULL;
+    bool ok = false;
+
+    HASH_FIND_STR(cache->entries, key, entry);
+    if (!entry) return NULL;
+    get_path(cache, key, path, sizeof(path));
+    file = fopen(path, "rb");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == entry->size) {
+            fseek(file, 0, SEEK_SET);
+            data = malloc(entry->size + 1);
+            ok = entry->size == 0 || fread(data, entry->size, 1, file) == 1;
+        }
+        fclose(file);
+    }
+    if (!ok || crc32(0, (void*)data, entry->size) != entry->crc) {
+        LOG_W("Corrupted disk cache entry: %s", key);
+        free(data);
+        entry_delete(cache, entry, true);
+        return NULL;
+    }
+    data[entry->size] = '\0';
+    if (size) *size = entry->size;
+    entry_touch(cache, entry);
+    return data;
+}
+
+int disk_cache_write(disk_cache_t *cache, const char *key,
+                     const void *data, int size,
+                     const char *etag, double expiration)
+{
+    entry_t *entry;
+    char path[1024], tmp_path[1024];
+    FILE *file;
+    bool ok;
+
+    etag = etag ?: "";
+    if (strlen(key) > UINT16_MAX || strlen(etag) > UINT16_MAX) return -1;
+    get_path(cache, key, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        LOG_W("Cannot write cache file %s", tmp_path);
+        return -1;
+    }
+    ok = size == 0 || fwrite(data, size, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        LOG_W("Cannot write cache file %s", path);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    HASH_FIND_STR(cache->entries, key, entry);
+    if (!entry) {
+        entry = calloc(1, sizeof(*entry));
+        entry->key = strdup(key);
+        HASH_ADD_KEYPTR(hh, cache->entries, entry->key, strlen(entry->key),
+                        entry);
+        DL_APPEND(cache->lru, entry);
+    }
+    cache->size += size - entry->size;
+    free(entry->etag);
+    entry->etag = strdup(etag);
+    entry->expiration = expiration;
+    entry->size = size;
+    entry->crc = crc32(0, data, size);
+    entry_touch(cache, entry);
+    return 0;
+}
+
+void disk_cache_remove(disk_cache_t *cache, const char *key)
+{
+    entry_t *entry;
+    HASH_FIND_STR(cache->entries, key, entry);
+    if (entry) entry_delete(cache, entry, true);
+}
+
+void disk_cache_update(disk_cache_t *cache)
+{
+    int i;
+    for (i = 0; i < MAX_EVICTIONS_PER_UPDATE; i++) {
+        if (cache->size <= cache->max_size || !cache->lru) break;
+        entry_delete(cache, cache->lru, true);
+    }
+    if (cache->dirty && get_time() - cache->last_save > SAVE_INTERVAL)
+        disk_cache_save(cache);
+}
+
+int disk_cache_save(disk_cache_t *cache)
+{
+    char path[1024], tmp_path[1024];
+    index_header_t header = {};
+    index_record_t rec;
+    entry_t *entry;
+    char *data, *p;
+    size_t size = 0;
+    FILE *file;
+    bool ok;
+
+    DL_FOREACH(cache->lru, entry) {
+        size += sizeof(rec) + strlen(entry->key) + strlen(entry->etag);
+        header.nb++;
+    }
+    data = p = malloc(size ?: 1);
+    DL_FOREACH(cache->lru, entry) {
+        memset(&rec, 0, sizeof(rec));
+        rec.expiration = entry->expiration;
+        rec.last_access = entry->last_access;
+        rec.size = entry->size;
+        rec.crc = entry->crc;
+        rec.key_len = strlen(entry->key);
+        rec.etag_len = strlen(entry->etag);
+        memcpy(p, &rec, sizeof(rec));
+        p += sizeof(rec);
+        memcpy(p, entry->key, rec.key_len);
+        p += rec.key_len;
+        memcpy(p, entry->etag, rec.etag_len);
+        p += rec.etag_len;
+    }
+    memcpy(header.magic, "SWDC", 4);
+    header.version = INDEX_VERSION;
+    header.data_size = size;
+    header.crc = crc32(0, (void*)data, size);
+
+    // Write to a temporary file first, so that we never lose the index.
+    snprintf(path, sizeof(path), "%s/index", cache->dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/index.tmp", cache->dir);
+    file = fopen(tmp_path, "wb");
+    ok = file != NULL;
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = (size == 0 || fwrite(data, size, 1, file) == 1) && ok;
+        ok = (fclose(file) == 0) && ok;
+    }
+    free(data);
+    if (!ok || rename(tmp_path, path) != 0) {
+        LOG_W("Cannot save cache index %s", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    cache->dirty = false;
+    cache->last_save = get_time();
+    return 0;
+}
+
+int64_t disk_cache_get_size(const disk_cache_t *cache)
+{
+    return cache->size;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include <assert.h>
+
+static void test_disk_cache(void)
+{
+    char dir[] = "/tmp/swe-disk-cache-XXXXXX";
+    char data[100], path[1024];
+    const char *etag;
+    disk_cache_t *cache;
+    FILE *file;
+    void *ret;
+    int size;
+
+    assert(mkdtemp(dir));
+    cache = disk_cache_create(dir, 250);
+    memset(data, 'x', sizeof(data));
+    disk_cache_write(cache, "a", data, 100, "etag-a", 10);
+    disk_cache_write(cache, "b", data, 100, NULL, 0);
+    disk_cache_write(cache, "c", data, 100, NULL, 0);
+    assert(disk_cache_get_size(cache) == 300);
+
+    // Reading 'a' makes 'b' the least recently used entry.
+    ret = disk_cache_read(cache, "a", &size);
+    assert(ret && size == 100 && memcmp(ret, data, 100) == 0);
+    free(ret);
+    disk_cache_update(cache);
+    assert(disk_cache_get_size(cache) == 200);
+    assert(!disk_cache_get_info(cache, "b", NULL, NULL));
+    get_path(cache, "b", path, sizeof(path));
+    assert(access(path, F_OK) != 0);
+
+    // Truncated file.
+    get_path(cache, "c", path, sizeof(path));
+    file = fopen(path, "wb");
+    fwrite(data, 50, 1, file);
+    fclose(file);
+    assert(!disk_cache_read(cache, "c", &size));
+    assert(!disk_cache_get_info(cache, "c", NULL, NULL));
+
+    // Reload from the index.
+    disk_cache_delete(cache);
+    cache = disk_cache_create(dir, 250);
+    assert(disk_cache_get_size(cache) == 100);
+    assert(disk_cache_get_info(cache, "a", &etag, NULL));
+    assert(strcmp(etag, "etag-a") == 0);
+    disk_cache_delete(cache);
+
+    // Corrupted index: we lose everything.
+    snprintf(path, sizeof(path), "%s/index", dir);
+    file = fopen(path, "r+b");
+    fseek(file, sizeof(index_header_t) + 2, SEEK_SET);
+    fputc('!', file);
+    fclose(file);
+    cache = disk_cache_create(dir, 250);
+    assert(disk_cache_get_size(cache) == 0);
+    get_path(cache, "a", path, sizeof(path));
+    assert(access(path, F_OK) != 0);
+    disk_cache_delete(cache);
+
+    snprintf(path, sizeof(path), "%s/index", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+TEST_REGISTER(NULL, test_disk_cache, TEST_AUTO);
+
+#endif
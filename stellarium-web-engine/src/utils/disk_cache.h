@@ -0,0 +1,129 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+/*
+ * File: disk_cache.h
+ * Size limited cache of files on disk.
+ *
+ * Each entry is stored in its own file, named after a hash of its key.
+ * The metadata of all the entries (key, etag, expiration, size, crc and
+ * last access time) is kept in a single index file, so that we don't need
+ * to touch the entries files until we actually read them.
+ *
+ * The entries are kept sorted by last access.  When the total size goes
+ * over the limit, <disk_cache_update> removes the least recently used
+ * ones, a few at a time so that we never block for long.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct disk_cache disk_cache_t;
+
+/*
+ * Function: disk_cache_create
+ * Open a disk cache, and load its index if it exists.
+ *
+ * Parameters:
+ *   dir      - Directory of the cache.  Created if needed.
+ *   max_size - Max total size of the entries data in bytes.
+ */
+disk_cache_t *disk_cache_create(const char *dir, int64_t max_size);
+
+/*
+ * Function: disk_cache_delete
+ * Save the index and release the memory of a disk cache.
+ */
+void disk_cache_delete(disk_cache_t *cache);
+
+/*
+ * Function: disk_cache_set_max_size
+ * Change the max total size of the cache.
+ */
+void disk_cache_set_max_size(disk_cache_t *cache, int64_t max_size);
+
+/*
+ * Function: disk_cache_get_info
+ * Get the http cache info of an entry without reading its data.
+ *
+ * Parameters:
+ *   cache      - A disk cache.
+ *   key        - Key of the entry.
+ *   etag       - Get the etag of the entry.  Valid until the entry is
+ *                written or removed.  Can be NULL.
+ *   expiration - Get the expiration time of the entry.  Can be NULL.
+ *
+ * Return:
+ *   false if the entry is not in the cache.
+ */
+bool disk_cache_get_info(disk_cache_t *cache, const char *key,
+                         const char **etag, double *expiration);
+
+/*
+ * Function: disk_cache_read
+ * Read the data of an entry.
+ *
+ * If the file is missing, or its size or crc don't match the index (for
+ * example after a truncated write), the entry is removed and we return
+ * NULL.
+ *
+ * Return:
+ *   The data, followed by an extra null byte so that text data are null
+ *   terminated.  The caller should free it.
+ */
+void *disk_cache_read(disk_cache_t *cache, const char *key, int *size);
+
+/*
+ * Function: disk_cache_write
+ * Add or replace an entry.
+ *
+ * The data is first written to a temporary file, so that a crash never
+ * leaves a partially written entry.
+ *
+ * Return:
+ *   0 on success.
+ */
+int disk_cache_write(disk_cache_t *cache, const char *key,
+                     const void *data, int size,
+                     const char *etag, double expiration);
+
+/*
+ * Function: disk_cache_remove
+ * Remove an entry and its file.
+ */
+void disk_cache_remove(disk_cache_t *cache, const char *key);
+
+/*
+ * Function: disk_cache_update
+ * Evict some entries if we are over the size limit, and save the index
+ * if it changed since a while.
+ *
+ * Should be called regularly.
+ */
+void disk_cache_update(disk_cache_t *cache);
+
+/*
+ * Function: disk_cache_save
+ * Save the index file.
+ *
+ * Return:
+ *   0 on success.
+ */
+int disk_cache_save(disk_cache_t *cache);
+
+/*
+ * Function: disk_cache_get_size
+ * Return the total size of the entries data.
+ */
+int64_t disk_cache_get_size(const disk_cache_t *cache);
+
+#endif // DISK_CACHE_H
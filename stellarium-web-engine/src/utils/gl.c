@@ -7,6 +7,8 @@
  * repository.
  */
 
+#ifndef NO_GL
+
 #include "gl.h"
 
 #include <assert.h>
@@ -414,3 +416,5 @@ void gl_update_uniform(gl_shader_t *shader, const char *name, ...)
     }
     va_end(args);
 }
+
+#endif // NO_GL
@@ -0,0 +1,194 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "profiler.h"
+#include "json-builder.h"
+
+#include <string.h>
+#include <time.h>
+
+// Max number of modules we keep track of in each frame.
+#define MAX_MODULES 64
+
+typedef struct {
+    const char  *id;
+    double      times[PROFILE_POST_RENDER + 1];
+} module_times_t;
+
+typedef struct {
+    double          times[PROFILE_PHASES_NB];
+    int             counts[PROFILE_COUNTERS_NB];
+    int             nb_modules;
+    module_times_t  modules[MAX_MODULES];
+} frame_t;
+
+static const char *PHASES_NAMES[PROFILE_PHASES_NB] = {
+    [PROFILE_UPDATE]        = "update",
+    [PROFILE_RENDER]        = "render",
+    [PROFILE_POST_RENDER]   = "post_render",
+    [PROFILE_PAINT_FINISH]  = "paint_finish",
+};
+
+static const char *COUNTERS_NAMES[PROFILE_COUNTERS_NB] = {
+    [PROFILE_TILES_VISITED] = "tiles_visited",
+    [PROFILE_TILES_LOADED]  = "tiles_loaded",
+    [PROFILE_POINTS]        = "points",
+    [PROFILE_LABELS]        = "labels",
+};
+
+// Ring buffer of the last frames.
+static struct {
+    frame_t frames[PROFILER_NB_FRAMES];
+    int     nb;         // Total number of recorded frames.
+} g_profiler = {};
+
+static frame_t *current_frame(void)
+{
+    int i = (g_profiler.nb + PROFILER_NB_FRAMES - 1) % PROFILER_NB_FRAMES;
+    return &g_profiler.frames[i];
+}
+
+double profiler_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void profiler_new_frame(void)
+{
+    g_profiler.nb++;
+    memset(current_frame(), 0, sizeof(frame_t));
+}
+
+static module_times_t *get_module(frame_t *frame, const char *id)
+{
+    int i;
+    // Modules ids are static strings, so most of the time comparing the
+    // pointers is enough.
+    for (i = 0; i < frame->nb_modules; i++) {
+        if (frame->modules[i].id == id) return &frame->modules[i];
+    }
+    for (i = 0; i < frame->nb_modules; i++) {
+        if (strcmp(frame->modules[i].id, id) == 0) return &frame->modules[i];
+    }
+    if (frame->nb_modules >= MAX_MODULES) return NULL;
+    frame->modules[frame->nb_modules].id = id;
+    return &frame->modules[frame->nb_modules++];
+}
+
+void profiler_add_time(const char *module, int phase, double dt)
+{
+    module_times_t *m;
+    frame_t *frame = current_frame();
+    if (!module) {
+        frame->times[phase] += dt;
+        return;
+    }
+    if (phase > PROFILE_POST_RENDER) return;
+    m = get_module(frame, module);
+    if (m) m->times[phase] += dt;
+}
+
+void profiler_count(int counter, int n)
+{
+    current_frame()->counts[counter] += n;
+}
+
+int profiler_get_count(int counter)
+{
+    return current_frame()->counts[counter];
+}
+
+static json_value *frame_to_json(const frame_t *frame)
+{
+    int i, j;
+    json_value *ret, *modules, *module, *counts;
+
+    ret = json_object_new(0);
+    for (i = 0; i < PROFILE_PHASES_NB; i++) {
+        json_object_push(ret, PHASES_NAMES[i],
+                         json_double_new(frame->times[i] * 1000));
+    }
+    modules = json_object_push(ret, "modules", json_object_new(0));
+    for (i = 0; i < frame->nb_modules; i++) {
+        module = json_object_push(modules, frame->modules[i].id,
+                                  json_object_new(0));
+        for (j = 0; j <= PROFILE_POST_RENDER; j++) {
+            json_object_push(module, PHASES_NAMES[j],
+                    json_double_new(frame->modules[i].times[j] * 1000));
+        }
+    }
+    counts = json_object_push(ret, "counts", json_object_new(0));
+    for (i = 0; i < PROFILE_COUNTERS_NB; i++) {
+        json_object_push(counts, COUNTERS_NAMES[i],
+                         json_integer_new(frame->counts[i]));
+    }
+    return ret;
+}
+
+json_value *profiler_to_json(void)
+{
+    int i, n;
+    json_value *ret;
+    const frame_t *frame;
+
+    ret = json_array_new(0);
+    n = g_profiler.nb;
+    if (n > PROFILER_NB_FRAMES) n = PROFILER_NB_FRAMES;
+    for (i = g_profiler.nb - n; i < g_profiler.nb; i++) {
+        frame = &g_profiler.frames[i % PROFILER_NB_FRAMES];
+        json_array_push(ret, frame_to_json(frame));
+    }
+    return ret;
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include "utils_json.h"
+#include <assert.h>
+#include <math.h>
+
+static void test_profiler(void)
+{
+    int i;
+    json_value *json, *frame, *modules, *counts;
+    double render_time;
+    const char *id = "test";
+
+    for (i = 0; i < PROFILER_NB_FRAMES + 2; i++) {
+        profiler_new_frame();
+        profiler_add_time(NULL, PROFILE_PAINT_FINISH, 0.001);
+        profiler_add_time(id, PROFILE_RENDER, i / 1000.);
+        profiler_add_time(id, PROFILE_RENDER, 0.001);
+        profiler_count(PROFILE_POINTS, i);
+    }
+    json = profiler_to_json();
+    assert(json->type == json_array);
+    assert(json->u.array.length == PROFILER_NB_FRAMES);
+    // Last frame.
+    frame = json->u.array.values[PROFILER_NB_FRAMES - 1];
+    assert(fabs(json_get_attr_f(frame, "paint_finish", 0) - 1) < 1e-9);
+    modules = json_get_attr(frame, "modules", json_object);
+    assert(modules && json_get_attr(modules, "test", json_object));
+    render_time = json_get_attr_f(json_get_attr(modules, "test", json_object),
+                                  "render", 0);
+    assert(fabs(render_time - (PROFILER_NB_FRAMES + 2)) < 1e-9);
+    counts = json_get_attr(frame, "counts", json_object);
+    assert(json_get_attr_i(counts, "points", 0) == PROFILER_NB_FRAMES + 1);
+    assert(profiler_get_count(PROFILE_POINTS) == PROFILER_NB_FRAMES + 1);
+    json_builder_free(json);
+}
+
+TEST_REGISTER(NULL, test_profiler, TEST_AUTO);
+
+#endif
@@ -0,0 +1,110 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * File: profiler.h
+ * Simple frame profiler.
+ *
+ * We keep, for the last PROFILER_NB_FRAMES frames, the time spent by each
+ * module in its update, render and post_render methods, the time of some
+ * global phases of the frame, and a few counters (tiles visited, points
+ * rendered...).
+ */
+
+#include "json.h"
+
+// Number of frames kept in the profiler ring buffer.
+#define PROFILER_NB_FRAMES 60
+
+/*
+ * Enum: PROFILE_PHASE
+ * The measured phases of a frame.
+ *
+ * The first three are also measured per module.
+ */
+enum {
+    PROFILE_UPDATE = 0,
+    PROFILE_RENDER,
+    PROFILE_POST_RENDER,
+    PROFILE_PAINT_FINISH,   // Flush of the renderer.
+    PROFILE_PHASES_NB
+};
+
+/*
+ * Enum: PROFILE_COUNTER
+ * The per frame counters.
+ */
+enum {
+    PROFILE_TILES_VISITED = 0,  // Healpix tiles iterated by the renderers.
+    PROFILE_TILES_LOADED,       // Hips tiles parsed and ready.
+    PROFILE_POINTS,             // Points sent to the renderer.
+    PROFILE_LABELS,             // Labels laid out.
+    PROFILE_COUNTERS_NB
+};
+
+/*
+ * Function: profiler_get_time
+ * Return a monotonic time in seconds, to measure durations.
+ */
+double profiler_get_time(void);
+
+/*
+ * Function: profiler_new_frame
+ * Start recording a new frame in the ring buffer.
+ */
+void profiler_new_frame(void);
+
+/*
+ * Function: profiler_add_time
+ * Add a duration to one of the phases of the current frame.
+ *
+ * Parameters:
+ *   module - Id of the module, or NULL for the global phases time.
+ *   phase  - One of the <PROFILE_PHASE> values.
+ *   dt     - Duration in seconds.
+ */
+void profiler_add_time(const char *module, int phase, double dt);
+
+/*
+ * Function: profiler_count
+ * Increase one of the counters of the current frame.
+ *
+ * Parameters:
+ *   counter    - One of the <PROFILE_COUNTER> values.
+ *   n          - Value to add.
+ */
+void profiler_count(int counter, int n);
+
+/*
+ * Function: profiler_get_count
+ * Return the value of one of the counters of the current frame.
+ */
+int profiler_get_count(int counter);
+
+/*
+ * Function: profiler_to_json
+ * Return the recorded frames as a json array, oldest frame first.
+ *
+ * Each frame is an object of the form (all times in ms):
+ *
+ *   {
+ *     "update": 1.2, "render": 5.3, "post_render": 0.1,
+ *     "paint_finish": 2.0,
+ *     "modules": {"stars": {"update": 0.1, "render": 1.1,
+ *                           "post_render": 0}, ...},
+ *     "counts": {"tiles_visited": 120, "tiles_loaded": 2,
+ *                "points": 3000, "labels": 25}
+ *   }
+ */
+json_value *profiler_to_json(void);
+
+#endif // PROFILER_H
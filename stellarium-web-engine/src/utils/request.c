@@ -10,32 +10,50 @@
 #ifndef NO_LIBCURL
 
 #include "request.h"
+#include "disk_cache.h"
+#include "trace.h"
+#include "utlist.h"
 #include "utstring.h"
 
 #include <assert.h>
 #include <curl/curl.h>
-#include <errno.h>
+#include <dirent.h>
 #include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <sys/stat.h>
+#include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #ifndef LOG_E
 #   define LOG_E
 #endif
 
-#ifndef PATH_MAX
-#   define PATH_MAX 1024
-#endif
-
 #define MAX_NB  16
 
+// Default max size of the disk cache.
+#define CACHE_MAX_SIZE (512 * 1024 * 1024LL)
+
+// Min time between two updates of the transfers (sec).
+#define UPDATE_INTERVAL (16.0 / 1000)
+
+// Max number of running transfers when we start a request of a given
+// priority, so that the low priority requests always leave some room
+// for the visible data.
+static const int MAX_NB_FOR_PRIORITY[REQUEST_PRIORITY_NB] = {
+    [REQUEST_VISIBLE]       = MAX_NB,
+    [REQUEST_PREFETCH]      = MAX_NB - 4,
+    [REQUEST_CATALOG]       = MAX_NB - 4,
+    [REQUEST_BACKGROUND]    = MAX_NB / 2,
+};
+
 // static data.
 static struct {
     CURLM        *curlm;
-    char         *cache_dir;
+    disk_cache_t *cache;
     int          nb; // Number of current running handles.
+    request_t    *queue; // Requests waiting to start.
+    double       last_update;
 } g = {};
 
 struct request
@@ -48,36 +66,19 @@ struct request
     void        *data;          // Actual data.
     int         size;
     bool        done;           // Request finished
-    char        *local_path;    // Data saved to this file
+    bool        cached;         // Data should be read from the disk cache.
 
     struct curl_slist *headers;
     char        *etag;
     double      expiration;     // Unix time expiration date.
+    double      trace_start;    // Trace time when the request started.
+    int         priority;
+    bool        queued;         // Set while in the queue.
+    request_t   *next, *prev;   // In the queue.
 };
 
-static const char *request_get_file(request_t *req, int *status_code);
-
-static void *read_file(const char *path, int *size)
-{
-    FILE *file;
-    char *ret;
-    int read_size __attribute__((unused));
-    int size_default;
-
-    size = size ?: &size_default; // Allow to pass NULL as size;
-    file = fopen(path, "rb");
-    if (!file) return NULL;
-    assert(file);
-    fseek(file, 0, SEEK_END);
-    *size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    ret = malloc(*size + 1);
-    read_size = fread(ret, *size, 1, file);
-    assert(read_size == 1 || *size == 0);
-    ret[*size] = '\0';
-    fclose(file);
-    return ret;
-}
+static size_t write_callback(
+        char *ptr, size_t size, size_t nmemb, void *userdata);
 
 static double get_unix_time(void)
 {
@@ -86,88 +87,86 @@ static double get_unix_time(void)
     return tv.tv_sec + tv.tv_usec / 1000. / 1000.;
 }
 
-static bool file_exists(const char *path)
+static void save_cache(void)
 {
-    FILE *file;
-    if ((file = fopen(path, "r"))) {
-        fclose(file);
-        return true;
-    }
-    return false;
+    if (g.cache) disk_cache_save(g.cache);
 }
 
 /*
- * Create directories for a given file path.
+ * Remove the files of the old cache layout, where each url was saved
+ * directly in the cache directory, with the '/' and ':' replaced by '_',
+ * next to a '.info' file holding its etag and expiration date.
+ *
+ * The cache directory can be shared with other applications, so we only
+ * remove the files that come with a '.info' file.
  */
-static int ensure_dir(const char *path)
+static void remove_old_cache_files(const char *cache_dir)
 {
-    char tmp[PATH_MAX];
-    char *p;
-    strcpy(tmp, path);
-    for (p = tmp + 1; *p; p++) {
-        if (*p != '/') continue;
-        *p = '\0';
-        if ((mkdir(tmp, S_IRWXU) != 0) && (errno != EEXIST)) return -1;
-        *p = '/';
+    DIR *dir;
+    struct dirent *dirent;
+    char path[1024];
+    const char *name;
+    int len;
+
+    dir = opendir(cache_dir);
+    if (!dir) return;
+    while ((dirent = readdir(dir))) {
+        name = dirent->d_name;
+        len = strlen(name);
+        if (strncmp(name, "http", 4) != 0) continue;
+        if (len < 5 || strcmp(name + len - 5, ".info") != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, name);
+        unlink(path);
+        path[strlen(path) - 5] = '\0'; // Remove the '.info'.
+        unlink(path);
     }
-    return 0;
+    closedir(dir);
 }
 
-static char *create_local_path(const char *url, const char *suffix)
+void request_init(const char *cache_dir)
 {
-    char *ret;
-    int i, r;
-    r = asprintf(&ret, "%s/%s%s", g.cache_dir, url, suffix ?: "");
-    if (r == -1) LOG_E("Error");
-    for (i = strlen(g.cache_dir) + 1; ret[i]; i++) {
-        if (ret[i] == '/' || ret[i] == ':')
-            ret[i] = '_';
+    char path[1024];
+    assert(cache_dir);
+    if (!g.curlm) {
+        g.curlm = curl_multi_init();
+        atexit(save_cache);
     }
-    ensure_dir(ret);
-    return ret;
+    disk_cache_delete(g.cache);
+    // No index yet: this is the first run since we changed the cache
+    // layout, so we can get rid of the old files.
+    snprintf(path, sizeof(path), "%s/swe-requests/index", cache_dir);
+    if (access(path, F_OK) != 0) remove_old_cache_files(cache_dir);
+    snprintf(path, sizeof(path), "%s/swe-requests", cache_dir);
+    g.cache = disk_cache_create(path, CACHE_MAX_SIZE);
 }
 
-void request_init(const char *cache_dir)
+void request_set_cache_max_size(int64_t size)
 {
-    assert(cache_dir);
-    if (!g.curlm) g.curlm = curl_multi_init();
-    free(g.cache_dir);
-    g.cache_dir = strdup(cache_dir);
+    assert(g.cache);
+    disk_cache_set_max_size(g.cache, size);
 }
 
 request_t *request_create(const char *url)
 {
-    char *local_path, *info_path;
-    char etag[128];
+    const char *etag;
     double expiration;
-    FILE *file;
-    int r;
     request_t *req = calloc(1, sizeof(*req));
     req->url = strdup(url);
 
     assert(strchr(url, ':')); // Make sure we have a protocol.
 
-    // Check for cache info.
-    local_path = create_local_path(url, NULL);
-    info_path = create_local_path(url, ".info");
-    if (file_exists(local_path) && file_exists(info_path)) {
-        file = fopen(info_path, "r");
-        r = fscanf(file, "etag: %s\n", etag);
-        if (r == 1) req->etag = strdup(etag);
-        r = fscanf(file, "expiration: %lf\n", &expiration);
-        if (r == 1) req->expiration = expiration;
-        fclose(file);
-
+    // Check for cache info.  We only read the index here, the data is
+    // read from the disk the first time we need it.
+    if (disk_cache_get_info(g.cache, url, &etag, &expiration)) {
+        if (*etag) req->etag = strdup(etag);
+        req->expiration = expiration;
         // If the cached version is not expired yet just use it.
         if (req->expiration && req->expiration > get_unix_time()) {
-            req->local_path = strdup(local_path);
+            req->cached = true;
             req->status_code = 200;
             req->done = true;
         }
     }
-
-    free(local_path);
-    free(info_path);
     return req;
 }
 
@@ -176,35 +175,31 @@ int request_is_finished(const request_t *req)
     return req->handle == NULL;
 }
 
+void request_set_priority(request_t *req, int priority)
+{
+    assert(priority >= 0 && priority < REQUEST_PRIORITY_NB);
+    req->priority = priority;
+}
+
 void request_delete(request_t *req)
 {
     if (!req) return;
-    if (req->handle) LOG_E("Aborting request not implemented yet!");
+    if (req->queued) DL_DELETE(g.queue, req);
+    // Abort the transfer.
+    if (req->handle) {
+        curl_multi_remove_handle(g.curlm, req->handle);
+        curl_easy_cleanup(req->handle);
+        g.nb--;
+    }
     if (req->data != utstring_body(&req->data_buf)) free(req->data);
     utstring_done(&req->data_buf);
     utstring_done(&req->header_buf);
     free(req->url);
-    free(req->local_path);
     free(req->etag);
     if (req->headers) curl_slist_free_all(req->headers);
     free(req);
 }
 
-static void save_cache(const char *url, const char *path, const char *etag,
-                       double expiration)
-{
-    char *info_path;
-    FILE *file;
-    int r;
-    r = asprintf(&info_path, "%s.info", path);
-    if (r == -1) LOG_E("Error");
-    file = fopen(info_path, "w");
-    fprintf(file, "etag: %s\n", etag);
-    fprintf(file, "expiration: %.0f\n", expiration);
-    fclose(file);
-    free(info_path);
-}
-
 static bool header_find(const char *header, const char *re,
                         char *buf, int buf_size)
 {
@@ -231,14 +226,10 @@ static void on_done(request_t *req)
 {
     char buf[128] = {};
     const char *header;
-    const char *path;
-
-    assert(!req->local_path);
 
     // The resource didn't change.
     if (req->status_code / 100 == 3) {
-        req->local_path = create_local_path(req->url, NULL);
-        assert(file_exists(req->local_path));
+        req->cached = true;
     }
 
     if (req->status_code / 100 != 2) goto end;
@@ -254,56 +245,109 @@ static void on_done(request_t *req)
         req->expiration = get_unix_time() + atof(buf);
     }
     // For the moment we save all the files in the cache as long as they
-    // have an etag.  We also never clean the cache!
+    // have an etag.  The disk cache removes the least recently used ones
+    // when it gets too big.
     if (req->etag) {
-        path = request_get_file(req, NULL);
-        save_cache(req->url, path, req->etag, req->expiration);
+        disk_cache_write(g.cache, req->url, req->data, req->size,
+                         req->etag, req->expiration);
     }
 
 end:
     return;
 }
 
+static void start(request_t *req)
+{
+    int r;
+    char *tmp;
+
+    req->handle = curl_easy_init();
+    utstring_init(&req->data_buf);
+    utstring_init(&req->header_buf);
+    curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, &req->data_buf);
+    curl_easy_setopt(req->handle, CURLOPT_HEADERDATA, &req->header_buf);
+    curl_easy_setopt(req->handle, CURLOPT_URL, req->url);
+    curl_easy_setopt(req->handle, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(req->handle, CURLOPT_PRIVATE, req);
+    curl_easy_setopt(req->handle, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYPEER, 0);
+    curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYHOST, 0);
+    // curl_easy_setopt(req->handle, CURLOPT_VERBOSE, 1);
+    if (req->etag) {
+        r = asprintf(&tmp, "If-None-Match: \"%s\"", req->etag);
+        if (r == -1) LOG_E("Error");
+        req->headers = curl_slist_append(req->headers, tmp);
+        free(tmp);
+    }
+    if (req->headers)
+        curl_easy_setopt(req->handle, CURLOPT_HTTPHEADER, req->headers);
+
+    curl_multi_add_handle(g.curlm, req->handle);
+    req->trace_start = trace_get_time();
+    g.nb++;
+}
+
+// Start the queued requests by order of priority, and in order of arrival
+// for a given priority.
+static void start_queued(void)
+{
+    int priority;
+    request_t *req, *tmp;
+
+    for (priority = 0; priority < REQUEST_PRIORITY_NB; priority++) {
+        DL_FOREACH_SAFE(g.queue, req, tmp) {
+            if (g.nb >= MAX_NB_FOR_PRIORITY[priority]) return;
+            if (req->priority != priority) continue;
+            DL_DELETE(g.queue, req);
+            req->queued = false;
+            start(req);
+        }
+    }
+}
+
 static void update(void)
 {
     int nb, msgs_in_queue;
     CURLMsg *msg;
     CURL *handle;
     request_t *req;
-    static double last = 0;
+    double now = get_unix_time();
 
-    // Avoid loading too many resources too fast to keep a good framerate.
-    if ((get_unix_time() - last) < 16.0 / 1000) return;
+    // We get called for each request polled, only update once per tick.
+    if (now - g.last_update < UPDATE_INTERVAL) return;
+    g.last_update = now;
 
     assert(g.curlm);
+    disk_cache_update(g.cache);
+    start_queued();
     curl_multi_perform(g.curlm, &nb);
     if (nb == g.nb) return;
     while ((msg = curl_multi_info_read(g.curlm, &msgs_in_queue))) {
-        if (msg->msg == CURLMSG_DONE) {
-            handle = msg->easy_handle;
-            curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&req);
-            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE,
-                                      &req->status_code);
-            // Convention: returns a server timeout if the connection failed.
-            if (!req->status_code && msg->data.result)
-                req->status_code = 598;
-            g.nb--;
-            curl_multi_remove_handle(g.curlm, handle);
-            curl_easy_cleanup(handle);
-            req->handle = NULL;
-            req->done = true;
-            if (req->status_code / 100 == 2) {
-                req->size = utstring_len(&req->data_buf);
-                // Add a 0 byte at the end of the data, this is useful for
-                // text resources.
-                utstring_bincpy(&req->data_buf, "", 1);
-                req->data = utstring_body(&req->data_buf);
-            }
-            on_done(req);
-            last = get_unix_time();
-            break;
+        if (msg->msg != CURLMSG_DONE) continue;
+        handle = msg->easy_handle;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&req);
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &req->status_code);
+        // Convention: returns a server timeout if the connection failed.
+        if (!req->status_code && msg->data.result)
+            req->status_code = 598;
+        g.nb--;
+        curl_multi_remove_handle(g.curlm, handle);
+        curl_easy_cleanup(handle);
+        req->handle = NULL;
+        req->done = true;
+        if (req->status_code / 100 == 2) {
+            req->size = utstring_len(&req->data_buf);
+            // Add a 0 byte at the end of the data, this is useful for
+            // text resources.
+            utstring_bincpy(&req->data_buf, "", 1);
+            req->data = utstring_body(&req->data_buf);
         }
+        on_done(req);
+        trace_add("request", "request", req->url, req->trace_start);
     }
+    // Reuse the slots of the finished transfers right away.
+    start_queued();
 }
 
 static size_t write_callback(
@@ -317,58 +361,15 @@ static size_t write_callback(
 
 static void req_update(request_t *req)
 {
-    int r;
-    char *tmp;
     assert(g.curlm); // Check that request_init was called!
     if (req->done) return;
-    if (!req->handle && g.nb < MAX_NB) {
-        req->handle = curl_easy_init();
-        utstring_init(&req->data_buf);
-        utstring_init(&req->header_buf);
-        curl_easy_setopt(req->handle, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(req->handle, CURLOPT_WRITEDATA, &req->data_buf);
-        curl_easy_setopt(req->handle, CURLOPT_HEADERDATA, &req->header_buf);
-        curl_easy_setopt(req->handle, CURLOPT_URL, req->url);
-        curl_easy_setopt(req->handle, CURLOPT_FAILONERROR, 1);
-        curl_easy_setopt(req->handle, CURLOPT_PRIVATE, req);
-        curl_easy_setopt(req->handle, CURLOPT_FOLLOWLOCATION, 1);
-        curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYPEER, 0);
-        curl_easy_setopt(req->handle, CURLOPT_SSL_VERIFYHOST, 0);
-        // curl_easy_setopt(req->handle, CURLOPT_VERBOSE, 1);
-        if (req->etag) {
-            r = asprintf(&tmp, "If-None-Match: \"%s\"", req->etag);
-            if (r == -1) LOG_E("Error");
-            req->headers = curl_slist_append(req->headers, tmp);
-            free(tmp);
-        }
-        if (req->headers)
-            curl_easy_setopt(req->handle, CURLOPT_HTTPHEADER, req->headers);
-
-        curl_multi_add_handle(g.curlm, req->handle);
-        g.nb++;
+    if (!req->handle && !req->queued) {
+        DL_APPEND(g.queue, req);
+        req->queued = true;
     }
-
     update();
 }
 
-static const char *request_get_file(request_t *req, int *status_code)
-{
-    FILE *file;
-    if (!req->local_path) {
-        req_update(req);
-        if (req->done && req->status_code / 100 == 2) {
-            req->local_path = create_local_path(req->url, NULL);
-            file = fopen(req->local_path, "wb");
-            if (!file) perror(NULL);
-            assert(file);
-            fwrite(utstring_body(&req->data_buf), 1, req->size, file);
-            fclose(file);
-        }
-    }
-    if (status_code) *status_code = req->status_code;
-    return req->local_path;
-}
-
 const void *request_get_data(request_t *req, int *size, int *status_code)
 {
     req_update(req);
@@ -377,9 +378,21 @@ const void *request_get_data(request_t *req, int *size, int *status_code)
         if (size) *size = 0;
         return NULL;
     }
-    // Local file, copy it into the data buffer.
-    if (!req->data && req->local_path) {
-        req->data = read_file(req->local_path, &req->size);
+    // Cached data, read it from the disk.
+    if (!req->data && req->cached) {
+        req->data = disk_cache_read(g.cache, req->url, &req->size);
+        // The file got evicted or corrupted: download it again.
+        if (!req->data) {
+            req->cached = false;
+            req->done = false;
+            req->status_code = 0;
+            request_make_fresh(req);
+            utstring_done(&req->data_buf);
+            utstring_done(&req->header_buf);
+            if (req->headers) curl_slist_free_all(req->headers);
+            req->headers = NULL;
+            return request_get_data(req, size, status_code);
+        }
     }
     if (size) *size = req->size;
     return req->data;
@@ -391,11 +404,123 @@ void request_make_fresh(request_t *req)
     req->etag = NULL;
 }
 
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+/*
+ * Those tests need a local http server, so they don't run automatically.
+ * Start tools/test-http-server.py and run the tests with the "request"
+ * filter.  SWE_TEST_SERVER can be set to change the server url.
+ */
+
+#include "tests.h"
+#include <unistd.h>
+
+// Poll some requests until they are all finished.
+static void wait_requests(request_t **reqs, int nb, double timeout)
+{
+    int i, code, nb_done;
+    double start = get_unix_time();
+    while (true) {
+        for (i = 0, nb_done = 0; i < nb; i++) {
+            request_get_data(reqs[i], NULL, &code);
+            nb_done += code != 0;
+        }
+        if (nb_done == nb) return;
+        assert(get_unix_time() - start < timeout);
+        usleep(1000);
+    }
+}
+
+static void test_request(void)
+{
+    const char *server = getenv("SWE_TEST_SERVER") ?: "http://localhost:8000";
+    request_t *slow[MAX_NB], *fast[32], *visible;
+    char url[256];
+    int i, code;
+    double start;
+    const char *data;
+    char cache_dir[] = "/tmp/swe-test-request-XXXXXX";
+    char path[1024];
+    const char *old_files[] = {"http___host_a", "http___host_a.info",
+                               "other", "other.info"};
+    FILE *file;
+
+    // Start with an empty cache, with only some files of the old cache
+    // layout that should get removed.
+    assert(mkdtemp(cache_dir));
+    for (i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, old_files[i]);
+        file = fopen(path, "w");
+        fclose(file);
+    }
+    request_init(cache_dir);
+    for (i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, old_files[i]);
+        assert((access(path, F_OK) == 0) == (i >= 2));
+    }
+
+    // Background requests cannot take all the slots, so that a visible
+    // request can still start right away.
+    for (i = 0; i < MAX_NB; i++) {
+        snprintf(url, sizeof(url), "%s/delay/5000/slow%d", server, i);
+        slow[i] = request_create(url);
+        request_set_priority(slow[i], REQUEST_BACKGROUND);
+        request_get_data(slow[i], NULL, &code);
+    }
+    snprintf(url, sizeof(url), "%s/delay/0/visible", server);
+    visible = request_create(url);
+    wait_requests(&visible, 1, 2.0);
+    request_get_data(visible, NULL, &code);
+    assert(code == 200);
+    assert(g.nb == MAX_NB_FOR_PRIORITY[REQUEST_BACKGROUND]);
+    request_delete(visible);
+
+    // Abort the running and queued requests.
+    for (i = 0; i < MAX_NB; i++) request_delete(slow[i]);
+    assert(g.nb == 0 && !g.queue);
+
+    // All the transfers that finished are processed at the same time.
+    for (i = 0; i < 32; i++) {
+        snprintf(url, sizeof(url), "%s/delay/0/fast%d", server, i);
+        fast[i] = request_create(url);
+    }
+    start = get_unix_time();
+    wait_requests(fast, 32, 2.0);
+    assert(get_unix_time() - start < 32 * UPDATE_INTERVAL);
+    for (i = 0; i < 32; i++) request_delete(fast[i]);
+
+    // The second time we get a 304 and read the data from the disk cache.
+    // The third time the entry got evicted meanwhile, so we have to
+    // download it again.
+    snprintf(url, sizeof(url), "%s/delay/0/cached", server);
+    disk_cache_remove(g.cache, url);
+    for (i = 0; i < 3; i++) {
+        visible = request_create(url);
+        if (i == 2) disk_cache_remove(g.cache, url);
+        wait_requests(&visible, 1, 2.0);
+        data = request_get_data(visible, NULL, &code);
+        assert(code == (i == 1 ? 304 : 200));
+        assert(data && strcmp(data, "/delay/0/cached") == 0);
+        assert(disk_cache_get_info(g.cache, url, NULL, NULL));
+        request_delete(visible);
+    }
+}
+
+TEST_REGISTER(NULL, test_request, 0);
+
+#endif
+
 #else // NO_LIBCURL
 
 #ifdef REQUEST_DUMMY
 
+// Dummy implementation that never gets any data from the network.  Used by
+// the headless native build, where the assets are read from local files.
+
 #include "request.h"
+#include <stdbool.h>
 #include <stdlib.h>
 
 struct request
@@ -406,6 +531,10 @@ void request_init(const char *cache_dir)
 {
 }
 
+void request_set_cache_max_size(int64_t size)
+{
+}
+
 request_t *request_create(const char *url)
 {
     return calloc(1, sizeof(request_t));
@@ -416,6 +545,10 @@ int request_is_finished(const request_t *req)
     return true;
 }
 
+void request_set_priority(request_t *req, int priority)
+{
+}
+
 void request_delete(request_t *req)
 {
     free(req);
@@ -427,6 +560,10 @@ const void *request_get_data(request_t *req, int *size, int *status_code)
     return NULL;
 }
 
+void request_make_fresh(request_t *req)
+{
+}
+
 #endif // REQUEST_DUMMY
 
 #endif // NO_LIBCURL
@@ -7,13 +7,47 @@
  * repository.
  */
 
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <stdint.h>
 
 typedef struct request request_t;
 
+/*
+ * Enum: REQUEST_PRIORITY
+ * Priority classes of the requests.
+ *
+ * When all the download slots are used, the waiting requests start by
+ * order of priority.  The low priority requests never take all the slots,
+ * so that the visible data can always start quickly.
+ *
+ *   REQUEST_VISIBLE    - Data needed to render the current view.  This is
+ *                        the default.
+ *   REQUEST_PREFETCH   - Data we predict we will need soon.
+ *   REQUEST_CATALOG    - Catalogs files.
+ *   REQUEST_BACKGROUND - Anything else that can wait.
+ */
+enum {
+    REQUEST_VISIBLE = 0,
+    REQUEST_PREFETCH,
+    REQUEST_CATALOG,
+    REQUEST_BACKGROUND,
+
+    REQUEST_PRIORITY_NB
+};
+
 void request_init(const char *cache_dir);
+// Set the max size of the disk cache in bytes.
+void request_set_cache_max_size(int64_t size);
 request_t *request_create(const char *url);
 int request_is_finished(const request_t *req);
+// Change the priority of a request that didn't start yet.
+void request_set_priority(request_t *req, int priority);
+// Delete a request, aborting the transfer if it is running.
 void request_delete(request_t *req);
 const void *request_get_data(request_t *req, int *size, int *status_code);
 // Don't use cache even if we have a local copy.
 void request_make_fresh(request_t *req);
+
+#endif // REQUEST_H
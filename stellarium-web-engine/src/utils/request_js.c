@@ -13,6 +13,16 @@
 
 #define MAX_NB  16 // Max number of concurrent requests.
 
+// Max number of running requests when we start a request of a given
+// priority, so that the low priority requests always leave some room
+// for the visible data.
+static const int MAX_NB_FOR_PRIORITY[REQUEST_PRIORITY_NB] = {
+    [REQUEST_VISIBLE]       = MAX_NB,
+    [REQUEST_PREFETCH]      = MAX_NB - 4,
+    [REQUEST_CATALOG]       = MAX_NB - 4,
+    [REQUEST_BACKGROUND]    = MAX_NB / 2,
+};
+
 struct request
 {
     char        *url;
@@ -21,11 +31,16 @@ struct request
     bool        done;
     void        *data;
     int         size;
+    double      trace_start;    // Trace time when the request started.
+    int         priority;
+    bool        queued;         // Set while in the queue.
+    request_t   *next, *prev;   // In the queue.
 };
 
 
 static struct {
     int nb;     // Number of current running requests.
+    request_t *queue; // Requests waiting to start.
 } g = {};
 
 static bool url_has_extension(const char *str, const char *ext);
@@ -40,6 +55,11 @@ void request_init(const char *cache_dir)
     assert(url_has_extension("http://xyz.test.jpg#xyz", ".jpg"));
 }
 
+void request_set_cache_max_size(int64_t size)
+{
+    // The browser manages the cache.
+}
+
 request_t *request_create(const char *url)
 {
     request_t *req = calloc(1, sizeof(*req));
@@ -52,9 +72,16 @@ int request_is_finished(const request_t *req)
     return req->done;
 }
 
+void request_set_priority(request_t *req, int priority)
+{
+    assert(priority >= 0 && priority < REQUEST_PRIORITY_NB);
+    req->priority = priority;
+}
+
 void request_delete(request_t *req)
 {
     if (!req) return;
+    if (req->queued) DL_DELETE(g.queue, req);
     if (req->handle) {
         emscripten_async_wget2_abort(req->handle - 1);
         g.nb--;
@@ -107,6 +134,7 @@ static void onload(unsigned int _, void *arg, void *data, unsigned int size)
     req->size = size;
     req->done = true;
     g.nb--;
+    trace_add("request", "request", req->url, req->trace_start);
 }
 
 static void onerror(unsigned int _, void *arg, int err, const char *msg)
@@ -118,22 +146,49 @@ static void onerror(unsigned int _, void *arg, int err, const char *msg)
     req->status_code = err ?: 499;
     req->done = true;
     g.nb--;
+    trace_add("request", "request", req->url, req->trace_start);
 }
 
 static void onprogress(unsigned int _, void *arg, int nb_bytes, int size)
 {
 }
 
-const void *request_get_data(request_t *req, int *size, int *status_code)
+static void start(request_t *req)
 {
     int handle;
-    if (!req->done && !req->handle && g.nb < MAX_NB) {
-        handle = emscripten_async_wget2_data(
-                req->url, "GET", NULL, req, false,
-                onload, onerror, onprogress);
-        req->handle = handle + 1; // So that we cannot get 0.
-        g.nb++;
+    handle = emscripten_async_wget2_data(
+            req->url, "GET", NULL, req, false,
+            onload, onerror, onprogress);
+    req->handle = handle + 1; // So that we cannot get 0.
+    req->trace_start = trace_get_time();
+    g.nb++;
+}
+
+// Start the queued requests by order of priority, and in order of arrival
+// for a given priority.
+static void start_queued(void)
+{
+    int priority;
+    request_t *req, *tmp;
+
+    for (priority = 0; priority < REQUEST_PRIORITY_NB; priority++) {
+        DL_FOREACH_SAFE(g.queue, req, tmp) {
+            if (g.nb >= MAX_NB_FOR_PRIORITY[priority]) return;
+            if (req->priority != priority) continue;
+            DL_DELETE(g.queue, req);
+            req->queued = false;
+            start(req);
+        }
+    }
+}
+
+const void *request_get_data(request_t *req, int *size, int *status_code)
+{
+    if (!req->done && !req->handle && !req->queued) {
+        DL_APPEND(g.queue, req);
+        req->queued = true;
     }
+    start_queued();
     if (size) *size = req->size;
     if (status_code) *status_code= req->status_code;
     return req->data;
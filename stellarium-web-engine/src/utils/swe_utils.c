@@ -14,6 +14,10 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#if HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
 #include "webp/decode.h"
 #include <zlib.h>
 
@@ -93,64 +97,158 @@ void img_write(const uint8_t *img, int w, int h, int bpp, const char *path)
     stbi_write_png(path, w, h, bpp, img, 0);
 }
 
-int z_uncompress(void *dest, int dest_size, const void *src, int src_size)
+#if HAVE_PTHREAD
+
+// Key of the per thread inflate streams.  The destructor releases the zlib
+// state when a worker thread exits.
+static pthread_key_t g_inflate_key;
+static pthread_once_t g_inflate_once = PTHREAD_ONCE_INIT;
+
+static void del_inflate_stream(void *stream)
 {
-    stbi_zlib_decode_buffer(dest, dest_size, src, src_size);
+    inflateEnd(stream);
+    free(stream);
+}
+
+static void init_inflate_key(void)
+{
+    pthread_key_create(&g_inflate_key, del_inflate_stream);
+}
+
+#else
+
+static z_stream *g_inflate_stream = NULL;
+
+#endif
+
+// Return a per thread inflate stream, so that we don't reallocate the zlib
+// state and window each time we uncompress a block.
+static z_stream *get_inflate_stream(int window_bits)
+{
+    z_stream *stream;
+
+#if HAVE_PTHREAD
+    pthread_once(&g_inflate_once, init_inflate_key);
+    stream = pthread_getspecific(g_inflate_key);
+#else
+    stream = g_inflate_stream;
+#endif
+    if (stream)
+        return inflateReset2(stream, window_bits) == Z_OK ? stream : NULL;
+
+    stream = calloc(1, sizeof(*stream));
+    if (inflateInit2(stream, window_bits) != Z_OK) {
+        free(stream);
+        return NULL;
+    }
+#if HAVE_PTHREAD
+    pthread_setspecific(g_inflate_key, stream);
+#else
+    g_inflate_stream = stream;
+#endif
+    return stream;
+}
+
+int z_inflate(void *dest, int dest_size, const void *src, int src_size,
+              int window_bits)
+{
+    int err;
+    z_stream *stream = get_inflate_stream(window_bits);
+    if (!stream) return -1;
+    stream->next_in = (void*)src;
+    stream->avail_in = src_size;
+    stream->next_out = dest;
+    stream->avail_out = dest_size;
+    err = inflate(stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        LOG_E("Cannot uncompress data: %s", stream->msg ?: "");
+        return -1;
+    }
     return 0;
 }
 
+int z_uncompress(void *dest, int dest_size, const void *src, int src_size)
+{
+    return z_inflate(dest, dest_size, src, src_size, 15);
+}
+
 // Uncompress gz file data.
-// Only used for the star source data.
-// XXX: need to get a more robust version!
 void *z_uncompress_gz(const void *src, int src_size, int *out_size)
 {
-    int err;
     uint32_t isize;
-    const uint8_t *d = src;
     void *ret = NULL;
-    uint8_t id1, id2, cm, flg;
-    z_stream stream = {};
-    assert(src_size >= 10);
-
-    id1 = *d++;
-    id2 = *d++;
-    cm = *d++;
-    flg = *d++;
-
-    if (id1 != 0x1f) goto error;
-    if (id2 != 0x8b) goto error;
-    if (cm != 8) goto error; // Only support deflate.
-    if (flg != 8) goto error; // Only support this flags for the moment!
-
-    d += 6;
-    d += strlen((const char*)d) + 1;
 
+    if (src_size < 18) goto error;
     // Size at position 4 of the 8 bytes footer at the end of file.
     memcpy(&isize, src + src_size - 4, 4);
-    *out_size = isize;
     ret = malloc(isize + 1);
-
-    stream.next_in = (void*)d;
-    stream.avail_in = src_size - 8 - ((const void*)d - src);
-    stream.next_out = ret;
-    stream.avail_out = isize;
-    err = inflateInit2(&stream, -15);
-    if (err != Z_OK) goto error;
-    err = inflate(&stream, Z_FINISH);
-    if (err != Z_STREAM_END) goto error;
-    inflateEnd(&stream);
-
+    if (!ret) goto error;
+    if (z_inflate(ret, isize, src, src_size, 15 + 16)) goto error;
     ((char*)ret)[isize] = '\0';
+    *out_size = isize;
     return ret;
 
 error:
     LOG_E("Cannot uncompress gz file!");
-    if (stream.msg) LOG_E("%s", stream.msg);
     free(ret);
     *out_size = 0;
     return NULL;
 }
 
+// Size of the chunks of uncompressed data in z_iter_gz_lines.  The buffer
+// only grows if a single line doesn't fit.
+#define LINES_CHUNK_SIZE (64 * 1024)
+
+int z_iter_gz_lines(const void *src, int src_size, void *user,
+                    int (*f)(void *user, const char *line, int len))
+{
+    z_stream stream = {};
+    char *buf, *line, *end;
+    int buf_size = LINES_CHUNK_SIZE, len = 0, err, ret = 0;
+
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) return -1;
+    buf = malloc(buf_size);
+    stream.next_in = (void*)src;
+    stream.avail_in = src_size;
+    while (true) {
+        // Make sure we have room for at least a full chunk.
+        if (buf_size - len < LINES_CHUNK_SIZE / 2) {
+            buf_size *= 2;
+            buf = realloc(buf, buf_size);
+        }
+        stream.next_out = (void*)(buf + len);
+        stream.avail_out = buf_size - len;
+        err = inflate(&stream, Z_NO_FLUSH);
+        if (err != Z_OK && err != Z_STREAM_END) {
+            LOG_E("Cannot uncompress gz data: %s", stream.msg ?: "");
+            ret = -1;
+            goto end;
+        }
+        len = buf_size - stream.avail_out;
+        // Pass all the full lines, and keep the last partial line for the
+        // next chunk.
+        line = buf;
+        while ((end = memchr(line, '\n', len - (line - buf)))) {
+            if ((ret = f(user, line, end - line))) goto end;
+            line = end + 1;
+        }
+        len -= line - buf;
+        memmove(buf, line, len);
+        if (err == Z_STREAM_END) break;
+        if (!stream.avail_in) {
+            LOG_E("Truncated gz data");
+            ret = -1;
+            goto end;
+        }
+    }
+    if (len) ret = f(user, buf, len);
+
+end:
+    inflateEnd(&stream);
+    free(buf);
+    return ret;
+}
+
 bool str_endswith(const char *str, const char *end)
 {
     if (!str || !end) return false;
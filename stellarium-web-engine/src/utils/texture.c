@@ -8,7 +8,9 @@
  */
 
 #include "texture.h"
-#include "gl.h"
+#ifndef NO_GL
+#   include "gl.h"
+#endif
 
 #include <assert.h>
 #include <math.h>
@@ -24,6 +26,20 @@ static struct {
 static inline bool is_pow2(int n) {return (n & (n - 1)) == 0;}
 static inline int next_pow2(int x) {return pow(2, ceil(log(x) / log(2)));}
 
+// Create a new texture id.
+static uint32_t gen_texture_id(void)
+{
+#ifndef NO_GL
+    uint32_t id;
+    GL(glGenTextures(1, &id));
+    return id;
+#else
+    // Without GL we only need unique non zero ids.
+    static uint32_t last_id = 0;
+    return ++last_id;
+#endif
+}
+
 
 static void blit(const uint8_t *src, int src_w, int src_h, int bpp,
                  uint8_t *dst, int dst_w, int dst_h,
@@ -48,14 +64,20 @@ void texture_set_load_callback(void *user,
 
 void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
 {
+#ifndef NO_GL
     uint8_t *buff0 = NULL;
     int data_type = GL_UNSIGNED_BYTE;
+#endif
     assert(tex->id);
 
     tex->w = w;
     tex->h = h;
     tex->tex_w = next_pow2(w);
     tex->tex_h = next_pow2(h);
+#ifdef NO_GL
+    // No GL upload, just keep the number of channels as format.
+    tex->format = bpp;
+#else
     tex->format = (int[]){
         0, GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA
     }[bpp];
@@ -79,6 +101,7 @@ void texture_set_data(texture_t *tex, const void *data, int w, int h, int bpp)
 
     if (tex->flags & TF_MIPMAP)
         GL(glGenerateMipmap(GL_TEXTURE_2D));
+#endif
 }
 
 texture_t *texture_create(int w, int h, int bpp)
@@ -90,8 +113,12 @@ texture_t *texture_create(int w, int h, int bpp)
     tex->tex_h = next_pow2(h);
     tex->w = w;
     tex->h = h;
+#ifdef NO_GL
+    tex->format = bpp;
+#else
     tex->format = (int[]){0, 0, 0, GL_RGB, GL_RGBA}[bpp];
-    GL(glGenTextures(1, &tex->id));
+#endif
+    tex->id = gen_texture_id();
     return tex;
 }
 
@@ -101,7 +128,9 @@ void texture_release(texture_t *tex)
     tex->ref--;
     if (tex->ref) return;
     free(tex->url);
+#ifndef NO_GL
     if (tex->id) GL(glDeleteTextures(1, &tex->id));
+#endif
     free(tex);
 }
 
@@ -115,7 +144,7 @@ texture_t *texture_from_data(const void *data, int img_w, int img_h, int bpp,
     tex = calloc(1, sizeof(*tex));
     tex->ref = 1;
     tex->flags = flags;
-    GL(glGenTextures(1, &tex->id));
+    tex->id = gen_texture_id();
 
     if (x != 0 || y != 0 || w != img_w || h != img_h) {
         img = calloc(w * h, bpp);
@@ -149,7 +178,7 @@ bool texture_load(texture_t *tex, int *code)
     assert(g_callback.load);
     img = g_callback.load(g_callback.user, tex->url, code, &w, &h, &bpp);
     if (!img) return false;
-    GL(glGenTextures(1, &tex->id));
+    tex->id = gen_texture_id();
     texture_set_data(tex, img, w, h, bpp);
     free(img);
     return true;
@@ -0,0 +1,260 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "tile_pack.h"
+#include "log.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h> // For crc32.
+
+// Version of the pack format.  Also update tools/make-tile-pack.py.
+#define PACK_VERSION 1
+
+#define SURVEY_NAME_MAX 60
+
+/*
+ * Type: header_t
+ * Header at the beginning of a pack.
+ *
+ * The files data follow the header, each one followed by a null byte so
+ * that we can directly use text files.  At index_offset (aligned to 8
+ * bytes) we have the surveys table, then the sorted index.
+ */
+typedef struct {
+    char        magic[4];       // "SWPK"
+    uint32_t    version;        // PACK_VERSION.
+    uint32_t    nb_surveys;
+    uint32_t    nb_entries;
+    uint64_t    index_offset;
+} header_t;
+
+typedef struct {
+    uint32_t    hash;           // crc32 of the name.
+    char        name[SURVEY_NAME_MAX]; // Null terminated.
+} survey_t;
+
+typedef struct {
+    uint32_t    hash;           // Survey hash.
+    int32_t     order;
+    int64_t     pix;
+    uint64_t    offset;         // Offset of the data in the pack.
+    uint32_t    size;           // Size of the data, without the null byte.
+    uint32_t    padding;
+} entry_t;
+
+_Static_assert(sizeof(header_t) == 24, "");
+_Static_assert(sizeof(survey_t) == 64, "");
+_Static_assert(sizeof(entry_t) == 32, "");
+
+struct tile_pack {
+    const uint8_t   *data;
+    size_t          size;
+    const header_t  *header;
+    const survey_t  *surveys;
+    const entry_t   *entries;
+};
+
+static int entry_cmp_key(const entry_t *e, uint32_t hash, int order,
+                         int64_t pix)
+{
+    if (e->hash != hash) return e->hash < hash ? -1 : 1;
+    if (e->order != order) return e->order < order ? -1 : 1;
+    if (e->pix != pix) return e->pix < pix ? -1 : 1;
+    return 0;
+}
+
+static bool header_is_valid(const header_t *header, uint64_t file_size)
+{
+    uint64_t index_size;
+    if (memcmp(header->magic, "SWPK", 4) != 0) return false;
+    if (header->version != PACK_VERSION) return false;
+    if (header->index_offset % 8) return false;
+    index_size = (uint64_t)header->nb_surveys * sizeof(survey_t) +
+                 (uint64_t)header->nb_entries * sizeof(entry_t);
+    return header->index_offset >= sizeof(header_t) &&
+           header->index_offset + index_size <= file_size;
+}
+
+tile_pack_t *tile_pack_open(const char *path)
+{
+    tile_pack_t *pack;
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(header_t)) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    if (!header_is_valid(data, st.st_size)) {
+        LOG_W("Invalid tile pack: %s", path);
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    pack = calloc(1, sizeof(*pack));
+    pack->data = data;
+    pack->size = st.st_size;
+    pack->header = data;
+    pack->surveys = (const void*)(pack->data + pack->header->index_offset);
+    pack->entries = (const void*)(pack->surveys + pack->header->nb_surveys);
+    return pack;
+}
+
+void tile_pack_close(tile_pack_t *pack)
+{
+    if (!pack) return;
+    munmap((void*)pack->data, pack->size);
+    free(pack);
+}
+
+const void *tile_pack_get(const tile_pack_t *pack, uint32_t hash,
+                          int order, int64_t pix, int *size)
+{
+    int lo = 0, hi = pack->header->nb_entries - 1, mid, r;
+    const entry_t *entry;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        entry = &pack->entries[mid];
+        r = entry_cmp_key(entry, hash, order, pix);
+        if (r < 0) {
+            lo = mid + 1;
+        } else if (r > 0) {
+            hi = mid - 1;
+        } else {
+            if (entry->offset + entry->size >= pack->header->index_offset)
+                return NULL;
+            if (size) *size = entry->size;
+            return pack->data + entry->offset;
+        }
+    }
+    return NULL;
+}
+
+// Parse a tile path of the form Norder<order>/Dir<dir>/Npix<pix>.<ext>
+static bool parse_tile_path(const char *path, int *order, int64_t *pix)
+{
+    char *end;
+    if (strncmp(path, "Norder", 6) != 0) return false;
+    *order = strtol(path + 6, &end, 10);
+    if (strncmp(end, "/Dir", 4) != 0) return false;
+    strtol(end + 4, &end, 10);
+    if (strncmp(end, "/Npix", 5) != 0) return false;
+    *pix = strtoll(end + 5, &end, 10);
+    return *end == '.';
+}
+
+const void *tile_pack_get_path(const tile_pack_t *pack, const char *path,
+                               int *size)
+{
+    const survey_t *survey = NULL;
+    const char *file;
+    int i, len, name_len, order;
+    int64_t pix;
+
+    len = strcspn(path, "?");
+    for (i = 0; i < pack->header->nb_surveys; i++) {
+        name_len = strnlen(pack->surveys[i].name, SURVEY_NAME_MAX);
+        if (    name_len < len && path[name_len] == '/' &&
+                memcmp(path, pack->surveys[i].name, name_len) == 0) {
+            survey = &pack->surveys[i];
+            break;
+        }
+    }
+    if (!survey) return NULL;
+    file = path + name_len + 1;
+    len -= name_len + 1;
+    if (parse_tile_path(file, &order, &pix))
+        return tile_pack_get(pack, survey->hash, order, pix, size);
+    pix = crc32(0, (const void*)file, len);
+    return tile_pack_get(pack, survey->hash, -1, pix, size);
+}
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include <assert.h>
+#include <stdio.h>
+
+static int test_entry_cmp(const void *a_, const void *b_)
+{
+    const entry_t *a = a_, *b = b_;
+    return entry_cmp_key(a, b->hash, b->order, b->pix);
+}
+
+// Write a small pack, the same way tools/make-tile-pack.py does.
+static void write_test_pack(const char *path)
+{
+    // Each file is followed by a null byte, the last one also pads the
+    // index to 8 bytes.
+    const char blobs[] = "tile\0props\0dss\0";
+    header_t header = {"SWPK", PACK_VERSION, 2, 3, 24 + sizeof(blobs)};
+    survey_t surveys[2] = {{.name = "stars"}, {.name = "surveys/dss"}};
+    entry_t entries[3];
+    FILE *file;
+    int i;
+
+    for (i = 0; i < 2; i++)
+        surveys[i].hash = crc32(0, (void*)surveys[i].name,
+                                strlen(surveys[i].name));
+    entries[0] = (entry_t){surveys[0].hash, 0, 1, 24, 4};
+    entries[1] = (entry_t){surveys[0].hash, -1,
+                           crc32(0, (void*)"properties", 10), 29, 5};
+    entries[2] = (entry_t){surveys[1].hash, 3, 100, 35, 3};
+    qsort(entries, 3, sizeof(entry_t), test_entry_cmp);
+
+    file = fopen(path, "wb");
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(blobs, sizeof(blobs), 1, file);
+    fwrite(surveys, sizeof(surveys), 1, file);
+    fwrite(entries, sizeof(entries), 1, file);
+    fclose(file);
+}
+
+static void test_tile_pack(void)
+{
+    char path[] = "/tmp/swe-tile-pack-XXXXXX";
+    tile_pack_t *pack;
+    const char *data;
+    int size;
+
+    close(mkstemp(path));
+    write_test_pack(path);
+    pack = tile_pack_open(path);
+    assert(pack);
+    data = tile_pack_get_path(pack, "stars/Norder0/Dir0/Npix1.eph?v=2",
+                              &size);
+    assert(data && size == 4 && strcmp(data, "tile") == 0);
+    data = tile_pack_get_path(pack, "stars/properties", &size);
+    assert(data && strcmp(data, "props") == 0);
+    data = tile_pack_get_path(pack, "surveys/dss/Norder3/Dir0/Npix100.jpg",
+                              &size);
+    assert(data && strcmp(data, "dss") == 0);
+    assert(!tile_pack_get_path(pack, "stars/Norder0/Dir0/Npix2.eph", NULL));
+    assert(!tile_pack_get_path(pack, "stars/Norder0/Allsky.eph", NULL));
+    assert(!tile_pack_get_path(pack, "dso/properties", NULL));
+    tile_pack_close(pack);
+    unlink(path);
+}
+
+TEST_REGISTER(NULL, test_tile_pack, TEST_AUTO);
+
+#endif
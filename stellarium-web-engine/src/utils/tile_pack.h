@@ -0,0 +1,82 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef TILE_PACK_H
+#define TILE_PACK_H
+
+/*
+ * File: tile_pack.h
+ * Single file store for the files of several hips surveys.
+ *
+ * A pack is a blob of files, followed by a table of the surveys and an index
+ * of all the files sorted by (survey hash, order, pix).  The survey hash is
+ * the crc32 of the survey path relative to the root of the pack (for
+ * example 'surveys/milkyway').  The files that are not tiles (properties,
+ * Allsky...) use an order of -1, and the crc32 of their path relative to
+ * the survey as pix.
+ *
+ * The pack is memory mapped when opened, so getting a file is a binary
+ * search in the index, without any system call or allocation.
+ *
+ * The packs are created from a sky data directory with
+ * tools/make-tile-pack.py.  They are read only: a pack is an offline bundle
+ * of a fixed version of the surveys, see <asset_add_pack>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct tile_pack tile_pack_t;
+
+/*
+ * Function: tile_pack_open
+ * Open and map a pack file.
+ *
+ * Return:
+ *   NULL if the file doesn't exist or is not a valid pack.
+ */
+tile_pack_t *tile_pack_open(const char *path);
+
+/*
+ * Function: tile_pack_close
+ * Unmap a pack.  All the pointers returned by the pack become invalid.
+ */
+void tile_pack_close(tile_pack_t *pack);
+
+/*
+ * Function: tile_pack_get
+ * Get a file from its key.
+ *
+ * Parameters:
+ *   pack   - A pack.
+ *   hash   - crc32 of the survey path.
+ *   order  - Order of the tile, or -1 for the other files.
+ *   pix    - Pix of the tile, or crc32 of the file path.
+ *   size   - Get the size of the data.
+ *
+ * Return:
+ *   A pointer to the data in the pack, or NULL if not found.  The data is
+ *   followed by a null byte, not counted in the size, so that text files
+ *   can be used directly as strings.
+ */
+const void *tile_pack_get(const tile_pack_t *pack, uint32_t hash,
+                          int order, int64_t pix, int *size);
+
+/*
+ * Function: tile_pack_get_path
+ * Get a file from its path relative to the root of the pack.
+ *
+ * The url parameters (after a '?') are ignored, so we can directly use
+ * the urls of the hips files, for example
+ * 'stars/Norder1/Dir0/Npix12.eph?v=1'.
+ */
+const void *tile_pack_get_path(const tile_pack_t *pack, const char *path,
+                               int *size);
+
+#endif // TILE_PACK_H
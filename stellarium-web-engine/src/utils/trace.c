@@ -0,0 +1,223 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#include "trace.h"
+#include "json-builder.h"
+
+#if SWE_TRACE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
+// Default size of the events ring buffer.
+#define DEFAULT_MAX_EVENTS (1 << 16)
+
+typedef struct {
+    const char  *cat;
+    const char  *name;
+    char        detail[96];
+    double      ts;     // Start time (µs).
+    double      dur;    // Duration (µs).
+    int         tid;
+} event_t;
+
+static struct {
+    // Read without the lock by the hot paths, so always accessed with
+    // atomic operations.
+    bool        enabled;
+    event_t     *events;    // Ring buffer.
+    int         max_events;
+    uint64_t    nb;         // Total number of added events.
+    double      origin;     // Time of the trace start.
+    int         nb_threads;
+#if HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} g_trace = {
+#if HAVE_PTHREAD
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+// Small id of the current thread, used as trace 'tid'.
+static __thread int t_tid = 0;
+
+static void lock(void)
+{
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&g_trace.lock);
+#endif
+}
+
+static void unlock(void)
+{
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&g_trace.lock);
+#endif
+}
+
+static double get_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void trace_start(int max_events)
+{
+    lock();
+    max_events = max_events ?: DEFAULT_MAX_EVENTS;
+    if (max_events != g_trace.max_events) {
+        free(g_trace.events);
+        g_trace.events = calloc(max_events, sizeof(*g_trace.events));
+        g_trace.max_events = max_events;
+    }
+    g_trace.nb = 0;
+    g_trace.origin = get_time_us();
+    __atomic_store_n(&g_trace.enabled, true, __ATOMIC_RELEASE);
+    unlock();
+}
+
+void trace_stop(void)
+{
+    lock();
+    __atomic_store_n(&g_trace.enabled, false, __ATOMIC_RELEASE);
+    unlock();
+}
+
+bool trace_is_enabled(void)
+{
+    return __atomic_load_n(&g_trace.enabled, __ATOMIC_ACQUIRE);
+}
+
+double trace_get_time(void)
+{
+    if (!trace_is_enabled()) return 0;
+    return get_time_us();
+}
+
+void trace_add(const char *cat, const char *name, const char *detail,
+               double start)
+{
+    event_t *e;
+    double now;
+    if (!start || !trace_is_enabled()) return;
+    now = get_time_us();
+    lock();
+    if (!t_tid) t_tid = ++g_trace.nb_threads;
+    e = &g_trace.events[g_trace.nb++ % g_trace.max_events];
+    e->cat = cat;
+    e->name = name;
+    e->ts = start - g_trace.origin;
+    e->dur = now - start;
+    e->tid = t_tid;
+    e->detail[0] = '\0';
+    if (detail) snprintf(e->detail, sizeof(e->detail), "%s", detail);
+    unlock();
+}
+
+trace_scope_t trace_scope_begin(const char *cat, const char *name,
+                                const char *detail)
+{
+    return (trace_scope_t) {
+        .cat = cat,
+        .name = name,
+        .detail = detail,
+        .start = trace_get_time(),
+    };
+}
+
+void trace_scope_end(trace_scope_t *scope)
+{
+    trace_add(scope->cat, scope->name, scope->detail, scope->start);
+}
+
+json_value *trace_to_json(void)
+{
+    json_value *ret, *events, *event, *args;
+    const event_t *e;
+    uint64_t i, n;
+
+    ret = json_object_new(0);
+    events = json_object_push(ret, "traceEvents", json_array_new(0));
+    lock();
+    n = g_trace.nb < g_trace.max_events ? g_trace.nb : g_trace.max_events;
+    for (i = g_trace.nb - n; i < g_trace.nb; i++) {
+        e = &g_trace.events[i % g_trace.max_events];
+        event = json_array_push(events, json_object_new(0));
+        json_object_push(event, "name", json_string_new(e->name));
+        json_object_push(event, "cat", json_string_new(e->cat));
+        json_object_push(event, "ph", json_string_new("X"));
+        json_object_push(event, "ts", json_double_new(e->ts));
+        json_object_push(event, "dur", json_double_new(e->dur));
+        json_object_push(event, "pid", json_integer_new(1));
+        json_object_push(event, "tid", json_integer_new(e->tid));
+        if (*e->detail) {
+            args = json_object_push(event, "args", json_object_new(0));
+            json_object_push(args, "detail", json_string_new(e->detail));
+        }
+    }
+    unlock();
+    json_object_push(ret, "displayTimeUnit", json_string_new("ms"));
+    return ret;
+}
+
+#else // SWE_TRACE
+
+json_value *trace_to_json(void)
+{
+    json_value *ret;
+    ret = json_object_new(0);
+    json_object_push(ret, "traceEvents", json_array_new(0));
+    return ret;
+}
+
+#endif // SWE_TRACE
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS && SWE_TRACE
+
+#include "tests.h"
+#include "utils_json.h"
+#include <assert.h>
+
+static void test_trace(void)
+{
+    int i;
+    json_value *json, *events;
+
+    trace_add("test", "ignored", NULL, trace_get_time()); // Not started.
+    trace_start(4);
+    for (i = 0; i < 6; i++) {
+        TRACE_SCOPE_DETAIL("test", "scope", "a \"detail\"");
+    }
+    trace_stop();
+    {
+        TRACE_SCOPE("test", "ignored");
+    }
+    json = trace_to_json();
+    events = json_get_attr(json, "traceEvents", json_array);
+    assert(events && events->u.array.length == 4);
+    assert(strcmp(json_get_attr_s(events->u.array.values[0], "name"),
+                  "scope") == 0);
+    assert(strcmp(json_get_attr_s(events->u.array.values[0], "ph"),
+                  "X") == 0);
+    json_builder_free(json);
+}
+
+TEST_REGISTER(NULL, test_trace, TEST_AUTO);
+
+#endif
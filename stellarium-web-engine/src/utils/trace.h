@@ -0,0 +1,143 @@
+/* Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+ *
+ * This program is licensed under the terms of the GNU AGPL v3, or
+ * alternatively under a commercial licence.
+ *
+ * The terms of the AGPL v3 license can be found in the main directory of this
+ * repository.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * File: trace.h
+ * Record timed spans of the engine activity, and export them in the Chrome
+ * trace event json format, so that they can be inspected in Perfetto or
+ * chrome://tracing.
+ *
+ * The code is only compiled if SWE_TRACE is set (default in debug, see
+ * config.h), otherwise all the macros expand to nothing.  Even when
+ * compiled, nothing is recorded until we call trace_start.
+ *
+ * Usage:
+ *
+ *   void my_function(void)
+ *   {
+ *       TRACE_SCOPE("render", "my_function");
+ *       ...
+ *   } // The span ends when we exit the scope.
+ *
+ * For spans that don't fit in a C scope (like network requests), use
+ * trace_get_time to get the start time, and trace_add once the span ends.
+ */
+
+#include <stdbool.h>
+
+#include "json.h"
+
+/*
+ * Type: trace_scope_t
+ * Span started by TRACE_SCOPE, ended automatically at the end of the scope.
+ */
+typedef struct {
+    const char  *cat;
+    const char  *name;
+    const char  *detail;    // Must remain valid until the end of the scope.
+    double      start;      // Set to zero if we are not tracing.
+} trace_scope_t;
+
+#if SWE_TRACE
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/*
+ * Macro: TRACE_SCOPE
+ * Record a span until the end of the current scope.
+ *
+ * Parameters:
+ *   cat    - Category of the span (static string).
+ *   name   - Name of the span (static string).
+ */
+#define TRACE_SCOPE(cat, name) TRACE_SCOPE_DETAIL(cat, name, NULL)
+
+/*
+ * Macro: TRACE_SCOPE_DETAIL
+ * Same as TRACE_SCOPE, with an extra string (like an url) shown in the
+ * span arguments.
+ */
+#define TRACE_SCOPE_DETAIL(cat, name, detail) \
+    trace_scope_t TRACE_CONCAT(trace_scope_, __LINE__) \
+        __attribute__((cleanup(trace_scope_end))) = \
+        trace_scope_begin(cat, name, detail)
+
+/*
+ * Function: trace_start
+ * Start recording the spans.
+ *
+ * Parameters:
+ *   max_events - Size of the events ring buffer.  When it is full we
+ *                overwrite the oldest events.  Zero for a default value.
+ */
+void trace_start(int max_events);
+
+/*
+ * Function: trace_stop
+ * Stop recording the spans.  The already recorded events are kept until
+ * the next call to trace_start.
+ */
+void trace_stop(void);
+
+/*
+ * Function: trace_is_enabled
+ * Return whether we are currently recording.
+ */
+bool trace_is_enabled(void);
+
+/*
+ * Function: trace_get_time
+ * Return the current trace time in µs, or zero if we are not recording.
+ */
+double trace_get_time(void);
+
+/*
+ * Function: trace_add
+ * Add a complete span to the trace.
+ *
+ * Parameters:
+ *   cat    - Category of the span (static string).
+ *   name   - Name of the span (static string).
+ *   detail - Optional extra string, copied.
+ *   start  - Start time returned by trace_get_time.  If zero (we were not
+ *            recording when the span started) the span is ignored.
+ */
+void trace_add(const char *cat, const char *name, const char *detail,
+               double start);
+
+trace_scope_t trace_scope_begin(const char *cat, const char *name,
+                                const char *detail);
+void trace_scope_end(trace_scope_t *scope);
+
+/*
+ * Function: trace_to_json
+ * Return all the recorded events in the Chrome trace event format.
+ */
+json_value *trace_to_json(void);
+
+#else // SWE_TRACE
+
+#define TRACE_SCOPE(cat, name)
+#define TRACE_SCOPE_DETAIL(cat, name, detail)
+
+static inline void trace_start(int max_events) {}
+static inline void trace_stop(void) {}
+static inline bool trace_is_enabled(void) { return false; }
+static inline double trace_get_time(void) { return 0; }
+static inline void trace_add(const char *cat, const char *name,
+                             const char *detail, double start) {}
+json_value *trace_to_json(void);
+
+#endif // SWE_TRACE
+
+#endif // TRACE_H
@@ -105,18 +105,64 @@ uint8_t *img_read_from_mem(const void *data, int size,
  */
 void img_write(const uint8_t *img, int w, int h, int bpp, const char *path);
 
+/*
+ * Function: z_inflate
+ * Uncompress deflate data into a buffer of known size.
+ *
+ * This uses a per thread inflate context, so that uncompressing many small
+ * blocks doesn't reallocate the zlib state each time.
+ *
+ * Parameters:
+ *   dest           - Output buffer.
+ *   dest_size      - Size of the uncompressed data.
+ *   src            - Compressed data.
+ *   src_size       - Size of the compressed data.
+ *   window_bits    - Same as for zlib inflateInit2: 15 for zlib data,
+ *                    15 + 16 for gzip data, -15 for raw deflate data.
+ *
+ * Return:
+ *   0 on success, -1 in case of error.
+ */
+int z_inflate(void *dest, int dest_size, const void *src, int src_size,
+              int window_bits);
+
 /*
  * Function: z_uncompress
- * Like zlib uncompress, but using stb instead.
+ * Like zlib uncompress, but reuse the thread inflate context.
  */
 int z_uncompress(void *dest, int dest_size, const void *src, int src_size);
 
 /*
  * Function: z_uncompress_gz
  * uncompress gz data.
+ *
+ * The returned data is null terminated.  For big text files, prefer
+ * z_iter_gz_lines that doesn't need the full uncompressed data in memory.
  */
 void *z_uncompress_gz(const void *src, int src_size, int *out_size);
 
+/*
+ * Function: z_iter_gz_lines
+ * Uncompress gz text data and call a function for each line.
+ *
+ * The data is uncompressed by chunks, so that the memory used only depends
+ * on the longest line, not on the total size of the file.
+ *
+ * Parameters:
+ *   src        - Compressed gz data.
+ *   src_size   - Size of the compressed data.
+ *   user       - Data passed to the callback.
+ *   f          - Callback called for each line, without the trailing
+ *                newline.  The line is not null terminated.  Returning a
+ *                non zero value stops the iteration.
+ *
+ * Return:
+ *   0 on success, -1 in case of error, or the value returned by the
+ *   callback if it stopped the iteration.
+ */
+int z_iter_gz_lines(const void *src, int src_size, void *user,
+                    int (*f)(void *user, const char *line, int len));
+
 /*
  * Function: str_startswith
  * Test is a string starts with an other one.
@@ -10,7 +10,161 @@
 #include "worker.h"
 #include <string.h>
 
-#ifndef HAVE_PTHREAD
+// Possible values of the worker state attribute.
+enum {
+    STATE_IDLE = 0,
+    STATE_QUEUED,
+    STATE_RUNNING,
+    STATE_DONE,
+};
+
+#if HAVE_PTHREAD
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Max number of workers waiting for a thread.  When the queue is full
+// worker_iter just returns 0 and we try again on the next call.
+#define QUEUE_SIZE 256
+
+// Max number of threads in the pool.
+#define MAX_THREADS 32
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       threads[MAX_THREADS];
+    int             nb_threads;
+    int             nb_running;
+    // Ring buffer of the queued workers.
+    worker_t        *queue[QUEUE_SIZE];
+    int             start;
+    int             size;
+} g = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *thread_func(void *arg)
+{
+    worker_t *w;
+    pthread_mutex_lock(&g.lock);
+    while (true) {
+        while (!g.size) pthread_cond_wait(&g.cond, &g.lock);
+        w = g.queue[g.start];
+        g.start = (g.start + 1) % QUEUE_SIZE;
+        g.size--;
+        w->state = STATE_RUNNING;
+        g.nb_running++;
+        pthread_mutex_unlock(&g.lock);
+        w->ret = w->fn(w);
+        pthread_mutex_lock(&g.lock);
+        w->state = STATE_DONE;
+        g.nb_running--;
+    }
+    return NULL;
+}
+
+// Start the threads if needed.  Need to be called with the lock held.
+static int pool_start(int nb_threads)
+{
+    int i;
+    if (g.nb_threads) return -1;
+    if (nb_threads <= 0) {
+        // Default to one thread per cpu, keeping one for the main loop.
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if (nb_threads < 1) nb_threads = 1;
+    }
+    if (nb_threads > MAX_THREADS) nb_threads = MAX_THREADS;
+    for (i = 0; i < nb_threads; i++) {
+        if (pthread_create(&g.threads[i], NULL, thread_func, NULL) != 0)
+            break;
+        pthread_detach(g.threads[i]);
+    }
+    g.nb_threads = i;
+    return i ? 0 : -1;
+}
+
+int worker_pool_init(int nb_threads)
+{
+    int r;
+    pthread_mutex_lock(&g.lock);
+    r = pool_start(nb_threads);
+    pthread_mutex_unlock(&g.lock);
+    return r;
+}
+
+int worker_pool_get_nb_threads(void)
+{
+    int ret;
+    pthread_mutex_lock(&g.lock);
+    if (!g.nb_threads) pool_start(0);
+    ret = g.nb_threads;
+    pthread_mutex_unlock(&g.lock);
+    return ret;
+}
+
+int worker_pool_get_nb_pending(void)
+{
+    int ret;
+    pthread_mutex_lock(&g.lock);
+    ret = g.size + g.nb_running;
+    pthread_mutex_unlock(&g.lock);
+    return ret;
+}
+
+void worker_init(worker_t *w, int (*fn)(worker_t *w))
+{
+    memset(w, 0, sizeof(*w));
+    w->fn = fn;
+}
+
+int worker_iter(worker_t *w)
+{
+    int ret = 0;
+    pthread_mutex_lock(&g.lock);
+    if (!g.nb_threads) pool_start(0);
+    switch (w->state) {
+    case STATE_IDLE:
+        if (g.size >= QUEUE_SIZE) break;
+        g.queue[(g.start + g.size) % QUEUE_SIZE] = w;
+        g.size++;
+        w->state = STATE_QUEUED;
+        pthread_cond_signal(&g.cond);
+        break;
+    case STATE_DONE:
+        ret = 1;
+        break;
+    }
+    pthread_mutex_unlock(&g.lock);
+    return ret;
+}
+
+bool worker_is_running(worker_t *w)
+{
+    bool ret;
+    pthread_mutex_lock(&g.lock);
+    ret = w->state == STATE_QUEUED || w->state == STATE_RUNNING;
+    pthread_mutex_unlock(&g.lock);
+    return ret;
+}
+
+#else
+
+int worker_pool_init(int nb_threads)
+{
+    return -1;
+}
+
+int worker_pool_get_nb_threads(void)
+{
+    return 0;
+}
+
+int worker_pool_get_nb_pending(void)
+{
+    return 0;
+}
 
 void worker_init(worker_t *w, int (*fn)(worker_t *w))
 {
@@ -21,8 +175,8 @@ void worker_init(worker_t *w, int (*fn)(worker_t *w))
 int worker_iter(worker_t *w)
 {
     if (w->state) return 1;
-    w->fn(w);
-    w->state = 1;
+    w->ret = w->fn(w);
+    w->state = STATE_DONE;
     return 1;
 }
 
@@ -32,3 +186,37 @@ bool worker_is_running(worker_t *w)
 }
 
 #endif
+
+/******** TESTS ***********************************************************/
+
+#if COMPILE_TESTS
+
+#include "tests.h"
+#include <assert.h>
+
+static int test_worker_fn(worker_t *w)
+{
+    int *v = w->user;
+    (*v)++;
+    return 0;
+}
+
+static void test_worker(void)
+{
+    int i, values[8] = {};
+    worker_t workers[8];
+
+    for (i = 0; i < 8; i++) {
+        worker_init(&workers[i], test_worker_fn);
+        workers[i].user = &values[i];
+    }
+    for (i = 0; i < 8; i++) {
+        while (!worker_iter(&workers[i])) {}
+        assert(!worker_is_running(&workers[i]));
+        assert(values[i] == 1);
+    }
+}
+
+TEST_REGISTER(NULL, test_worker, TEST_AUTO);
+
+#endif
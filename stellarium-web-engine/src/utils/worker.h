@@ -14,6 +14,9 @@
  * A worker is simply a task that run in a thread pool.  We can create a worker
  * with <worker_init> and then run it by calling <worker_iter> as many times
  * as we want, until it returns a non zero value.
+ *
+ * If the build doesn't have pthread support (HAVE_PTHREAD set to 0), the
+ * worker function is directly executed by the first call to <worker_iter>.
  */
 
 #ifndef WORKER_H
@@ -31,6 +34,40 @@ struct worker
     int state;
 };
 
+/*
+ * Function: worker_pool_init
+ * Start the thread pool with a given number of threads.
+ *
+ * This is optional: if not called, the pool is automatically started the
+ * first time a worker runs, with one thread per cpu minus one.
+ *
+ * Parameters:
+ *   nb_threads - Number of threads in the pool, or zero for the default.
+ *
+ * Return:
+ *   0 on success, -1 if the pool was already started or if we don't have
+ *   thread support.
+ */
+int worker_pool_init(int nb_threads);
+
+/*
+ * Function: worker_pool_get_nb_threads
+ * Return the number of threads in the pool.
+ *
+ * Return zero if we don't have thread support, in which case the workers
+ * run directly in the calling thread.
+ */
+int worker_pool_get_nb_threads(void);
+
+/*
+ * Function: worker_pool_get_nb_pending
+ * Return the number of workers currently queued or running in the pool.
+ *
+ * This can be used by schedulers to avoid filling the queue with work
+ * that might not be needed anymore by the time a thread gets to it.
+ */
+int worker_pool_get_nb_pending(void);
+
 /*
  * Function: worker_init
  * Initialize the worker struct to run a given function in a thread.
@@ -42,7 +79,7 @@ void worker_init(worker_t *w, int (*fn)(worker_t *w));
  * Execute the worker function.
  *
  * This will attempt to start the worker function in a separate thread.
- * If the function is already running or if no thread is ready, it does
+ * If the function is already running or if the pool queue is full, it does
  * nothing.
  *
  * We can call this in a loop until it returns a non zero value to make it
@@ -55,7 +92,9 @@ int worker_iter(worker_t *worker);
 
 /*
  * Function: worker_is_running
- * Return whether a worker is currently running.
+ * Return whether a worker is currently queued or running.
+ *
+ * A worker for which this returns true must not be freed.
  */
 bool worker_is_running(worker_t *worker);
 
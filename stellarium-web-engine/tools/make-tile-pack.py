@@ -0,0 +1,95 @@
+#!/usr/bin/python3
+
+# Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+#
+# This program is licensed under the terms of the GNU AGPL v3, or
+# alternatively under a commercial licence.
+#
+# The terms of the AGPL v3 license can be found in the main directory of this
+# repository.
+
+# Pack all the hips surveys of a sky data directory into a single tile pack
+# file (see src/utils/tile_pack.h for the format).
+#
+# Every directory with a 'properties' file is a survey, named after its
+# path relative to the data directory.
+#
+# Usage: ./tools/make-tile-pack.py <data-dir> <output>
+#
+# The pack can then be mounted at the url of the data directory, for example
+# with: swe-bench -d apps/test-skydata -k skydata.pack
+
+import os
+import re
+import struct
+import sys
+import zlib
+
+VERSION = 1
+SURVEY_NAME_MAX = 60
+TILE_RE = re.compile(r'^Norder(\d+)/Dir\d+/Npix(\d+)\.')
+
+
+def crc32(s):
+    return zlib.crc32(s.encode()) & 0xffffffff
+
+
+def list_surveys(root):
+    for path, dirs, files in os.walk(root):
+        if 'properties' not in files:
+            continue
+        dirs[:] = []  # No survey inside a survey.
+        yield os.path.relpath(path, root)
+
+
+def list_files(root, survey):
+    survey_dir = os.path.join(root, survey)
+    for path, dirs, files in os.walk(survey_dir):
+        dirs.sort()
+        for name in sorted(files):
+            yield os.path.relpath(os.path.join(path, name), survey_dir)
+
+
+def make_pack(root, output):
+    surveys = sorted(list_surveys(root))
+    entries = {}
+    out = open(output, 'wb')
+    out.write(bytes(24))  # Header, written at the end.
+    offset = 24
+
+    for survey in surveys:
+        assert len(survey) < SURVEY_NAME_MAX, survey
+        survey_hash = crc32(survey)
+        for name in list_files(root, survey):
+            m = TILE_RE.match(name)
+            if m:
+                key = (survey_hash, int(m.group(1)), int(m.group(2)))
+            else:
+                key = (survey_hash, -1, crc32(name))
+            if key in entries:
+                print('Skip %s/%s: same key as another file' % (survey, name))
+                continue
+            data = open(os.path.join(root, survey, name), 'rb').read()
+            out.write(data + b'\0')
+            entries[key] = (offset, len(data))
+            offset += len(data) + 1
+
+    index_offset = (offset + 7) // 8 * 8
+    out.write(bytes(index_offset - offset))
+    for survey in surveys:
+        out.write(struct.pack('<I60s', crc32(survey), survey.encode()))
+    for key in sorted(entries):
+        out.write(struct.pack('<IiqQI4x', *key, *entries[key]))
+    out.seek(0)
+    out.write(struct.pack('<4sIIIQ', b'SWPK', VERSION, len(surveys),
+                          len(entries), index_offset))
+    out.close()
+    print('%s: %d surveys, %d files, %d bytes' %
+          (output, len(surveys), len(entries), offset))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print('Usage: %s <data-dir> <output>' % sys.argv[0])
+        sys.exit(-1)
+    make_pack(sys.argv[1], sys.argv[2])
@@ -0,0 +1,55 @@
+#!/usr/bin/python3
+
+# Stellarium Web Engine - Copyright (c) 2022 - Stellarium Labs SRL
+#
+# This program is licensed under the terms of the GNU AGPL v3, or
+# alternatively under a commercial licence.
+#
+# The terms of the AGPL v3 license can be found in the main directory of this
+# repository.
+
+# Minimal http server for the request tests (see src/utils/request.c).
+#
+# GET /delay/<ms>/<name> returns the path as text after <ms> milliseconds,
+# with an etag, or a 304 status if the client already has it.
+#
+# Usage: ./tools/test-http-server.py [port]
+
+import http.server
+import sys
+import time
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+
+    def do_GET(self):
+        parts = self.path.split('/')
+        if len(parts) < 4 or parts[1] != 'delay':
+            self.send_error(404)
+            return
+        time.sleep(int(parts[2]) / 1000)
+        body = self.path.encode()
+        etag = '"%08x"' % (hash(self.path) & 0xffffffff)
+        try:
+            if self.headers.get('If-None-Match') == etag:
+                self.send_response(304)
+                self.end_headers()
+                return
+            self.send_response(200)
+            self.send_header('ETag', etag)
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        except (BrokenPipeError, ConnectionResetError):
+            pass  # The request has been aborted.
+
+    def log_message(self, *args):
+        pass
+
+
+class Server(http.server.ThreadingHTTPServer):
+    request_queue_size = 64  # Accept all the concurrent connections.
+
+
+port = int(sys.argv[1]) if len(sys.argv) > 1 else 8000
+Server(('localhost', port), Handler).serve_forever()